@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "local_duckdb.h"
+
+/*
+ * Per-query overhead of the cloud database of the server.
+ *
+ * Runs the queries of a file (one SQL per line) [iterations] times in three ways:
+ *      reopen      open the database and a connection for every query
+ *      connection  one database, a new connection for every query
+ *      pool        LocalDuckdb: pooled connections and prepared statements
+ *
+ * usage: pvd_duckdb_bench <database file> <queries.sql> [iterations]
+ *
+ * Use small queries (e.g. the SCache warmup queries of a plan) to see the fixed cost of a query.
+ */
+
+template <typename F>
+std::vector<double> measure(const std::vector<std::string>& queries, int iterations, F run)
+{
+    std::vector<double> latencies;
+    for (int i = 0; i < iterations; i++) {
+        for (auto& sql : queries) {
+            auto start = std::chrono::steady_clock::now();
+            run(sql);
+            latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+    return latencies;
+}
+
+void report(const std::string& mode, const std::vector<double>& latencies, bool last)
+{
+    double total = 0;
+    for (double latency : latencies) {
+        total += latency;
+    }
+    std::cout << "  \"" << mode << "\": {\"queries\": " << latencies.size()
+              << ", \"mean_us\": " << total / latencies.size()
+              << ", \"p50_us\": " << latencies[latencies.size() / 2]
+              << ", \"p99_us\": " << latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)]
+              << "}" << (last ? "" : ",") << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        std::cout << "usage: pvd_duckdb_bench <database file> <queries.sql> [iterations]" << std::endl;
+        return 1;
+    }
+    std::string path = argv[1];
+    std::vector<std::string> queries;
+    std::ifstream queries_file(argv[2]);
+    for (std::string line; std::getline(queries_file, line);) {
+        if (!line.empty()) queries.push_back(line);
+    }
+    if (queries.empty()) {
+        std::cout << "no queries in " << argv[2] << std::endl;
+        return 1;
+    }
+    int iterations = argc > 3 ? std::stoi(argv[3]) : 10;
+
+    auto reopen = measure(queries, iterations, [&path](const std::string& sql) {
+        duckdb::DuckDB db(path);
+        duckdb::Connection con(db);
+        LocalDuckdb::query_table(con, sql);
+    });
+
+    std::vector<double> connection;
+    {
+        duckdb::DuckDB db(path);
+        connection = measure(queries, iterations, [&db](const std::string& sql) {
+            duckdb::Connection con(db);
+            LocalDuckdb::query_table(con, sql);
+        });
+    }
+
+    std::vector<double> pool;
+    {
+        LocalDuckdb cloud(path, 1);
+        // LocalDuckdb logs every query to stdout, keep the report clean
+        std::ofstream null_stream;
+        auto stdout_buf = std::cout.rdbuf(null_stream.rdbuf());
+        pool = measure(queries, iterations, [&cloud](const std::string& sql) {
+            cloud.query(sql, [](std::shared_ptr<arrow::Table>) {});
+        });
+        std::cout.rdbuf(stdout_buf);
+    }
+
+    std::cout << "{" << std::endl;
+    report("reopen", reopen, false);
+    report("connection", connection, false);
+    report("pool", pool, true);
+    std::cout << "}" << std::endl;
+    return 0;
+}
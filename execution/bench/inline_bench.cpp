@@ -0,0 +1,75 @@
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "arrow_utils.h"
+
+/*
+ * Calibrates the row threshold of the inline execution of Filter and Projection
+ * (DEFAULT_INLINE_MAX_ROWS in arrow_utils.h).
+ *
+ * For tables of increasing size, runs the same filter + projection as an Acero plan
+ * and inline with arrow compute kernels, and reports the mean latency of both.
+ * The threshold is the largest size where the inline execution is at least 1.5x faster:
+ * above it the fixed setup cost of Acero is no longer the larger part, and Acero can
+ * spread the rows over its threads while the inline execution uses one.
+ *
+ * usage: pvd_inline_bench [iterations]
+ */
+
+static std::shared_ptr<arrow::Table> make_table(int64_t num_rows)
+{
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int64_t> dist(0, 1000);
+    arrow::Int64Builder a;
+    arrow::DoubleBuilder b;
+    for (int64_t i = 0; i < num_rows; i++) {
+        (void)a.Append(dist(rng));
+        (void)b.Append(dist(rng) * 0.5);
+    }
+    auto schema = arrow::schema({arrow::field("a", arrow::int64()), arrow::field("b", arrow::float64())});
+    return arrow::Table::Make(schema, {a.Finish().ValueOrDie(), b.Finish().ValueOrDie()});
+}
+
+template <typename F>
+static double mean_us(int iterations, F run)
+{
+    run();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        run();
+    }
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+int main(int argc, char** argv)
+{
+    int iterations = argc > 1 ? std::stoi(argv[1]) : 50;
+    auto cond = cp::greater(cp::field_ref("a"), cp::literal(int64_t(500)));
+    std::vector<cp::Expression> projs = {cp::call("multiply", {cp::field_ref("a"), cp::literal(int64_t(2))}),
+                                         cp::call("add", {cp::field_ref("b"), cp::literal(1.0)})};
+    std::vector<std::string> names = {"a2", "b1"};
+
+    int64_t threshold = 0;
+    std::cout << "{\"sizes\": [" << std::endl;
+    for (int64_t num_rows = 16; num_rows <= (1 << 20); num_rows *= 4) {
+        auto table = make_table(num_rows);
+        double acero = mean_us(iterations, [&]() {
+            auto source = ac::Declaration("table_source", {}, ac::TableSourceNodeOptions{table, default_batch_size()});
+            auto filter = ac::Declaration("filter", {source}, ac::FilterNodeOptions{cond});
+            auto project = ac::Declaration("project", {filter}, ac::ProjectNodeOptions{projs, names});
+            declaration_to_table(project);
+        });
+        double inline_ = mean_us(iterations, [&]() {
+            project_table(filter_table(table, cond), projs, names);
+        });
+        if (inline_ * 1.5 < acero) {
+            threshold = num_rows;
+        }
+        std::cout << "  {\"rows\": " << num_rows << ", \"acero_us\": " << acero << ", \"inline_us\": " << inline_ << "}"
+                  << (num_rows * 4 <= (1 << 20) ? "," : "") << std::endl;
+    }
+    std::cout << "], \"inline_max_rows\": " << threshold << "}" << std::endl;
+    return 0;
+}
@@ -0,0 +1,156 @@
+#define ASIO_STANDALONE
+
+#include <websocketpp/config/asio_no_tls_client.hpp>
+#include <websocketpp/client.hpp>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "network.h"
+#include "json.h"
+
+using json = nlohmann::json;
+
+/*
+ * Closed-loop load generator for pvd_server.
+ *
+ * Each simulated client opens its own websocket, registers the plan, then sends
+ * Execute queries for [node] one after another (the next query is sent when the
+ * previous reply arrives), cycling through the bindings file (one binding json per line).
+ *
+ * usage: pvd_load_test <port> <plan.json> <node id> <bindings.jsonl> [num clients] [queries per client]
+ *
+ * Run it against servers started with different --exec-threads to see throughput scale with cores.
+ */
+
+typedef websocketpp::client<websocketpp::config::asio_client> ws_client;
+
+struct LoadClient
+{
+    ws_client client;
+    websocketpp::connection_hdl hdl;
+    const std::string& plan_json;
+    const std::vector<std::string>& bindings;
+    int node;
+    int num_queries;
+    int sent = 0;
+    int32_t next_id = 0;
+    std::vector<double> latencies;
+    std::chrono::steady_clock::time_point sent_at;
+
+    LoadClient(const std::string& plan_json, const std::vector<std::string>& bindings, int node, int num_queries)
+            : plan_json(plan_json), bindings(bindings), node(node), num_queries(num_queries) {}
+
+    void send_query(pvd::Query::Message msg, const std::string& content)
+    {
+        pvd::Query query = {msg, node, static_cast<int64_t>(content.size() + 1)};
+        std::string buf(sizeof(int32_t) + sizeof(query) + content.size() + 1, '\0');
+        int32_t id = next_id++;
+        memcpy(buf.data(), &id, sizeof(id));
+        memcpy(buf.data() + sizeof(id), &query, sizeof(query));
+        memcpy(buf.data() + sizeof(id) + sizeof(query), content.c_str(), content.size() + 1);
+        sent_at = std::chrono::steady_clock::now();
+        client.send(hdl, buf.data(), buf.size(), websocketpp::frame::opcode::binary);
+    }
+
+    void send_next()
+    {
+        if (sent == num_queries) {
+            client.close(hdl, websocketpp::close::status::normal, "done");
+            return;
+        }
+        send_query(pvd::Query::Execute, bindings[sent % bindings.size()]);
+        sent++;
+    }
+
+    void run(const std::string& uri)
+    {
+        client.clear_access_channels(websocketpp::log::alevel::all);
+        client.clear_error_channels(websocketpp::log::elevel::all);
+        client.init_asio();
+        client.set_open_handler([this](websocketpp::connection_hdl h) {
+            hdl = h;
+            send_query(pvd::Query::Init, plan_json);
+        });
+        client.set_message_handler([this](websocketpp::connection_hdl h, ws_client::message_ptr msg) {
+            if (msg->get_opcode() == websocketpp::frame::opcode::text) {
+                std::cout << msg->get_payload() << std::endl;
+                client.close(hdl, websocketpp::close::status::normal, "error");
+                return;
+            }
+            int32_t id = *(const int32_t*)msg->get_payload().data();
+            if (id > 0) {
+                // id 0 is the Init reply
+                auto now = std::chrono::steady_clock::now();
+                latencies.push_back(std::chrono::duration<double, std::milli>(now - sent_at).count());
+            }
+            send_next();
+        });
+        websocketpp::lib::error_code ec;
+        auto con = client.get_connection(uri, ec);
+        if (ec) {
+            std::cout << "Connection failed: " << ec.message() << std::endl;
+            return;
+        }
+        client.connect(con);
+        client.run();
+    }
+};
+
+int main(int argc, char** argv)
+{
+    if (argc < 5) {
+        std::cout << "usage: pvd_load_test <port> <plan.json> <node id> <bindings.jsonl> [num clients] [queries per client]" << std::endl;
+        return 1;
+    }
+    std::string uri = std::string("ws://localhost:") + argv[1];
+    std::ifstream plan_file(argv[2]);
+    std::string plan_json = json::parse(plan_file).dump();
+    int node = std::stoi(argv[3]);
+    std::vector<std::string> bindings;
+    std::ifstream bindings_file(argv[4]);
+    for (std::string line; std::getline(bindings_file, line);) {
+        if (!line.empty()) bindings.push_back(json::parse(line).dump());
+    }
+    if (bindings.empty()) {
+        std::cout << "no bindings in " << argv[4] << std::endl;
+        return 1;
+    }
+    int num_clients = argc > 5 ? std::stoi(argv[5]) : 8;
+    int num_queries = argc > 6 ? std::stoi(argv[6]) : 100;
+
+    std::vector<std::unique_ptr<LoadClient>> clients;
+    for (int i = 0; i < num_clients; i++) {
+        clients.push_back(std::make_unique<LoadClient>(plan_json, bindings, node, num_queries));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (auto& client : clients) {
+        threads.emplace_back([&client, &uri]() { client->run(uri); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<double> latencies;
+    for (auto& client : clients) {
+        latencies.insert(latencies.end(), client->latencies.begin(), client->latencies.end());
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        return latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1, (size_t)(p * latencies.size()))];
+    };
+    std::cout << "{\"clients\": " << num_clients
+              << ", \"queries\": " << latencies.size()
+              << ", \"seconds\": " << seconds
+              << ", \"throughput\": " << latencies.size() / seconds
+              << ", \"p50_ms\": " << percentile(0.5)
+              << ", \"p95_ms\": " << percentile(0.95)
+              << ", \"p99_ms\": " << percentile(0.99) << "}" << std::endl;
+    return 0;
+}
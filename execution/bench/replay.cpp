@@ -0,0 +1,419 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#include "plan.h"
+#include "binding.h"
+#include "cloud_api.h"
+#include "metrics.h"
+#include "executor.h"
+#include "local_duckdb.h"
+#include "loopback.h"
+#include "unix_socket.h"
+#include "memory_accounting.h"
+#include "json.h"
+
+using json = nlohmann::json;
+
+/*
+ * Replays the interactions of a bundled dashboard (plans/*.js) on every physical plan variant,
+ * without a browser: the client plan runs on the main thread and reaches the server code
+ * (ServerHandler, sessions, executor, DuckDB) through an in-process LoopbackSender, or a
+ * pvd_server started with --unix through a UnixSocketSender. The messages and the replies can
+ * be delayed by a link latency (one-way) and bandwidth, like the network of a browser.
+ *
+ * For each variant, the plan is initialized as Module.register of index.html does, then the
+ * interactions are executed one after another with execute_subplan. The interactions are
+ * synthetic (as in index.html: a new binding of all choices every 5 rounds, the "switch-on",
+ * and in between only the choices of the task of the variant change) or replayed from a file.
+ *
+ * Reports, per variant: the initialization time, p50 / p95 / p99 of the interaction latency
+ * (all, switch-on, following), the bytes retained by the client caches, the memory stats of
+ * the server (see the Stats message) and the RSS of the process.
+ * The client and the server share the process: the Arrow allocations and the peak RSS of the
+ * server stats are those of the process (run one variant per process with --variant to compare
+ * them), the operator pools of a session only count its own nodes.
+ *
+ * usage: pvd_replay <plans/workload.js> [--variant NAME] [--rounds N] [--seed N]
+ *                   [--bindings FILE] [--record FILE] [--db FILE] [--threads N] [--out FILE]
+ *                   [--unix PATH] [--latency-ms N] [--bandwidth-mbps N]
+ *
+ * A bindings file has one interaction per line, {"variant": ..., "switch_on": ..., "binding": {...}}
+ * (as written by --record) or a plain binding json. Lines with another variant are skipped.
+ */
+
+thread_local pvd::QuerySender* pvd::SENDER = nullptr;
+pvd::CloudApi* pvd::cloud = nullptr;
+// the trace is not written
+std::ofstream pvd::log_file;
+
+typedef std::chrono::steady_clock clock_type;
+
+struct Workload
+{
+    std::string name;
+    // variant -> plan json
+    json plans;
+    // choice id -> values to pick from
+    json values;
+    // variant -> the choices changed by the following interactions
+    json tasks;
+};
+
+struct Interaction
+{
+    bool switch_on;
+    json binding;
+};
+
+/*
+ * the plans file declares var <name>_plans = {...}; var <name>_values = {...}; var <name>_tasks = {...};
+ */
+static Workload load_workload(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Can not open " + path);
+    }
+    Workload workload;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.rfind("var ", 0) != 0) {
+            continue;
+        }
+        auto eq = line.find(" = ");
+        auto underscore = line.rfind('_', eq);
+        if (eq == std::string::npos || underscore == std::string::npos) {
+            continue;
+        }
+        auto kind = line.substr(underscore + 1, eq - underscore - 1);
+        auto value = line.substr(eq + 3);
+        while (!value.empty() && (value.back() == ';' || std::isspace(static_cast<unsigned char>(value.back())))) {
+            value.pop_back();
+        }
+        workload.name = line.substr(4, underscore - 4);
+        if (kind == "plans") workload.plans = json::parse(value);
+        else if (kind == "values") workload.values = json::parse(value);
+        else if (kind == "tasks") workload.tasks = json::parse(value);
+    }
+    if (workload.plans.empty()) {
+        throw std::runtime_error("No plans in " + path);
+    }
+    return workload;
+}
+
+static const json& random_select(const json& array, std::mt19937& rng)
+{
+    std::uniform_int_distribution<size_t> dist(0, array.size() - 1);
+    return array[dist(rng)];
+}
+
+// a new binding of all choices, the lower bound of a range is below its upper bound
+static json full_binding(const json& values, std::mt19937& rng)
+{
+    json binding = json::object();
+    for (auto& [choice, domain] : values.items()) {
+        binding[choice] = random_select(domain, rng);
+    }
+    for (auto& [choice, _] : values.items()) {
+        auto pos = choice.find("lower");
+        if (pos == std::string::npos) {
+            continue;
+        }
+        auto upper = std::string(choice).replace(pos, 5, "upper");
+        if (binding.contains(upper) && binding[choice]["value"] > binding[upper]["value"]) {
+            std::swap(binding[choice], binding[upper]);
+        }
+    }
+    return binding;
+}
+
+// change the choices of the task: a value, or a [lower, upper] range
+static void interact(json& binding, const json& values, const json& task, std::mt19937& rng)
+{
+    for (auto& choice : task) {
+        if (!choice.is_array()) {
+            binding[choice.get<std::string>()] = random_select(values[choice.get<std::string>()], rng);
+            continue;
+        }
+        auto lower_id = choice[0].get<std::string>();
+        auto upper_id = choice[1].get<std::string>();
+        json lower = random_select(values[lower_id], rng);
+        json upper = random_select(values[upper_id], rng);
+        if (lower["value"] > upper["value"]) {
+            std::swap(lower, upper);
+        }
+        if ((lower_id.find("ra") != std::string::npos || lower_id.find("dec") != std::string::npos) &&
+            lower["value"].is_number()) {
+            // sky coordinates: zoom into a random 1/16 of the range
+            double l = lower["value"].get<double>();
+            double r = upper["value"].get<double>();
+            std::bernoulli_distribution half(0.5);
+            for (int i = 0; i < 4; i++) {
+                double m = (l + r) / 2;
+                if (half(rng)) l = m;
+                else r = m;
+            }
+            lower["value"] = l;
+            upper["value"] = r;
+        }
+        binding[lower_id] = lower;
+        binding[upper_id] = upper;
+    }
+}
+
+static std::vector<Interaction> synthetic_interactions(const Workload& workload, const std::string& variant,
+                                                       int rounds, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    const json& task = workload.tasks.contains(variant) ? workload.tasks[variant] : json::array();
+    std::vector<Interaction> interactions;
+    json binding;
+    for (int round = 0; round < rounds; round++) {
+        bool switch_on = round % 5 == 0;
+        if (switch_on) {
+            binding = full_binding(workload.values, rng);
+        }
+        interact(binding, workload.values, task, rng);
+        interactions.push_back({switch_on, binding});
+    }
+    return interactions;
+}
+
+static std::vector<Interaction> recorded_interactions(const std::string& path, const std::string& variant)
+{
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Can not open " + path);
+    }
+    std::vector<Interaction> interactions;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        auto entry = json::parse(line);
+        if (!entry.contains("binding")) {
+            interactions.push_back({interactions.empty(), entry});
+            continue;
+        }
+        if (entry.contains("variant") && entry["variant"] != variant) {
+            continue;
+        }
+        interactions.push_back({entry.value("switch_on", interactions.empty()), entry["binding"]});
+    }
+    return interactions;
+}
+
+static double elapsed_ms(clock_type::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+}
+
+static json summarize(std::vector<double> latencies)
+{
+    if (latencies.empty()) {
+        return {{"count", 0}};
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double q) {
+        size_t rank = static_cast<size_t>(std::ceil(q * latencies.size()));
+        return latencies[std::clamp<size_t>(rank, 1, latencies.size()) - 1];
+    };
+    double sum = 0;
+    for (double latency : latencies) {
+        sum += latency;
+    }
+    return {
+        {"count", latencies.size()},
+        {"mean_ms", sum / latencies.size()},
+        {"p50_ms", percentile(0.50)},
+        {"p95_ms", percentile(0.95)},
+        {"p99_ms", percentile(0.99)},
+        {"max_ms", latencies.back()},
+    };
+}
+
+static json run_variant(pvd::NativeSender& sender, const Workload& workload, const std::string& variant,
+                        const std::vector<Interaction>& interactions)
+{
+    pvd::SENDER = &sender;
+    struct ResetSender { ~ResetSender() { pvd::SENDER = nullptr; } } reset_sender;
+
+    // register the plan: Init at the server, then the initialization of the client plan
+    pvd::PlanContext context;
+    auto plan = pvd::parse_json_plan(workload.plans[variant], context);
+    auto plan_str = workload.plans[variant].dump();
+    bool initialized = false;
+    auto start = clock_type::now();
+    pvd::Query init = {pvd::Query::Init, plan->id, static_cast<int64_t>(plan_str.size() + 1)};
+    sender.send(init, (void*)plan_str.c_str(), [plan, &initialized](pvd::Reply reply) {
+        plan->initialize([&initialized](std::exception_ptr error) {
+            if (error) std::rethrow_exception(error);
+            initialized = true;
+        });
+    });
+    sender.run_until_idle();
+    if (!initialized) {
+        throw std::runtime_error("The plan is not initialized");
+    }
+    double init_ms = elapsed_ms(start);
+
+    std::vector<double> all, switch_on, following;
+    for (auto& interaction : interactions) {
+        auto binding = pvd::parse_json_binding(interaction.binding);
+        bool done = false;
+        start = clock_type::now();
+        plan->execute_subplan(binding, plan->id, [&done](std::shared_ptr<pvd::SerialData> data) { done = true; });
+        sender.run_until_idle();
+        if (!done) {
+            throw std::runtime_error("An interaction did not complete");
+        }
+        double latency = elapsed_ms(start);
+        all.push_back(latency);
+        (interaction.switch_on ? switch_on : following).push_back(latency);
+    }
+
+    pvd::BufferSet counted;
+    int64_t client_cache_bytes = 0;
+    for (auto& [node_id, node] : context.nodes) {
+        client_cache_bytes += node->cache_memory(counted).retained_bytes;
+    }
+    json server_stats;
+    static const char empty[] = "";
+    pvd::Query stats = {pvd::Query::Stats, 0, sizeof(empty)};
+    sender.send(stats, (void*)empty, [&server_stats](pvd::Reply reply) {
+        server_stats = json::parse(static_cast<const char*>(reply.data));
+    });
+    sender.run_until_idle();
+
+    return {
+        {"variant", variant},
+        {"init_ms", init_ms},
+        {"latency", {{"all", summarize(all)}, {"switch_on", summarize(switch_on)}, {"following", summarize(following)}}},
+        {"memory", {
+            {"client_cache_bytes", client_cache_bytes},
+            {"rss_bytes", pvd::current_rss_bytes()},
+            {"peak_rss_bytes", pvd::peak_rss_bytes()},
+            {"server", server_stats},
+        }},
+    };
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::cout << "usage: pvd_replay <plans/workload.js> [--variant NAME] [--rounds N] [--seed N] "
+                     "[--bindings FILE] [--record FILE] [--db FILE] [--threads N] [--out FILE] "
+                     "[--unix PATH] [--latency-ms N] [--bandwidth-mbps N]" << std::endl;
+        return 1;
+    }
+    std::string variant_arg, bindings_path, record_path, out_path, unix_path;
+    pvd::LinkShape shape;
+    std::string db_path = "../../data/pvd.db";
+    int rounds = 20;
+    unsigned seed = 42;
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--variant") variant_arg = argv[i + 1];
+        else if (arg == "--rounds") rounds = std::stoi(argv[i + 1]);
+        else if (arg == "--seed") seed = static_cast<unsigned>(std::stoul(argv[i + 1]));
+        else if (arg == "--bindings") bindings_path = argv[i + 1];
+        else if (arg == "--record") record_path = argv[i + 1];
+        else if (arg == "--db") db_path = argv[i + 1];
+        else if (arg == "--threads") threads = std::stoi(argv[i + 1]);
+        else if (arg == "--out") out_path = argv[i + 1];
+        else if (arg == "--unix") unix_path = argv[i + 1];
+        else if (arg == "--latency-ms") {
+            shape.latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::duration<double, std::milli>(std::stod(argv[i + 1])));
+        }
+        else if (arg == "--bandwidth-mbps") shape.bytes_per_second = std::stod(argv[i + 1]) * 1e6 / 8;
+        else {
+            std::cout << "Unknown argument " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    auto workload = load_workload(argv[1]);
+    if (out_path.empty()) {
+        out_path = workload.name + "_replay.json";
+    }
+    std::vector<std::string> variants;
+    for (auto& [variant, _] : workload.plans.items()) {
+        if (variant_arg.empty() || variant == variant_arg) {
+            variants.push_back(variant);
+        }
+    }
+    if (variants.empty()) {
+        std::cout << "No variant " << variant_arg << " in " << argv[1] << std::endl;
+        return 1;
+    }
+
+    // the server runs in this process, unless it is a pvd_server at [unix_path]
+    std::unique_ptr<pvd::Executor> executor;
+    std::unique_ptr<pvd::ServerHandler> handler;
+    if (unix_path.empty()) {
+        executor = std::make_unique<pvd::Executor>(threads);
+        pvd::cloud = new LocalDuckdb(db_path, threads);
+        handler = std::make_unique<pvd::ServerHandler>(executor.get());
+    }
+    // one connection per variant, its sessions are dropped at the end
+    auto connect = [&]() -> std::unique_ptr<pvd::NativeSender> {
+        if (unix_path.empty()) {
+            return std::make_unique<pvd::LoopbackSender>(*handler, shape);
+        }
+        return std::make_unique<pvd::UnixSocketSender>(unix_path, shape);
+    };
+    std::ofstream record;
+    if (!record_path.empty()) {
+        record.open(record_path);
+    }
+
+    json results = {
+        {"workload", workload.name},
+        {"link", {{"latency_ms", std::chrono::duration<double, std::milli>(shape.latency).count()},
+                  {"bytes_per_second", shape.bytes_per_second}}},
+        {"variants", json::array()},
+    };
+    for (auto& variant : variants) {
+        // every variant replays the same interactions
+        auto interactions = bindings_path.empty() ? synthetic_interactions(workload, variant, rounds, seed)
+                                                  : recorded_interactions(bindings_path, variant);
+        for (auto& interaction : interactions) {
+            if (record.is_open()) {
+                record << json({{"variant", variant}, {"switch_on", interaction.switch_on},
+                                {"binding", interaction.binding}}).dump() << "\n";
+            }
+        }
+        try {
+            auto sender = connect();
+            results["variants"].push_back(run_variant(*sender, workload, variant, interactions));
+        }
+        catch (std::exception& e) {
+            std::cerr << workload.name << "&" << variant << " failed: " << e.what() << std::endl;
+            results["variants"].push_back({{"variant", variant}, {"error", e.what()}});
+        }
+    }
+
+    std::ofstream(out_path) << results.dump(2) << std::endl;
+    // the execution logs go to stdout, the summary to stderr
+    for (auto& result : results["variants"]) {
+        if (result.contains("error")) {
+            continue;
+        }
+        auto& latency = result["latency"]["all"];
+        std::cerr << workload.name << "&" << result["variant"].get<std::string>()
+                  << ": init " << result["init_ms"].get<double>() << " ms, p50 " << latency.value("p50_ms", 0.0)
+                  << " ms, p95 " << latency.value("p95_ms", 0.0) << " ms, p99 " << latency.value("p99_ms", 0.0)
+                  << " ms, switch-on p50 " << result["latency"]["switch_on"].value("p50_ms", 0.0) << " ms" << std::endl;
+    }
+    std::cerr << "results written to " << out_path << std::endl;
+    return 0;
+}
@@ -0,0 +1,959 @@
+#include <sys/utsname.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <random>
+#include <regex>
+#include <thread>
+
+#include "plan.h"
+#include "expression.h"
+#include "arrow_utils.h"
+#include "local_duckdb.h"
+#include "json.h"
+
+using json = nlohmann::json;
+
+/*
+ * Micro-benchmarks of the data structures of the plans: HashTable, RTree, PrefixSum and PrefixSum2D,
+ * of the lookup of a binding in the caches (Binding/), and of the dispatch of an execution to its node (Plan/).
+ *
+ * For each structure: the build (the Build plan node over a table in memory), the query (the
+ * query of the Impl, without the plan), serialize / deserialize, and the memory of the structure.
+ * The synthetic tables sweep the number of rows, the number of keys (HashTable), the dimensions
+ * (RTree) and the cardinality of the prefix sums. The queries sweep the selectivity: the fraction
+ * of the space of an RTree or of the sum columns of a prefix sum covered by the range.
+ * With --db, the structures of the bundled dashboards are built on data/pvd.db too.
+ *
+ * The results are in the JSON format of Google Benchmark (times in ns per iteration, the other
+ * numbers as counters), so the results of two commits can be compared with its compare.py.
+ *
+ * With --calibrate, fits the cost model of the optimizer to this machine instead (see calibrate()).
+ *
+ * usage: pvd_bench [--filter REGEX] [--min-time SECONDS] [--max-rows N] [--db FILE] [--out FILE (pvd_bench.json)]
+ *        pvd_bench --calibrate PROFILE [--side server|client] [--bandwidth-mbps B] [--max-rows N]
+ */
+
+thread_local pvd::QuerySender* pvd::SENDER = nullptr;
+pvd::CloudApi* pvd::cloud = nullptr;
+std::ofstream pvd::log_file;
+
+static double process_cpu_seconds()
+{
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Runs each benchmark for at least [min_time] seconds, the number of iterations grows
+ * from 1 until the runs take long enough
+ */
+class Runner
+{
+    std::regex filter;
+    double min_time;
+
+public:
+    json benchmarks = json::array();
+
+    Runner(const std::string& filter, double min_time) : filter(filter), min_time(min_time) {}
+
+    bool enabled(const std::string& name) const
+    {
+        return std::regex_search(name, filter);
+    }
+
+    /*
+     * run the benchmark and return its entry (to add counters),
+     * nullptr if it is filtered out or failed
+     */
+    json* run(const std::string& name, int64_t items_per_iteration, int64_t bytes_per_iteration, const std::function<void()>& f)
+    {
+        if (!enabled(name)) {
+            return nullptr;
+        }
+        try {
+            f();
+            int64_t iterations = 1;
+            double real, cpu;
+            while (true) {
+                auto start = std::chrono::steady_clock::now();
+                double cpu_start = process_cpu_seconds();
+                for (int64_t i = 0; i < iterations; i++) {
+                    f();
+                }
+                real = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                cpu = process_cpu_seconds() - cpu_start;
+                if (real >= min_time || iterations >= 1000000000) {
+                    break;
+                }
+                // aim 40% over the min time, at most 10x more iterations per round
+                double multiplier = real > 0 ? min_time * 1.4 / real : 10;
+                iterations = std::max<int64_t>(iterations + 1, iterations * std::min(multiplier, 10.0));
+            }
+            json entry = {
+                {"name", name},
+                {"run_name", name},
+                {"run_type", "iteration"},
+                {"iterations", iterations},
+                {"real_time", real * 1e9 / iterations},
+                {"cpu_time", cpu * 1e9 / iterations},
+                {"time_unit", "ns"},
+            };
+            if (items_per_iteration > 0) {
+                entry["items_per_second"] = items_per_iteration * iterations / real;
+            }
+            if (bytes_per_iteration > 0) {
+                entry["bytes_per_second"] = bytes_per_iteration * iterations / real;
+            }
+            std::cerr << name << ": " << real * 1e9 / iterations << " ns (" << iterations << " iterations)" << std::endl;
+            benchmarks.push_back(std::move(entry));
+            return &benchmarks.back();
+        }
+        catch (std::exception& e) {
+            fail(name, e.what());
+            return nullptr;
+        }
+    }
+
+    void fail(const std::string& name, const std::string& message)
+    {
+        if (!enabled(name)) {
+            return;
+        }
+        std::cerr << name << ": " << message << std::endl;
+        benchmarks.push_back({
+            {"name", name}, {"run_name", name}, {"run_type", "iteration"},
+            {"error_occurred", true}, {"error_message", message}});
+    }
+};
+
+// the input of a build: a table in memory
+class TableInput : public pvd::Plan
+{
+    std::shared_ptr<pvd::TableData> data;
+
+public:
+    TableInput(int id, std::shared_ptr<arrow::Table> table) : Plan(id), data(std::make_shared<pvd::TableData>(table)) {}
+    std::vector<std::shared_ptr<Plan>> input_plans() const override { return {}; }
+    void execute(const pvd::BindingMap& binding, pvd::execute_callback_t cb) override { cb(data); }
+    void pick_useful_binding(const pvd::BindingMap& binding, pvd::BindingMap& useful_binding) override {}
+    std::string to_sql(const pvd::BindingMap& binding) const override { return ""; }
+    std::string to_string() const override { return "TableInput[" + std::to_string(id) + "]"; }
+    void get_all_choice_nodes(std::unordered_map<std::string, std::shared_ptr<pvd::ChoiceExpr>>& choice_nodes) override {}
+};
+
+static int next_id = 1;
+
+static std::shared_ptr<pvd::Expression> column(const std::string& name)
+{
+    return std::make_shared<pvd::ColumnRef>(name, "");
+}
+
+static std::shared_ptr<arrow::ChunkedArray> get_column(std::shared_ptr<arrow::Table> table, const std::string& name)
+{
+    auto column = table->GetColumnByName(name);
+    if (!column) {
+        throw std::runtime_error("No column " + name + " in " + table->schema()->ToString());
+    }
+    return column;
+}
+
+static std::shared_ptr<pvd::SerialData> run_build(pvd::Plan& plan)
+{
+    std::shared_ptr<pvd::SerialData> result;
+    plan.execute({}, [&result](std::shared_ptr<pvd::SerialData> data) { result = std::move(data); });
+    return result;
+}
+
+/*
+ * benchmark the build of the structure and return it (nullptr if it failed),
+ * the entry has the memory of the structure and the peak of the memory pool of the build
+ */
+static std::shared_ptr<pvd::SerialData> bench_build(Runner& runner, const std::string& name,
+                                                    std::shared_ptr<pvd::Plan> plan, int64_t num_rows)
+{
+    std::shared_ptr<pvd::SerialData> result;
+    auto entry = runner.run(name, num_rows, 0, [&]() { result = run_build(*plan); });
+    if (!result && !runner.enabled(name)) {
+        result = run_build(*plan);
+    }
+    if (entry) {
+        (*entry)["rows"] = num_rows;
+        (*entry)["memory_bytes"] = result->size();
+        (*entry)["pool_peak_bytes"] = plan->memory_pool()->max_memory();
+    }
+    return result;
+}
+
+static std::shared_ptr<arrow::Buffer> serialize(pvd::SerialData& data)
+{
+    auto out = arrow::io::BufferOutputStream::Create().ValueOrDie();
+    data.serialize(out);
+    return out->Finish().ValueOrDie();
+}
+
+static void bench_serialization(Runner& runner, const std::string& structure, const std::string& params,
+                                std::shared_ptr<pvd::SerialData> data,
+                                const std::function<std::shared_ptr<pvd::SerialData>()>& make_empty)
+{
+    auto serialize_name = structure + "/serialize/" + params;
+    auto deserialize_name = structure + "/deserialize/" + params;
+    std::shared_ptr<arrow::Buffer> serialized;
+    try {
+        serialized = serialize(*data);
+    }
+    catch (std::exception& e) {
+        runner.fail(serialize_name, e.what());
+        runner.fail(deserialize_name, e.what());
+        return;
+    }
+    if (auto entry = runner.run(serialize_name, 1, serialized->size(), [&]() { serialize(*data); })) {
+        (*entry)["serialized_bytes"] = serialized->size();
+    }
+    runner.run(deserialize_name, 1, serialized->size(), [&]() {
+        make_empty()->deserialize(std::make_shared<arrow::io::BufferReader>(serialized));
+    });
+}
+
+template <typename Query>
+static void bench_queries(Runner& runner, const std::string& name, const std::vector<Query>& queries,
+                          const std::function<std::shared_ptr<pvd::TableData>(const Query&)>& query)
+{
+    size_t next = 0;
+    int64_t result_rows = 0, count = 0;
+    auto entry = runner.run(name, 1, 0, [&]() {
+        result_rows += query(queries[next++ % queries.size()])->table->num_rows();
+        count++;
+    });
+    if (entry) {
+        (*entry)["result_rows"] = static_cast<double>(result_rows) / count;
+    }
+}
+
+static const int NUM_QUERIES = 256;
+static const std::vector<double> SELECTIVITIES = {0.001, 0.01, 0.1};
+
+static std::string selectivity_param(double selectivity)
+{
+    std::ostringstream out;
+    out << "selectivity:" << selectivity;
+    return out.str();
+}
+
+static bool any_enabled(const Runner& runner, const std::string& structure, const std::string& params)
+{
+    for (auto op : {"build", "query", "serialize", "deserialize"}) {
+        if (runner.enabled(structure + "/" + op + "/" + params)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// keys: columns of the key, the queries are the keys of random rows (always found)
+static void bench_hash_table(Runner& runner, const std::string& params, std::shared_ptr<arrow::Table> table,
+                             const std::vector<std::string>& keys, std::mt19937_64& rng)
+{
+    if (!any_enabled(runner, "HashTable", params)) {
+        return;
+    }
+    std::vector<std::shared_ptr<pvd::Expression>> key_exprs;
+    for (auto& key : keys) {
+        key_exprs.push_back(column(key));
+    }
+    auto plan = std::make_shared<pvd::HashTableBuild>(next_id++, std::make_shared<TableInput>(next_id++, table), key_exprs);
+    auto data = bench_build(runner, "HashTable/build/" + params, plan, table->num_rows());
+    if (!data) {
+        return;
+    }
+    auto hash_table = std::dynamic_pointer_cast<pvd::HashTableImpl>(data);
+
+    std::vector<uint64_t> queries;
+    std::uniform_int_distribution<int64_t> row(0, table->num_rows() - 1);
+    for (int i = 0; i < NUM_QUERIES; i++) {
+        std::vector<std::shared_ptr<arrow::Scalar>> key;
+        int64_t r = row(rng);
+        for (auto& name : keys) {
+            key.push_back(get_column(table, name)->GetScalar(r).ValueOrDie());
+        }
+        queries.push_back(hash_scalars(key));
+    }
+    bench_queries<uint64_t>(runner, "HashTable/query/" + params, queries,
+                            [&hash_table](const uint64_t& key) { return hash_table->query(key); });
+    bench_serialization(runner, "HashTable", params, data, []() { return std::make_shared<pvd::HashTableImpl>(); });
+}
+
+// the range of a column, for the query boxes
+static std::pair<double, double> column_range(std::shared_ptr<arrow::ChunkedArray> values)
+{
+    auto min_max = cp::MinMax(values->Slice(0)).ValueOrDie().scalar_as<arrow::StructScalar>();
+    auto to_double = [](std::shared_ptr<arrow::Scalar> scalar) {
+        return std::static_pointer_cast<arrow::DoubleScalar>(scalar->CastTo(arrow::float64()).ValueOrDie())->value;
+    };
+    return {to_double(min_max.value[0]), to_double(min_max.value[1])};
+}
+
+static void bench_rtree(Runner& runner, const std::string& params, std::shared_ptr<arrow::Table> table,
+                        const std::vector<std::string>& keys, std::mt19937_64& rng)
+{
+    if (!any_enabled(runner, "RTree", params)) {
+        return;
+    }
+    std::vector<std::shared_ptr<pvd::Expression>> key_exprs;
+    std::vector<std::pair<double, double>> ranges;
+    for (auto& key : keys) {
+        key_exprs.push_back(column(key));
+        ranges.push_back(column_range(get_column(table, key)));
+    }
+    auto plan = std::make_shared<pvd::RTreeBuild>(next_id++, std::make_shared<TableInput>(next_id++, table), key_exprs);
+    auto data = bench_build(runner, "RTree/build/" + params, plan, table->num_rows());
+    if (!data) {
+        return;
+    }
+    auto rtree = std::dynamic_pointer_cast<pvd::RTreeImpl>(data);
+
+    typedef std::pair<std::vector<double>, std::vector<double>> Box;
+    std::uniform_real_distribution<double> unit(0, 1);
+    for (double selectivity : SELECTIVITIES) {
+        // a box covering [selectivity] of the space
+        double side = std::pow(selectivity, 1.0 / keys.size());
+        std::vector<Box> queries;
+        for (int i = 0; i < NUM_QUERIES; i++) {
+            Box box;
+            for (auto [min, max] : ranges) {
+                double lower = min + (max - min) * (1 - side) * unit(rng);
+                box.first.push_back(lower);
+                box.second.push_back(lower + (max - min) * side);
+            }
+            queries.push_back(std::move(box));
+        }
+        bench_queries<Box>(runner, "RTree/query/" + params + "/" + selectivity_param(selectivity), queries,
+                           [&rtree](const Box& box) { return rtree->query(box.first, box.second); });
+    }
+    bench_serialization(runner, "RTree", params, data, []() { return std::make_shared<pvd::RTreeImpl>(); });
+}
+
+// a range of [width] consecutive values of the sorted distinct values of a sum column
+static std::pair<std::shared_ptr<arrow::Scalar>, std::shared_ptr<arrow::Scalar>>
+random_range(const pvd::TableData& values, double fraction, std::mt19937_64& rng)
+{
+    int64_t n = values.table->num_rows();
+    int64_t width = std::clamp<int64_t>(std::llround(fraction * n), 1, n);
+    int64_t lower = std::uniform_int_distribution<int64_t>(0, n - width)(rng);
+    auto column = values.table->column(0);
+    return {column->GetScalar(lower).ValueOrDie(), column->GetScalar(lower + width - 1).ValueOrDie()};
+}
+
+static void bench_prefix_sum(Runner& runner, const std::string& params, std::shared_ptr<arrow::Table> table,
+                             const std::string& sum, const std::string& target, const std::string& agg, std::mt19937_64& rng)
+{
+    if (!any_enabled(runner, "PrefixSum", params)) {
+        return;
+    }
+    auto plan = std::make_shared<pvd::PrefixSumBuild>(next_id++, std::make_shared<TableInput>(next_id++, table),
+                                                      column(sum), sum, column(target), target, column(agg), agg);
+    auto data = bench_build(runner, "PrefixSum/build/" + params, plan, table->num_rows());
+    if (!data) {
+        return;
+    }
+    auto prefix_sum = std::dynamic_pointer_cast<pvd::PrefixSumImpl>(data);
+
+    typedef std::pair<std::shared_ptr<arrow::Scalar>, std::shared_ptr<arrow::Scalar>> Range;
+    for (double selectivity : SELECTIVITIES) {
+        std::vector<Range> queries;
+        for (int i = 0; i < NUM_QUERIES; i++) {
+            queries.push_back(random_range(*prefix_sum->sum_col_data, selectivity, rng));
+        }
+        bench_queries<Range>(runner, "PrefixSum/query/" + params + "/" + selectivity_param(selectivity), queries,
+                             [&prefix_sum](const Range& range) { return prefix_sum->query(range.first, range.second); });
+    }
+    bench_serialization(runner, "PrefixSum", params, data, []() { return std::make_shared<pvd::PrefixSumImpl>(); });
+}
+
+static void bench_prefix_sum_2d(Runner& runner, const std::string& params, std::shared_ptr<arrow::Table> table,
+                                const std::string& sum_x, const std::string& sum_y, const std::string& target,
+                                const std::string& agg, std::mt19937_64& rng)
+{
+    if (!any_enabled(runner, "PrefixSum2D", params)) {
+        return;
+    }
+    auto plan = std::make_shared<pvd::PrefixSum2DBuild>(next_id++, std::make_shared<TableInput>(next_id++, table),
+                                                        column(sum_x), sum_x, column(sum_y), sum_y,
+                                                        column(target), target, column(agg), agg);
+    auto data = bench_build(runner, "PrefixSum2D/build/" + params, plan, table->num_rows());
+    if (!data) {
+        return;
+    }
+    auto prefix_sum = std::dynamic_pointer_cast<pvd::PrefixSum2DImpl>(data);
+
+    typedef std::array<std::shared_ptr<arrow::Scalar>, 4> Rectangle;
+    for (double selectivity : SELECTIVITIES) {
+        // a rectangle covering [selectivity] of the sum values
+        double side = std::sqrt(selectivity);
+        std::vector<Rectangle> queries;
+        for (int i = 0; i < NUM_QUERIES; i++) {
+            auto [lower_x, upper_x] = random_range(*prefix_sum->sum_col_x_data, side, rng);
+            auto [lower_y, upper_y] = random_range(*prefix_sum->sum_col_y_data, side, rng);
+            queries.push_back({lower_x, upper_x, lower_y, upper_y});
+        }
+        bench_queries<Rectangle>(runner, "PrefixSum2D/query/" + params + "/" + selectivity_param(selectivity), queries,
+                                 [&prefix_sum](const Rectangle& r) { return prefix_sum->query(r[0], r[1], r[2], r[3]); });
+    }
+    bench_serialization(runner, "PrefixSum2D", params, data, []() { return std::make_shared<pvd::PrefixSum2DImpl>(); });
+}
+
+// the hash of the bindings before FlatBinding, a scalar per id and per value hashed through ToString()
+static uint64_t scalar_hash_binding(const pvd::BindingMap& binding)
+{
+    std::vector<std::shared_ptr<arrow::Scalar>> scalars;
+    for (auto& [id, value] : binding) {
+        scalars.push_back(std::make_shared<arrow::StringScalar>(id));
+        if (value.is_index()) scalars.push_back(std::make_shared<arrow::Int64Scalar>(value.get_index()));
+        else if (value.is_int()) scalars.push_back(std::make_shared<arrow::Int64Scalar>(value.get_int()));
+        else if (value.is_float()) scalars.push_back(std::make_shared<arrow::FloatScalar>(value.get_float()));
+        else if (value.is_bool()) scalars.push_back(std::make_shared<arrow::BooleanScalar>(value.get_bool()));
+        else scalars.push_back(std::make_shared<arrow::StringScalar>(value.get_string()));
+    }
+    return hash_scalars(scalars);
+}
+
+/*
+ * The lookup of a binding in an SCache (the bindings of all the choices) and in a DCache (one
+ * binding), for bindings of [choices] ids: each id is an Index, an Int, a Float or a String.
+ */
+static void bench_bindings(Runner& runner, std::mt19937_64& rng)
+{
+    for (int choices : {2, 8, 32}) {
+        auto params = "choices:" + std::to_string(choices);
+        bool enabled = false;
+        for (auto op : {"scalar_hash", "hash", "equal", "scache_lookup", "dcache_compare"}) {
+            enabled = enabled || runner.enabled(std::string("Binding/") + op + "/" + params);
+        }
+        if (!enabled) {
+            continue;
+        }
+        // the cached bindings, as an SCache has them
+        std::vector<pvd::BindingMap> bindings;
+        std::unordered_map<pvd::FlatBinding, int, pvd::FlatBindingHash> cache;
+        for (int b = 0; b < 1024; b++) {
+            pvd::BindingMap binding;
+            for (int c = 0; c < choices; c++) {
+                auto id = "choice_" + std::to_string(c);
+                int value = rng() % 64;
+                switch (c % 4) {
+                    case 0: binding.emplace(id, pvd::Binding(pvd::Binding::Kind::Index, value)); break;
+                    case 1: binding.emplace(id, pvd::Binding(pvd::Binding::Kind::Int, value)); break;
+                    case 2: binding.emplace(id, pvd::Binding(value * 0.5f)); break;
+                    default: binding.emplace(id, pvd::Binding("value_" + std::to_string(value))); break;
+                }
+            }
+            cache.emplace(pvd::FlatBinding(binding), b);
+            bindings.push_back(std::move(binding));
+        }
+        std::vector<pvd::FlatBinding> flat;
+        for (auto& binding : bindings) flat.emplace_back(binding);
+
+        size_t next = 0;
+        uint64_t sink = 0;
+        runner.run("Binding/scalar_hash/" + params, 1, 0, [&]() { sink += scalar_hash_binding(bindings[next++ % bindings.size()]); });
+        runner.run("Binding/hash/" + params, 1, 0, [&]() { sink += pvd::hash_binding(bindings[next++ % bindings.size()]); });
+        runner.run("Binding/equal/" + params, 1, 0, [&]() {
+            auto i = next++ % flat.size();
+            sink += flat[i] == flat[(i + 1) % flat.size()];
+        });
+        // SCache::execute: flatten the useful binding and find it
+        runner.run("Binding/scache_lookup/" + params, 1, 0, [&]() {
+            sink += cache.at(pvd::FlatBinding(bindings[next++ % bindings.size()]));
+        });
+        // DCache::execute: flatten the useful binding and compare it to the cached one
+        runner.run("Binding/dcache_compare/" + params, 1, 0, [&]() {
+            sink += pvd::FlatBinding(bindings[next++ % bindings.size()]) != flat[0];
+        });
+        if (sink == 42) std::cerr << std::endl;
+    }
+}
+
+// a node of the dispatch benchmark, its execution returns nothing
+class Fork : public pvd::Plan
+{
+    std::vector<std::shared_ptr<Plan>> inputs;
+
+public:
+    Fork(int id, std::vector<std::shared_ptr<Plan>> inputs) : Plan(id), inputs(std::move(inputs)) {}
+    std::vector<std::shared_ptr<Plan>> input_plans() const override { return inputs; }
+    void execute(const pvd::BindingMap& binding, pvd::execute_callback_t cb) override { cb(nullptr); }
+    void pick_useful_binding(const pvd::BindingMap& binding, pvd::BindingMap& useful_binding) override {}
+    std::string to_sql(const pvd::BindingMap& binding) const override { return ""; }
+    std::string to_string() const override { return "Fork[" + std::to_string(id) + "]"; }
+    void get_all_choice_nodes(std::unordered_map<std::string, std::shared_ptr<pvd::ChoiceExpr>>& choice_nodes) override {}
+};
+
+static std::shared_ptr<pvd::Plan> fork_tree(int depth)
+{
+    std::vector<std::shared_ptr<pvd::Plan>> inputs;
+    if (depth > 1) {
+        inputs = {fork_tree(depth - 1), fork_tree(depth - 1)};
+    }
+    return std::make_shared<Fork>(next_id++, std::move(inputs));
+}
+
+/*
+ * execute_subplan of a node of a binary tree of plans (a plan with AnyPlan choices), found by
+ * the search of the tree (recursive/) or by the PlanIndex of the parsed plans (indexed/)
+ */
+static void bench_dispatch(Runner& runner)
+{
+    for (int depth : {3, 6, 9}) {
+        auto root = fork_tree(depth);
+        auto params = "nodes:" + std::to_string((1 << depth) - 1);
+        // the first leaf in post order, the search of the tree visits all the other nodes
+        int target = root->id - (1 << depth) + 2;
+        pvd::BindingMap binding;
+        int64_t executed = 0;
+        auto cb = [&executed](std::shared_ptr<pvd::SerialData> data) { executed++; };
+        runner.run("Plan/dispatch_recursive/" + params, 1, 0, [&]() { root->execute_subplan(binding, target, cb); });
+        root->index = std::make_shared<pvd::PlanIndex>(root);
+        runner.run("Plan/dispatch_indexed/" + params, 1, 0, [&]() { root->execute_subplan(binding, target, cb); });
+        if (executed == 0) std::cerr << std::endl;
+    }
+}
+
+/*
+ * k: [0, keys)    x, y, z: [0, 1)    s, s2: [0, sums)    t: [0, targets)    v: [0, 1)
+ */
+static std::shared_ptr<arrow::Table> synthetic_table(int64_t num_rows, int64_t keys, int64_t sums, int64_t targets,
+                                                     std::mt19937_64& rng)
+{
+    std::uniform_real_distribution<double> unit(0, 1);
+    arrow::Int64Builder k, s, s2, t;
+    arrow::DoubleBuilder x, y, z, v;
+    for (int64_t i = 0; i < num_rows; i++) {
+        (void)k.Append(rng() % keys);
+        (void)x.Append(unit(rng));
+        (void)y.Append(unit(rng));
+        (void)z.Append(unit(rng));
+        (void)s.Append(rng() % sums);
+        (void)s2.Append(rng() % sums);
+        (void)t.Append(rng() % targets);
+        (void)v.Append(unit(rng));
+    }
+    auto schema = arrow::schema({
+        arrow::field("k", arrow::int64()), arrow::field("x", arrow::float64()), arrow::field("y", arrow::float64()),
+        arrow::field("z", arrow::float64()), arrow::field("s", arrow::int64()), arrow::field("s2", arrow::int64()),
+        arrow::field("t", arrow::int64()), arrow::field("v", arrow::float64())});
+    return arrow::Table::Make(schema, {
+        k.Finish().ValueOrDie(), x.Finish().ValueOrDie(), y.Finish().ValueOrDie(), z.Finish().ValueOrDie(),
+        s.Finish().ValueOrDie(), s2.Finish().ValueOrDie(), t.Finish().ValueOrDie(), v.Finish().ValueOrDie()});
+}
+
+static void bench_synthetic(Runner& runner, int64_t max_rows, std::mt19937_64& rng)
+{
+    const int64_t TARGETS = 16;
+    for (int64_t num_rows = 1 << 10; num_rows <= max_rows; num_rows *= 16) {
+        auto rows_param = "synthetic/rows:" + std::to_string(num_rows);
+        for (int64_t keys : {int64_t(16), int64_t(1024), num_rows / 4}) {
+            auto table = synthetic_table(num_rows, keys, 2, TARGETS, rng);
+            bench_hash_table(runner, rows_param + "/keys:" + std::to_string(keys), table, {"k"}, rng);
+        }
+        auto table = synthetic_table(num_rows, 2, 2, TARGETS, rng);
+        std::vector<std::string> dims = {"x", "y", "z"};
+        for (size_t dim = 1; dim <= dims.size(); dim++) {
+            bench_rtree(runner, rows_param + "/dim:" + std::to_string(dim), table,
+                        std::vector<std::string>(dims.begin(), dims.begin() + dim), rng);
+        }
+        for (int64_t sums : {int64_t(64), int64_t(1024)}) {
+            auto table = synthetic_table(num_rows, 2, sums, TARGETS, rng);
+            bench_prefix_sum(runner, rows_param + "/sums:" + std::to_string(sums), table, "s", "t", "v", rng);
+        }
+        for (int64_t sums : {int64_t(16), int64_t(128)}) {
+            auto table = synthetic_table(num_rows, 2, sums, TARGETS, rng);
+            bench_prefix_sum_2d(runner, rows_param + "/sums:" + std::to_string(sums), table, "s", "s2", "t", "v", rng);
+        }
+    }
+}
+
+// the structures of the bundled dashboards (plans/*.js) on data/pvd.db, over the inputs of their builds
+static void bench_bundled(Runner& runner, const std::string& db_path, std::mt19937_64& rng)
+{
+    LocalDuckdb db(db_path, 1);
+    auto load = [&db](const std::string& sql) {
+        std::shared_ptr<arrow::Table> table;
+        db.query(sql, [&table](std::shared_ptr<arrow::Table> result) { table = result; });
+        return table->CombineChunks().ValueOrDie();
+    };
+    // a failure (e.g. a table missing in the database) is reported under [name]
+    auto bundled = [&runner](const std::string& name, const std::function<void()>& run) {
+        try {
+            run();
+        }
+        catch (std::exception& e) {
+            runner.fail(name, e.what());
+        }
+    };
+    bundled("HashTable/build/covid/county", [&]() {
+        auto table = load("SELECT county, SUM(cases) AS cases FROM covid GROUP BY county");
+        bench_hash_table(runner, "covid/county", table, {"county"}, rng);
+    });
+    bundled("RTree/build/sdss/ra_dec", [&]() {
+        bench_rtree(runner, "sdss/ra_dec", load("SELECT ra, dec FROM sdss"), {"ra", "dec"}, rng);
+    });
+    bundled("PrefixSum/build/liquor/date", [&]() {
+        auto table = load("SELECT Date, Category, SUM(Sales) AS Sales FROM liquor GROUP BY Date, Category");
+        bench_prefix_sum(runner, "liquor/date", table, "Date", "Category", "Sales", rng);
+    });
+    bundled("PrefixSum2D/build/brightkite/latitude_longitude", [&]() {
+        auto table = load("SELECT month, CAST(latitude * 10 AS INTEGER) AS latitude, CAST(longitude * 10 AS INTEGER) AS longitude, "
+                          "COUNT(*) AS count FROM brightkite GROUP BY 1, 2, 3");
+        bench_prefix_sum_2d(runner, "brightkite/latitude_longitude", table, "latitude", "longitude", "month", "count", rng);
+    });
+}
+
+/*
+ * Calibration of the cost model of the optimizer (optimizer/plan/cost.py) on this machine.
+ *
+ * The builds, the RTree query and the transfer of a table run on a grid of sizes, and the
+ * coefficients of the formulas of Plan.latency (ms) and Plan.memory (bytes) of the optimizer are
+ * fitted to the measures, with the features the optimizer computes for the node: e.g. a
+ * PrefixSumBuild has the distinct values of the target column as output rows and the distinct
+ * values of the sum column as output columns. The profile is loaded by the optimizer with
+ * PVD_COST_PROFILE=<file>. The operators not calibrated here keep their coefficients.
+ */
+
+// the features of the latency and memory formulas of the optimizer
+static const std::vector<std::string> LATENCY_FEATURES = {
+    "bias", "input_num_cols", "input_num_rows", "input_num_string_cols", "input_size", "input_string_size",
+    "output_num_cols", "output_num_rows", "output_num_string_cols", "output_size", "output_string_size"};
+static const std::vector<std::string> MEMORY_FEATURES = {
+    "bias", "output_num_cols", "output_num_rows", "output_num_string_cols", "output_size", "output_string_size"};
+
+struct Sample
+{
+    std::map<std::string, double> features;
+    double value;
+};
+
+// the least squares solution of A x = b (normal equations), empty if singular
+static std::vector<double> solve_least_squares(const std::vector<std::vector<double>>& a, const std::vector<double>& b)
+{
+    size_t n = a[0].size();
+    // [A^T A | A^T b]
+    std::vector<std::vector<double>> m(n, std::vector<double>(n + 1, 0));
+    for (size_t r = 0; r < a.size(); r++) {
+        for (size_t i = 0; i < n; i++) {
+            for (size_t j = 0; j < n; j++) m[i][j] += a[r][i] * a[r][j];
+            m[i][n] += a[r][i] * b[r];
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        size_t pivot = i;
+        for (size_t r = i + 1; r < n; r++) {
+            if (std::abs(m[r][i]) > std::abs(m[pivot][i])) pivot = r;
+        }
+        if (std::abs(m[pivot][i]) < 1e-12) return {};
+        std::swap(m[i], m[pivot]);
+        for (size_t r = 0; r < n; r++) {
+            if (r == i) continue;
+            double f = m[r][i] / m[i][i];
+            for (size_t c = i; c <= n; c++) m[r][c] -= f * m[i][c];
+        }
+    }
+    std::vector<double> x(n);
+    for (size_t i = 0; i < n; i++) x[i] = m[i][n] / m[i][i];
+    return x;
+}
+
+/*
+ * fit value = sum(coef * feature) over [features], with non-negative coefficients, minimizing the
+ * relative error (the samples span orders of magnitude): the best fit of the subsets of features
+ * with a non-negative least squares solution, the other coefficients of [all_features] are 0
+ */
+static json fit(const std::vector<Sample>& samples, const std::vector<std::string>& features,
+                const std::vector<std::string>& all_features, json& quality)
+{
+    std::vector<double> best;
+    std::vector<std::string> best_features;
+    double best_error = std::numeric_limits<double>::infinity();
+    for (uint32_t subset = 1; subset < (1u << features.size()); subset++) {
+        std::vector<std::string> used;
+        for (size_t i = 0; i < features.size(); i++) {
+            if (subset & (1u << i)) used.push_back(features[i]);
+        }
+        std::vector<std::vector<double>> a;
+        std::vector<double> b;
+        for (auto& sample : samples) {
+            std::vector<double> row;
+            for (auto& f : used) row.push_back(f == "bias" ? 1 / sample.value : sample.features.at(f) / sample.value);
+            a.push_back(std::move(row));
+            b.push_back(1);
+        }
+        auto x = solve_least_squares(a, b);
+        if (x.empty() || std::any_of(x.begin(), x.end(), [](double c) { return c < 0; })) {
+            continue;
+        }
+        double error = 0;
+        for (size_t r = 0; r < a.size(); r++) {
+            double predicted = 0;
+            for (size_t i = 0; i < x.size(); i++) predicted += a[r][i] * x[i];
+            error += (predicted - 1) * (predicted - 1);
+        }
+        if (error < best_error) {
+            best_error = error;
+            best = x;
+            best_features = used;
+        }
+    }
+    if (best.empty()) {
+        throw std::runtime_error("No non-negative fit");
+    }
+
+    json coef;
+    for (auto& f : all_features) coef[f] = 0.0;
+    for (size_t i = 0; i < best.size(); i++) coef[best_features[i]] = best[i];
+    double max_error = 0;
+    for (auto& sample : samples) {
+        double predicted = coef["bias"].get<double>();
+        for (auto& [f, value] : sample.features) predicted += coef[f].get<double>() * value;
+        max_error = std::max(max_error, std::abs(predicted - sample.value) / sample.value);
+    }
+    quality = {{"samples", samples.size()}, {"rms_relative_error", std::sqrt(best_error / samples.size())},
+               {"max_relative_error", max_error}};
+    return coef;
+}
+
+// median time of a few runs after a warm up, in ms
+static double measure_ms(const std::function<void()>& f)
+{
+    f();
+    std::vector<double> times;
+    for (int i = 0; i < 3; i++) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[1];
+}
+
+// [num_cols] columns of the synthetic table, the first ones are [first]
+static std::shared_ptr<arrow::Table> select_columns(std::shared_ptr<arrow::Table> table, std::vector<std::string> first, size_t num_cols)
+{
+    for (auto& name : {"x", "y", "z", "v", "s", "s2", "t", "k"}) {
+        if (first.size() >= num_cols) break;
+        if (std::find(first.begin(), first.end(), name) == first.end()) first.push_back(name);
+    }
+    std::vector<int> indices;
+    for (auto& name : first) indices.push_back(table->schema()->GetFieldIndex(name));
+    return table->SelectColumns(indices).ValueOrDie();
+}
+
+/*
+ * side: "server" or "client", the at_server of the coefficients in the optimizer
+ * bytes_per_second: the bandwidth of the network between the client and the server, 0 = only the
+ * (de)serialization of the transferred tables
+ */
+static json calibrate(int64_t max_rows, const std::string& side, double bytes_per_second, std::mt19937_64& rng)
+{
+    std::vector<int64_t> sizes;
+    for (int64_t num_rows = 1 << 12; num_rows <= max_rows; num_rows *= 4) sizes.push_back(num_rows);
+    if (sizes.size() < 2) {
+        throw std::runtime_error("The calibration needs --max-rows 16384 or more");
+    }
+    std::map<std::string, std::vector<Sample>> latency, memory;
+    auto log = [](const std::string& what, double ms) { std::cerr << what << ": " << ms << " ms" << std::endl; };
+
+    for (int64_t num_rows : sizes) {
+        auto rows = "rows:" + std::to_string(num_rows);
+        // HashTableBuild and RTreeBuild: a row per input row, the cost grows with the columns carried
+        auto table = synthetic_table(num_rows, std::max<int64_t>(num_rows / 16, 1), 2, 2, rng);
+        for (size_t num_cols : {2, 4, 8}) {
+            double n = num_rows, c = num_cols;
+            auto input = std::make_shared<TableInput>(next_id++, select_columns(table, {"k"}, num_cols));
+            auto hash_table = std::make_shared<pvd::HashTableBuild>(next_id++, input, std::vector<std::shared_ptr<pvd::Expression>>{column("k")});
+            std::shared_ptr<pvd::SerialData> built;
+            double ms = measure_ms([&]() { built = run_build(*hash_table); });
+            log("HashTableBuild/" + rows + "/cols:" + std::to_string(num_cols), ms);
+            latency["HashTableBuild"].push_back({{{"input_num_rows", n}, {"input_num_cols", c}, {"input_size", n * c}}, ms});
+            memory["HashTableBuild"].push_back({{{"output_num_rows", n}, {"output_num_cols", c}, {"output_size", n * c}}, double(built->size())});
+
+            input = std::make_shared<TableInput>(next_id++, select_columns(table, {"x", "y"}, num_cols));
+            auto rtree = std::make_shared<pvd::RTreeBuild>(next_id++, input, std::vector<std::shared_ptr<pvd::Expression>>{column("x"), column("y")});
+            std::shared_ptr<pvd::SerialData> rtree_data;
+            ms = measure_ms([&]() { rtree_data = run_build(*rtree); });
+            log("RTreeBuild/" + rows + "/cols:" + std::to_string(num_cols), ms);
+            latency["RTreeBuild"].push_back({{{"input_num_rows", n}, {"input_num_cols", c}, {"input_size", n * c}}, ms});
+            memory["RTreeBuild"].push_back({{{"output_num_rows", n}, {"output_num_cols", c}, {"output_size", n * c}}, double(rtree_data->size())});
+
+            // the transfer of the table over the network: serialize, send, deserialize
+            auto data = std::make_shared<pvd::TableData>(select_columns(table, {"x"}, num_cols));
+            int64_t bytes = serialize(*data)->size();
+            ms = measure_ms([&]() {
+                auto buffer = serialize(*data);
+                std::make_shared<pvd::TableData>()->deserialize(std::make_shared<arrow::io::BufferReader>(buffer));
+            });
+            if (bytes_per_second > 0) {
+                ms += bytes * 1e3 / bytes_per_second;
+            }
+            log("Network/" + rows + "/cols:" + std::to_string(num_cols), ms);
+            latency["Network"].push_back({{{"input_num_rows", n}, {"input_num_cols", c}, {"input_size", n * c}}, ms});
+
+            if (num_cols == 2) {
+                // RTreeQuery: the input rows are the rows of the RTree
+                auto rtree_impl = std::dynamic_pointer_cast<pvd::RTreeImpl>(rtree_data);
+                for (double selectivity : SELECTIVITIES) {
+                    double side_length = std::sqrt(selectivity);
+                    std::uniform_real_distribution<double> lower(0, 1 - side_length);
+                    int64_t result_rows = 0, count = 0;
+                    // the mean of a batch of queries, one is too short to time
+                    const int BATCH = 64;
+                    ms = measure_ms([&]() {
+                        for (int i = 0; i < BATCH; i++) {
+                            double x = lower(rng), y = lower(rng);
+                            result_rows += rtree_impl->query({x, y}, {x + side_length, y + side_length})->table->num_rows();
+                            count++;
+                        }
+                    }) / BATCH;
+                    log("RTreeQuery/" + rows + "/" + selectivity_param(selectivity), ms);
+                    latency["RTreeQuery"].push_back({{{"input_num_rows", n}, {"output_num_rows", double(result_rows) / count}}, ms});
+                }
+            }
+        }
+
+        // PrefixSumBuild: the output rows are the targets, the output columns the values of the sum column
+        for (int64_t sums : {64, 1024}) {
+            for (int64_t targets : {4, 64}) {
+                auto table = synthetic_table(num_rows, 2, sums, targets, rng);
+                auto input = std::make_shared<TableInput>(next_id++, select_columns(table, {"s", "t", "v"}, 3));
+                auto build = std::make_shared<pvd::PrefixSumBuild>(next_id++, input, column("s"), "s", column("t"), "t", column("v"), "v");
+                std::shared_ptr<pvd::SerialData> built;
+                double ms = measure_ms([&]() { built = run_build(*build); });
+                log("PrefixSumBuild/" + rows + "/sums:" + std::to_string(sums) + "/targets:" + std::to_string(targets), ms);
+                double n = num_rows, t = targets;
+                double x = std::dynamic_pointer_cast<pvd::PrefixSumImpl>(built)->sum_col_data->table->num_rows();
+                latency["PrefixSumBuild"].push_back({{{"input_num_rows", n}, {"output_num_rows", t}, {"output_num_cols", x}, {"output_size", t * x}}, ms});
+                memory["PrefixSumBuild"].push_back({{{"output_num_rows", t}, {"output_num_cols", x}, {"output_size", t * x}}, double(built->size())});
+            }
+        }
+
+        // PrefixSum2DBuild: the output columns are the cells of the grid of the two sum columns
+        for (int64_t sums : {16, 64}) {
+            for (int64_t targets : {4, 16}) {
+                auto table = synthetic_table(num_rows, 2, sums, targets, rng);
+                auto input = std::make_shared<TableInput>(next_id++, select_columns(table, {"s", "s2", "t", "v"}, 4));
+                auto build = std::make_shared<pvd::PrefixSum2DBuild>(next_id++, input, column("s"), "s", column("s2"), "s2",
+                                                                     column("t"), "t", column("v"), "v");
+                std::shared_ptr<pvd::SerialData> built;
+                double ms = measure_ms([&]() { built = run_build(*build); });
+                log("PrefixSum2DBuild/" + rows + "/sums:" + std::to_string(sums) + "/targets:" + std::to_string(targets), ms);
+                auto impl = std::dynamic_pointer_cast<pvd::PrefixSum2DImpl>(built);
+                double n = num_rows, t = targets;
+                double cells = double(impl->sum_col_x_data->table->num_rows()) * impl->sum_col_y_data->table->num_rows();
+                latency["PrefixSum2DBuild"].push_back({{{"input_num_rows", n}, {"output_num_rows", t}, {"output_num_cols", cells}, {"output_size", t * cells}}, ms});
+                memory["PrefixSum2DBuild"].push_back({{{"output_num_rows", t}, {"output_num_cols", cells}, {"output_size", t * cells}}, double(built->size())});
+            }
+        }
+    }
+
+    // the per-row, per-value and per-call (bias) costs fitted for each operator
+    const std::map<std::string, std::vector<std::string>> latency_features = {
+        {"HashTableBuild", {"bias", "input_num_rows", "input_size"}},
+        {"RTreeBuild", {"bias", "input_num_rows", "input_size"}},
+        {"RTreeQuery", {"bias", "input_num_rows", "output_num_rows"}},
+        {"PrefixSumBuild", {"bias", "input_num_rows", "output_size"}},
+        {"PrefixSum2DBuild", {"bias", "input_num_rows", "output_size"}},
+    };
+    const std::map<std::string, std::vector<std::string>> memory_features = {
+        {"HashTableBuild", {"output_num_rows", "output_size"}},
+        {"RTreeBuild", {"output_num_rows", "output_size"}},
+        {"PrefixSumBuild", {"output_num_cols", "output_size"}},
+        {"PrefixSum2DBuild", {"output_num_cols", "output_size"}},
+    };
+    json profile = {{"latency", json::object()}, {"memory", json::object()}, {"fit", json::object()}};
+    for (auto& [node, features] : latency_features) {
+        profile["latency"][node][side] = fit(latency[node], features, LATENCY_FEATURES, profile["fit"]["latency"][node]);
+    }
+    for (auto& [node, features] : memory_features) {
+        profile["memory"][node] = fit(memory[node], features, MEMORY_FEATURES, profile["fit"]["memory"][node]);
+    }
+    // the transfer is not per side, the formula of the optimizer has a bias and a cost per value
+    auto network = fit(latency["Network"], {"bias", "input_size"}, LATENCY_FEATURES, profile["fit"]["latency"]["Network"]);
+    profile["network"] = {{"bias", network["bias"]}, {"input_size", network["input_size"]}};
+    return profile;
+}
+
+int main(int argc, char** argv)
+{
+    std::string filter = ".*", db_path, out_path = "pvd_bench.json", calibrate_path, side = "server";
+    double min_time = 0.5, bandwidth_mbps = 0;
+    int64_t max_rows = 1 << 18;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--filter") filter = argv[i + 1];
+        else if (arg == "--min-time") min_time = std::stod(argv[i + 1]);
+        else if (arg == "--max-rows") max_rows = std::stoll(argv[i + 1]);
+        else if (arg == "--db") db_path = argv[i + 1];
+        else if (arg == "--out") out_path = argv[i + 1];
+        else if (arg == "--calibrate") calibrate_path = argv[i + 1];
+        else if (arg == "--side") side = argv[i + 1];
+        else if (arg == "--bandwidth-mbps") bandwidth_mbps = std::stod(argv[i + 1]);
+        else {
+            std::cout << "usage: pvd_bench [--filter REGEX] [--min-time SECONDS] [--max-rows N] [--db FILE] [--out FILE]" << std::endl
+                      << "       pvd_bench --calibrate PROFILE [--side server|client] [--bandwidth-mbps B] [--max-rows N]" << std::endl;
+            return 1;
+        }
+    }
+    if (side != "server" && side != "client") {
+        std::cout << "--side is server or client" << std::endl;
+        return 1;
+    }
+
+    char date[32];
+    auto now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", std::localtime(&now));
+    utsname host;
+    uname(&host);
+    json context = {
+        {"date", date},
+        {"host_name", host.nodename},
+        {"executable", argv[0]},
+        {"num_cpus", std::thread::hardware_concurrency()},
+        {"max_rows", max_rows},
+    };
+    std::mt19937_64 rng(42);
+
+    if (!calibrate_path.empty()) {
+        auto profile = calibrate(max_rows, side, bandwidth_mbps * 1e6 / 8, rng);
+        context["side"] = side;
+        context["bandwidth_mbps"] = bandwidth_mbps;
+        profile["context"] = context;
+        std::ofstream(calibrate_path) << profile.dump(2) << std::endl;
+        std::cerr << "Cost profile written to " << calibrate_path << std::endl;
+        return 0;
+    }
+
+    Runner runner(filter, min_time);
+    bench_bindings(runner, rng);
+    bench_dispatch(runner);
+    bench_synthetic(runner, max_rows, rng);
+    if (!db_path.empty()) {
+        bench_bundled(runner, db_path, rng);
+    }
+
+    context["min_time"] = min_time;
+    json results = {
+        {"context", context},
+        {"benchmarks", runner.benchmarks},
+    };
+    // not on stdout, the serialization of the data logs there
+    std::ofstream(out_path) << results.dump(2) << std::endl;
+    std::cerr << runner.benchmarks.size() << " benchmarks written to " << out_path << std::endl;
+    return 0;
+}
@@ -1,21 +1,49 @@
 #pragma once
 
 #include <emscripten/emscripten.h>
+#include <emscripten/eventloop.h>
 #include <emscripten/websocket.h>
 
+#include <map>
+
 #include "plan.h"
 #include "network.h"
 
 namespace pvd
 {
     void register_new_plan(const std::string& plan_json, std::function<void(std::string plan_str)> cb);
-    void execute_plan(int node_id, const std::string& binding, execute_callback_t cb);
+    // why an execution ended without a result: "cancelled" (superseded by a newer execution of the view)
+    // or "timed out" (no reply of the server within WasmSender::timeout)
+    typedef std::function<void(const std::string& reason)> abort_callback_t;
+
+    /*
+     * execute the view rooted at [node_id], cb is called with the result, or on_abort if the
+     * execution is superseded by a newer one of the view
+     */
+    void execute_plan(int node_id, const std::string& binding, execute_callback_t cb, abort_callback_t on_abort);
+    /*
+     * execute several nodes of the current plan with one binding (coordinated views),
+     * cb is called once per node with its result, or on_abort once
+     */
+    void execute_batch(const std::vector<int>& node_ids, const std::string& binding,
+                       std::function<void(int node_id, std::shared_ptr<SerialData> data)> cb,
+                       abort_callback_t on_abort);
+    /*
+     * query the memory stats of the server (JSON)
+     */
+    void server_stats(std::function<void(std::string stats)> cb);
 
     class WasmSender : public pvd::QuerySender
     {
     public:
-        int max_id = 0;
-        query_callback_t query_callback[1000];
+        PendingRequests pending;
+        // queries without a reply after the timeout are called back with a TimedOut reply (0 = never),
+        // Init never times out
+        std::chrono::milliseconds timeout{60000};
+        // a timer is armed for the next deadline while queries can time out
+        bool timer_armed = false;
+        // (view, node id) -> id of the latest Execute query of the node by the view
+        std::map<std::pair<int32_t, int32_t>, int32_t> latest_execute;
 
         EMSCRIPTEN_WEBSOCKET_T ws;
 
@@ -32,17 +60,79 @@ namespace pvd
         }
 
         void send(const Query& query, void* data, query_callback_t cb) {
-            int id = max_id++;
-            query_callback[id] = cb;
+            expire();
+            // the reply continues the execution of the view that sent the query
+            if (auto execution = ViewExecution::current()) {
+                cb = [execution, cb = std::move(cb)](Reply reply) {
+                    ViewScope scope(execution);
+                    cb(reply);
+                };
+            }
+            int32_t id = 0;
+            // the server never replies to a Log
+            if (query.msg != Query::Log) {
+                id = pending.add(cb, query.msg == Query::Init ? std::chrono::milliseconds(0) : timeout);
+            }
+            query_callback_t superseded;
+            if (query.msg == Query::Execute || query.msg == Query::ExecuteBatch) {
+                // the server cancels the previous execution of the node by the view and never replies to it
+                auto [it, inserted] = latest_execute.try_emplace({query.view, query.node_id}, id);
+                if (!inserted) {
+                    superseded = pending.take(it->second);
+                    it->second = id;
+                }
+            }
             send_query(id, query, data);
             printf("sent query id %d msg %d\n", id, query.msg);
+            arm_timer();
+            if (superseded) {
+                superseded(Reply::failed(Reply::Cancelled));
+            }
         };
 
         void receive(void* reply, int64_t size) {
             int32_t id = *(int32_t*)reply;
             Reply r = Reply{static_cast<int64_t>(size - sizeof(int32_t)), (void*)((char*)reply + sizeof(int32_t))};
-            query_callback_t cb = query_callback[id];
+            query_callback_t cb = pending.take(id);
+            if (!cb) {
+                // reply of a superseded or timed out query
+                return;
+            }
             cb(r);
+            expire();
+        }
+
+        // number of queries waiting for a reply, for backpressure on the interactions
+        size_t num_in_flight() const {
+            return pending.size();
+        }
+
+        void expire() {
+            for (auto& [id, cb] : pending.expire()) {
+                printf("query id %d timed out\n", id);
+                cb(Reply::failed(Reply::TimedOut));
+            }
+        }
+
+        // expire the queries at their deadline, even if nothing is sent or received meanwhile
+        void arm_timer() {
+            if (timer_armed) {
+                return;
+            }
+            auto deadline = pending.next_deadline();
+            if (deadline == std::chrono::steady_clock::time_point::max()) {
+                return;
+            }
+            auto delay = std::chrono::duration<double, std::milli>(deadline - std::chrono::steady_clock::now());
+            timer_armed = true;
+            emscripten_set_timeout(&WasmSender::on_timer, std::max(delay.count(), 0.0), this);
+        }
+
+        static void on_timer(void* user_data) {
+            auto sender = static_cast<WasmSender*>(user_data);
+            sender->timer_armed = false;
+            sender->expire();
+            sender->arm_timer();
         }
 
         WasmSender(EMSCRIPTEN_WEBSOCKET_T ws) : ws(ws) {}
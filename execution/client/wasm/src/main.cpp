@@ -7,11 +7,12 @@
 #include "pvd_client.h"
 #include "cloud_api.h"
 #include "arrow_utils.h"
+#include "trace.h"
 
 // The websocket connection to the server
 EMSCRIPTEN_WEBSOCKET_T ws = 0;
 // The global sender instance used to send queries to the server
-pvd::QuerySender* pvd::SENDER = nullptr;
+thread_local pvd::QuerySender* pvd::SENDER = nullptr;
 // The callback function for the websocket special message (inited, error, closed)
 // assume to be void msg(std::string result)
 emscripten::val msg_cb;
@@ -71,8 +72,9 @@ void register_plan(std::string plan_json, emscripten::val register_done_cb)
     }
 }
 
-// execute_cb: assume to be void execute_cb(long buffer_ptr, long buffer_size)
+// execute_cb: assume to be void execute_cb(long buffer_ptr, long buffer_size, [string error])
 // convert char* buffer_ptr to long in the argument
+// an execution without result (e.g. superseded by a newer one of the view) calls execute_cb(0, 0, reason)
 void execute_plan(int node_id, std::string binding, emscripten::val execute_cb)
 {
     if (ws == 0) {
@@ -99,6 +101,10 @@ void execute_plan(int node_id, std::string binding, emscripten::val execute_cb)
                 // delete the buffer after the callback function
                 delete[] tmp_buf;
                 //std::cout << "Buffer deleted" << std::endl;
+                // the spans of the execution go to the server in one message
+                pvd::flush_trace();
+            }, [execute_cb](const std::string& reason) {
+                execute_cb(0, 0, reason);
             });
         }
         catch (std::exception& e) {
@@ -107,6 +113,56 @@ void execute_plan(int node_id, std::string binding, emscripten::val execute_cb)
     }
 }
 
+// execute_cb: assume to be void execute_cb(int node_id, long buffer_ptr, long buffer_size, [string error]),
+// called once per node, or once with execute_cb(-1, 0, 0, reason) if the batch has no result
+void execute_batch(emscripten::val node_ids, std::string binding, emscripten::val execute_cb)
+{
+    if (ws == 0) {
+        msg_cb(std::string("websocket not connected"));
+    }
+    else {
+        try
+        {
+            auto nodes = emscripten::vecFromJSArray<int>(node_ids);
+            pvd::execute_batch(nodes, binding, [execute_cb](int node_id, std::shared_ptr<pvd::SerialData> data) {
+                auto table = std::dynamic_pointer_cast<pvd::TableData>(data);
+                auto buf = table_to_buffer(table->table, nullptr, 0);
+                char* tmp_buf = new char[buf->size() + 4];
+                memcpy(tmp_buf, buf->data(), buf->size());
+                execute_cb(node_id, (unsigned long)tmp_buf, (unsigned long)buf->size());
+                delete[] tmp_buf;
+                pvd::flush_trace();
+            }, [execute_cb](const std::string& reason) {
+                execute_cb(-1, 0, 0, reason);
+            });
+        }
+        catch (std::exception& e) {
+            msg_cb(std::string(e.what()));
+        }
+    }
+}
+
+// number of queries waiting for a server reply, the page can hold back new interactions when it grows
+int in_flight()
+{
+    if (pvd::SENDER == nullptr) {
+        return 0;
+    }
+    return static_cast<int>(static_cast<pvd::WasmSender*>(pvd::SENDER)->num_in_flight());
+}
+
+// stats_cb: assume to be void stats_cb(std::string stats_json)
+void server_stats(emscripten::val stats_cb)
+{
+    if (ws == 0) {
+        msg_cb(std::string("websocket not connected"));
+        return;
+    }
+    pvd::server_stats([stats_cb](std::string stats) {
+        stats_cb(stats);
+    });
+}
+
 void init(std::string port, emscripten::val cb) {
     msg_cb = cb;
 
@@ -131,4 +187,7 @@ EMSCRIPTEN_BINDINGS() {
     emscripten::function("init", &init);
     emscripten::function("register", &register_plan);
     emscripten::function("execute", &execute_plan);
+    emscripten::function("execute_batch", &execute_batch);
+    emscripten::function("server_stats", &server_stats);
+    emscripten::function("in_flight", &in_flight);
 }
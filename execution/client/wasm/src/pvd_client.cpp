@@ -11,6 +11,8 @@ namespace pvd
      */
     int current_id = 0;
     std::shared_ptr<Plan> current_plan = nullptr;
+    // node id -> node of the current plan
+    PlanContext current_context;
 
     void register_new_plan(const std::string& plan_json, std::function<void(std::string plan_str)> cb)
     {
@@ -18,23 +20,28 @@ namespace pvd
         std::cout << plan_json << std::endl;
         // parse the json string to a plan
         json json_obj = json::parse(plan_json);
-        auto plan = parse_json_plan(json_obj);
+        PlanContext context;
+        auto plan = parse_json_plan(json_obj, context);
 
         // register the plan with the root id
         current_id = plan->id;
         current_plan = plan;
+        current_context = std::move(context);
 
         // send the plan json to the server and initialize the server side plan
         Query query = {Query::Init, plan->id, plan_json.size() + 1};
         SENDER->send(query, (void*)plan_json.c_str(), 
                     [plan, cb](Reply reply) { 
-                        plan->initialize([plan, cb]() {
+                        plan->initialize([plan, cb](std::exception_ptr error) {
+                            if (error) {
+                                std::rethrow_exception(error);
+                            }
                             cb(plan->to_string());
                         });
                     });
     }
 
-    void execute_plan(int node_id, const std::string& binding, execute_callback_t cb)
+    void execute_plan(int node_id, const std::string& binding, execute_callback_t cb, abort_callback_t on_abort)
     {
         // node_id should be the root id of the plan to execute
         if (current_id != node_id) {
@@ -45,6 +52,62 @@ namespace pvd
         auto plan = current_plan;
         auto binding_json = json::parse(binding);
         auto bind = parse_json_binding(binding_json);
-        plan->execute_subplan(bind, node_id, cb);
+        auto execution = std::make_shared<ViewExecution>(node_id, std::move(on_abort));
+        ViewScope scope(execution);
+        plan->execute_subplan(bind, node_id, [execution, cb](std::shared_ptr<SerialData> data) {
+            if (execution->finish()) {
+                cb(data);
+            }
+        });
+    }
+
+    void execute_batch(const std::vector<int>& node_ids, const std::string& binding,
+                       std::function<void(int node_id, std::shared_ptr<SerialData> data)> cb,
+                       abort_callback_t on_abort)
+    {
+        std::vector<std::shared_ptr<Plan>> plans;
+        for (int node_id : node_ids) {
+            auto it = current_context.nodes.find(node_id);
+            if (it == current_context.nodes.end()) {
+                throw std::runtime_error("Plan id " + std::to_string(node_id) + " is not registered");
+            }
+            plans.push_back(it->second);
+        }
+
+        auto batch = std::make_shared<ExecutionBatch>(parse_json_binding(json::parse(binding)));
+        // the batch is one execution of the views, superseded with its first node like on the server
+        auto execution = std::make_shared<ViewExecution>(node_ids[0], std::move(on_abort));
+        auto remaining = std::make_shared<size_t>(plans.size());
+        ViewScope view_scope(execution);
+        {
+            // shared subplans run once, the Network nodes are sent in one message
+            BatchScope scope(batch);
+            for (size_t i = 0; i < plans.size(); i++) {
+                int node_id = node_ids[i];
+                plans[i]->execute_shared(batch->get_binding(), [execution, remaining, cb, node_id](std::shared_ptr<SerialData> data) {
+                    if (execution->is_finished()) {
+                        return;
+                    }
+                    if (--*remaining == 0) {
+                        execution->finish();
+                    }
+                    cb(node_id, data);
+                });
+            }
+        }
+        batch->flush();
+    }
+
+    void server_stats(std::function<void(std::string stats)> cb)
+    {
+        static const char empty[] = "";
+        Query query = {Query::Stats, 0, sizeof(empty)};
+        SENDER->send(query, (void*)empty, [cb](Reply reply) {
+            if (!reply.ok()) {
+                cb(json{{"error", reply.status_name()}}.dump());
+                return;
+            }
+            cb(std::string(static_cast<const char*>(reply.data)));
+        });
     }
 }
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <arrow/api.h>
+
+#include "duckdb.hpp"
+
+#include "cloud_api.h"
+
+/*
+ * The cloud database of the server: a local DuckDB file.
+ *
+ * The database is opened once per process and queried through a pool of connections,
+ * one per execution thread, so the catalog and the buffer cache of DuckDB survive
+ * between queries. Each connection keeps the prepared statements of the queries it
+ * has run, a recurring query is only parsed and planned once per connection. The bound
+ * values of a plan are passed as parameters, so the SQL template of a Cloud node is the
+ * same for every binding of the same plan choices.
+ *
+ * Results are streamed: query_stream returns a reader that pulls the next chunks from
+ * DuckDB when the plan asks for the next batch, the connection stays leased by the
+ * reader until the stream ends.
+ */
+class LocalDuckdb : public pvd::CloudApi
+{
+public:
+    LocalDuckdb(const std::string& path, size_t num_connections);
+    ~LocalDuckdb();
+
+    void query(std::string sql, std::function<void(std::shared_ptr<arrow::Table>)> cb) override;
+    void query_stream(std::string sql, std::function<void(std::shared_ptr<arrow::RecordBatchReader>)> cb) override;
+    // the parameters are bound to the prepared statement of the SQL template
+    void query_stream(std::string sql, std::vector<std::shared_ptr<arrow::Scalar>> params,
+                      std::function<void(std::shared_ptr<arrow::RecordBatchReader>)> cb) override;
+
+    size_t num_connections() const { return connections.size(); }
+
+    /*
+     * run the query on the connection and collect the arrow result
+     * (without prepared statements, used by benchmarks as the baseline)
+     */
+    static std::shared_ptr<arrow::Table> query_table(duckdb::Connection& con, const std::string& sql);
+    /*
+     * collect the batches of an arrow result and destroy the result
+     */
+    static std::shared_ptr<arrow::Table> fetch_table(duckdb_arrow result);
+    /*
+     * convert a query parameter to a DuckDB value
+     */
+    static duckdb::Value to_duckdb_value(const arrow::Scalar& scalar);
+
+private:
+    // at most this many prepared statements are kept per connection
+    static constexpr size_t MAX_PREPARED = 256;
+    // DuckDB chunks (2048 rows) are merged into record batches of about this many rows
+    static constexpr size_t STREAM_BATCH_ROWS = 64 * 1024;
+
+    struct PooledConnection
+    {
+        duckdb::Connection con;
+        // the prepared statements, most recently used first
+        std::list<std::pair<std::string, duckdb::unique_ptr<duckdb::PreparedStatement>>> prepared_order;
+        // sql -> its prepared statement in prepared_order
+        std::unordered_map<std::string, decltype(prepared_order)::iterator> prepared;
+
+        explicit PooledConnection(duckdb::DuckDB& db) : con(db) {}
+        duckdb::PreparedStatement& prepare(const std::string& sql);
+    };
+
+    /*
+     * A connection borrowed from the pool, returned when the lease is destroyed
+     */
+    class Lease
+    {
+        LocalDuckdb* pool;
+        PooledConnection* connection;
+    public:
+        Lease(LocalDuckdb* pool, PooledConnection* connection) : pool(pool), connection(connection) {}
+        Lease(Lease&& other) noexcept : pool(other.pool), connection(std::exchange(other.connection, nullptr)) {}
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        ~Lease() { reset(); }
+        PooledConnection* operator->() const { return connection; }
+        // return the connection to the pool now
+        void reset() {
+            if (connection) pool->release(std::exchange(connection, nullptr));
+        }
+    };
+
+    class StreamReader;
+
+    Lease acquire();
+    void release(PooledConnection* connection);
+
+    // one database instance shared by all threads, a database file can only be opened once per process
+    duckdb::DuckDB db;
+    std::vector<std::unique_ptr<PooledConnection>> connections;
+    std::mutex mutex;
+    std::condition_variable available;
+    std::vector<PooledConnection*> idle;
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "network.h"
+#include "server_handler.h"
+
+namespace pvd
+{
+    /*
+     * The network between the client and the server, applied to each message and each reply:
+     * a message waits for the link to send the previous ones, takes size / bandwidth to send,
+     * and arrives [latency] later. The default is no delay.
+     */
+    struct LinkShape
+    {
+        typedef std::chrono::steady_clock clock;
+
+        // one-way delay
+        std::chrono::nanoseconds latency{0};
+        // 0 = unlimited
+        double bytes_per_second = 0;
+
+        bool is_shaped() const { return latency.count() > 0 || bytes_per_second > 0; }
+        /*
+         * the arrival time of a message of [size] bytes sent at [now],
+         * [link_free] is when the link has sent the previous messages, updated
+         */
+        clock::time_point arrival(clock::time_point now, size_t size, clock::time_point& link_free) const;
+    };
+
+    /*
+     * A QuerySender of a native client (not the browser), for benchmarking and profiling the
+     * client and the server on one machine. The messages are framed as on the websocket.
+     * The replies arrive on other threads and are delivered on the client thread by
+     * run_until_idle(), like the websocket callbacks of the browser.
+     * The transports are LoopbackSender (in-process) and UnixSocketSender (unix_socket.h).
+     */
+    class NativeSender : public QuerySender
+    {
+    protected:
+        typedef LinkShape::clock clock;
+
+        // the replies waiting for the client thread, shared with the threads receiving them
+        struct Inbox
+        {
+            struct Entry
+            {
+                clock::time_point arrival;
+                std::shared_ptr<ar::Buffer> reply;
+                // not empty if the server failed
+                std::string error;
+            };
+            LinkShape shape;
+            std::mutex mutex;
+            std::condition_variable cv;
+            // in order of arrival
+            std::deque<Entry> entries;
+            clock::time_point link_free;
+
+            void push_reply(std::shared_ptr<ar::Buffer> reply);
+            void push_error(const std::string& error);
+            void push(Entry entry, size_t size);
+        };
+        std::shared_ptr<Inbox> inbox;
+
+        // hand the framed message to the server
+        virtual void transmit(std::shared_ptr<const std::string> message) = 0;
+
+    private:
+        struct Outgoing
+        {
+            clock::time_point arrival;
+            std::shared_ptr<const std::string> message;
+        };
+        PendingRequests pending;
+        // (view, node id) -> id of the latest Execute query of the node by the view
+        std::map<std::pair<int32_t, int32_t>, int32_t> latest_execute;
+        // the messages delayed by the shape of the link, in order of arrival
+        std::deque<Outgoing> outbox;
+        clock::time_point link_free;
+
+    public:
+        explicit NativeSender(LinkShape shape = {});
+        virtual ~NativeSender() = default;
+
+        void send(const Query& query, void* data, query_callback_t cb) override;
+        void receive(void* reply, int64_t size) override;
+
+        /*
+         * send the delayed messages and deliver the replies on the calling thread until
+         * no query is waiting for a reply, throw the first error reported by the server
+         */
+        void run_until_idle();
+        size_t num_in_flight() const { return pending.size(); }
+    };
+
+    /*
+     * Hands the messages directly to a ServerHandler in the same process.
+     * Each sender is one connection of the handler.
+     */
+    class LoopbackSender : public NativeSender
+    {
+        ServerHandler& handler;
+
+    protected:
+        void transmit(std::shared_ptr<const std::string> message) override;
+
+    public:
+        explicit LoopbackSender(ServerHandler& handler, LinkShape shape = {}) : NativeSender(shape), handler(handler) {}
+        // closes the connection
+        ~LoopbackSender();
+    };
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "session.h"
+
+namespace pvd
+{
+    /*
+     * Handles the messages of the clients, whatever the transport is (the websocket server,
+     * or the in-process loopback of pvd_replay).
+     *      message: [query id (int32)] [Query] [content]
+     *      reply:   [query id (int32)] [payload]
+     * Errors are not tagged with a query id, they are sent as "ERROR: message".
+     */
+    class ServerHandler
+    {
+    public:
+        // may be called from any execution thread
+        typedef std::function<void(std::shared_ptr<ar::Buffer>)> reply_t;
+        typedef std::function<void(const std::string& message)> error_t;
+
+        explicit ServerHandler(Executor* executor) : executor(executor) {}
+
+        /*
+         * handle a message of the connection,
+         * the message is kept alive until the tasks of the message are done with it
+         */
+        void handle(ConnectionId conn, std::shared_ptr<const std::string> message, reply_t reply, error_t error);
+        /*
+         * release all plans (and their caches) registered by the connection
+         */
+        void close(ConnectionId conn);
+        size_t num_sessions() const { return registry.num_sessions(); }
+
+    private:
+        Executor* executor;
+        // all plans registered by all connections
+        PlanRegistry registry;
+
+        /*
+         * reply the memory of the server: the process, the memory pools of the plan nodes
+         * and the caches of every session (collected on the strand of each session)
+         */
+        void stats(int32_t query_id, reply_t reply);
+    };
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "plan.h"
+#include "executor.h"
+#include "cancel.h"
+#include "batch.h"
+#include "json.h"
+
+using json = nlohmann::json;
+
+namespace pvd
+{
+    /*
+     * Opaque identity of a client connection
+     */
+    typedef const void* ConnectionId;
+
+    /*
+     * A plan registered by a client connection.
+     * Each session owns its own plan nodes and caches (DCache, Metrics, ...),
+     * except the results of SCaches over structurally identical subplans (see SCacheStore).
+     * All executions of a session run in order on its strand, so the operator
+     * state of a session is never accessed by two threads at the same time.
+     */
+    struct Session
+    {
+        ConnectionId conn;
+        int root_id;
+        std::shared_ptr<Plan> plan;
+        PlanContext context;
+        std::shared_ptr<Strand> strand;
+
+        /*
+         * execute the subplan rooted at [node_id] of this session
+         */
+        task<std::shared_ptr<SerialData>> execute(BindingMap binding, int node_id);
+        /*
+         * execute the subplans rooted at [node_ids] with one binding,
+         * their common subplans are computed once (see ExecutionBatch)
+         * return the results in the order of [node_ids]
+         */
+        task<std::vector<std::shared_ptr<SerialData>>> execute_batch(BindingMap binding, std::vector<int> node_ids);
+
+        /*
+         * Start a new execution of [node_id] for the client view [view] and cancel the previous one
+         * of the same node by the same view (a newer interaction supersedes the results the view is
+         * still waiting for, other views reading the node keep theirs).
+         */
+        std::shared_ptr<CancelToken> begin_execution(int view, int node_id);
+        // forget the token of a finished execution
+        void end_execution(int view, int node_id, const std::shared_ptr<CancelToken>& token);
+        /*
+         * the memory of the session: "caches" retained by its cache nodes, "operators" the
+         * live and peak bytes of the pool of each node that allocated
+         * (run on the strand, the caches are only modified there)
+         */
+        json memory_stats();
+        /*
+         * run [task] on the strand once the plan is initialized (Execute, Stats): the SCaches are
+         * built by the workers, outside the strand, and can only be read after the last one is built.
+         * The tasks posted before are deferred, in order.
+         */
+        void post(task_t task);
+        // the initialization finished (or failed), run the deferred tasks
+        void finish_initialization();
+
+    private:
+        std::mutex init_mutex;
+        bool initialized = false;
+        std::vector<task_t> deferred;
+        // the latest execution of each (view, node), set from the websocket threads
+        std::mutex executions_mutex;
+        std::map<std::pair<int, int>, std::shared_ptr<CancelToken>> executions;
+    };
+
+    /*
+     * All plans registered by all connections
+     *      connection -> plan root id -> session
+     *      connection -> plan node id -> plan root id
+     * The sessions of a connection are dropped when the connection closes.
+     */
+    class PlanRegistry
+    {
+        // messages of different connections are handled by different threads
+        mutable std::mutex mutex;
+        std::map<ConnectionId, std::map<int, std::shared_ptr<Session>>> sessions;
+        std::map<ConnectionId, std::map<int, int>> node_to_root;
+        // fingerprint -> store of the SCaches, shared by all sessions while any of them is alive
+        std::unordered_map<uint64_t, std::weak_ptr<SCacheStore>> shared_scaches;
+
+    public:
+        /*
+         * parse the plan json and register it as a new session of the connection
+         * (replacing the session with the same root id)
+         */
+        std::shared_ptr<Session> register_plan(ConnectionId conn, const json& plan_json, Executor* executor);
+        /*
+         * find the session of the connection that contains the node [node_id]
+         * return nullptr if not found
+         */
+        std::shared_ptr<Session> find(ConnectionId conn, int node_id) const;
+        /*
+         * drop all sessions of the connection
+         */
+        void drop(ConnectionId conn);
+        size_t num_sessions() const;
+        std::vector<std::shared_ptr<Session>> all_sessions() const;
+    };
+}
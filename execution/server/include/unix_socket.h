@@ -0,0 +1,68 @@
+#pragma once
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "loopback.h"
+#include "server_handler.h"
+
+namespace pvd
+{
+    /*
+     * The messages of a native client over a Unix domain socket.
+     * Each frame is [size (uint32)] [kind (uint8)] [payload], the payload of a message or a
+     * reply is framed as on the websocket, an error reply is the error message.
+     */
+    enum class FrameKind : uint8_t { Message, Reply, Error };
+
+    /*
+     * Accepts native clients on a Unix socket and hands their messages to the ServerHandler.
+     * Each connection is read by its own thread, the replies are written by the execution threads.
+     * The destructor closes the connections and joins the threads.
+     */
+    class UnixSocketServer
+    {
+        ServerHandler& handler;
+        std::string path;
+        int listen_fd;
+        std::thread acceptor;
+        std::mutex mutex;
+        std::condition_variable readers_done;
+        // socket -> thread reading the connection, until it closes
+        std::map<int, std::thread> readers;
+        // the threads of the closed connections, joined by the next accept
+        std::vector<std::thread> finished;
+
+        void serve(int fd);
+
+    public:
+        // replaces the socket file at [path]
+        UnixSocketServer(ServerHandler& handler, const std::string& path);
+        ~UnixSocketServer();
+        // accept the connections on a background thread
+        void start();
+    };
+
+    /*
+     * A native client connected to a pvd_server over a Unix socket,
+     * so the client and the server can run (and be profiled) as separate processes.
+     */
+    class UnixSocketSender : public NativeSender
+    {
+        int fd;
+        std::thread reader;
+
+    protected:
+        void transmit(std::shared_ptr<const std::string> message) override;
+
+    public:
+        explicit UnixSocketSender(const std::string& path, LinkShape shape = {});
+        // closes the connection, the server drops its sessions
+        ~UnixSocketSender();
+    };
+}
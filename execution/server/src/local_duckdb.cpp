@@ -0,0 +1,252 @@
+#include <iostream>
+#include <arrow/c/bridge.h>
+
+#include "local_duckdb.h"
+#include "cancel.h"
+
+LocalDuckdb::LocalDuckdb(const std::string& path, size_t num_connections) : db(path)
+{
+    for (size_t i = 0; i < std::max<size_t>(1, num_connections); i++) {
+        connections.push_back(std::make_unique<PooledConnection>(db));
+        idle.push_back(connections.back().get());
+    }
+}
+
+LocalDuckdb::~LocalDuckdb()
+{
+    // the connections must be closed before the database
+    connections.clear();
+}
+
+duckdb::PreparedStatement& LocalDuckdb::PooledConnection::prepare(const std::string& sql)
+{
+    auto it = prepared.find(sql);
+    if (it != prepared.end()) {
+        prepared_order.splice(prepared_order.begin(), prepared_order, it->second);
+        return *it->second->second;
+    }
+    auto statement = con.Prepare(sql);
+    if (statement->HasError()) {
+        throw std::runtime_error("DuckDB prepare failed: " + statement->GetError());
+    }
+    if (prepared.size() >= MAX_PREPARED) {
+        // evict the least recently used statement
+        prepared.erase(prepared_order.back().first);
+        prepared_order.pop_back();
+    }
+    prepared_order.emplace_front(sql, std::move(statement));
+    prepared.emplace(sql, prepared_order.begin());
+    return *prepared_order.front().second;
+}
+
+LocalDuckdb::Lease LocalDuckdb::acquire()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    available.wait(lock, [this]() { return !idle.empty(); });
+    auto connection = idle.back();
+    idle.pop_back();
+    return {this, connection};
+}
+
+void LocalDuckdb::release(PooledConnection* connection)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        idle.push_back(connection);
+    }
+    available.notify_one();
+}
+
+/*
+ * Reads the streaming result of a query, merging DuckDB chunks into record batches.
+ * Acero pulls the batches from its own threads, so the cancel token of the execution
+ * is captured when the stream is opened.
+ */
+class LocalDuckdb::StreamReader : public arrow::RecordBatchReader
+{
+    Lease connection;
+    duckdb::unique_ptr<duckdb::QueryResult> result;
+    std::shared_ptr<arrow::Schema> arrow_schema;
+    std::shared_ptr<pvd::CancelToken> token;
+    int callback_id = -1;
+
+    // stop reading DuckDB and return the connection to the pool
+    void finish()
+    {
+        if (token) {
+            token->remove_callback(callback_id);
+            token = nullptr;
+        }
+        result = nullptr;
+        connection.reset();
+    }
+
+public:
+    StreamReader(Lease lease, duckdb::unique_ptr<duckdb::QueryResult> query_result)
+            : connection(std::move(lease)), result(std::move(query_result)), token(pvd::current_cancel_token())
+    {
+        ArrowSchema schema;
+        duckdb::ArrowConverter::ToArrowSchema(&schema, result->types, result->names, result->client_properties);
+        arrow_schema = arrow::ImportSchema(&schema).ValueOrDie();
+        if (token) {
+            // interrupt the running query when the execution is superseded
+            auto con = &connection->con;
+            callback_id = token->on_cancel([con]() { con->Interrupt(); });
+        }
+    }
+
+    ~StreamReader() override
+    {
+        finish();
+    }
+
+    std::shared_ptr<arrow::Schema> schema() const override
+    {
+        return arrow_schema;
+    }
+
+    arrow::Status ReadNext(std::shared_ptr<arrow::RecordBatch>* batch) override
+    {
+        *batch = nullptr;
+        if (!result) {
+            return arrow::Status::OK();
+        }
+        std::vector<duckdb::unique_ptr<duckdb::DataChunk>> chunks;
+        size_t num_rows = 0;
+        while (num_rows < STREAM_BATCH_ROWS) {
+            if (token && token->is_cancelled()) {
+                finish();
+                return arrow::Status::Cancelled("execution cancelled");
+            }
+            auto chunk = result->Fetch();
+            if (result->HasError()) {
+                std::string error = result->GetError();
+                finish();
+                return arrow::Status::IOError("DuckDB query failed: " + error);
+            }
+            if (!chunk || chunk->size() == 0) {
+                break;
+            }
+            num_rows += chunk->size();
+            chunks.push_back(std::move(chunk));
+        }
+        if (chunks.empty()) {
+            finish();
+            return arrow::Status::OK();
+        }
+
+        auto merged = std::move(chunks[0]);
+        if (chunks.size() > 1) {
+            merged = duckdb::make_uniq<duckdb::DataChunk>();
+            merged->Initialize(duckdb::Allocator::DefaultAllocator(), chunks[0]->GetTypes(), num_rows);
+            for (auto& chunk : chunks) {
+                merged->Append(*chunk);
+            }
+        }
+        ArrowArray array;
+        duckdb::ArrowConverter::ToArrowArray(*merged, &array, result->client_properties);
+        ARROW_ASSIGN_OR_RAISE(*batch, arrow::ImportRecordBatch(&array, arrow_schema));
+        return arrow::Status::OK();
+    }
+
+    arrow::Status Close() override
+    {
+        finish();
+        return arrow::Status::OK();
+    }
+};
+
+void LocalDuckdb::query_stream(std::string sql, std::function<void(std::shared_ptr<arrow::RecordBatchReader>)> cb)
+{
+    query_stream(std::move(sql), {}, std::move(cb));
+}
+
+duckdb::Value LocalDuckdb::to_duckdb_value(const arrow::Scalar& scalar)
+{
+    if (!scalar.is_valid) {
+        return duckdb::Value();
+    }
+    switch (scalar.type->id()) {
+        case arrow::Type::INT64:
+            return duckdb::Value::BIGINT(static_cast<const arrow::Int64Scalar&>(scalar).value);
+        case arrow::Type::INT32:
+            return duckdb::Value::INTEGER(static_cast<const arrow::Int32Scalar&>(scalar).value);
+        case arrow::Type::DOUBLE:
+            return duckdb::Value::DOUBLE(static_cast<const arrow::DoubleScalar&>(scalar).value);
+        case arrow::Type::FLOAT:
+            return duckdb::Value::FLOAT(static_cast<const arrow::FloatScalar&>(scalar).value);
+        case arrow::Type::BOOL:
+            return duckdb::Value::BOOLEAN(static_cast<const arrow::BooleanScalar&>(scalar).value);
+        case arrow::Type::STRING:
+            return duckdb::Value(static_cast<const arrow::StringScalar&>(scalar).value->ToString());
+        default:
+            throw std::runtime_error("Unsupported query parameter type " + scalar.type->ToString());
+    }
+}
+
+void LocalDuckdb::query_stream(std::string sql, std::vector<std::shared_ptr<arrow::Scalar>> params,
+                               std::function<void(std::shared_ptr<arrow::RecordBatchReader>)> cb)
+{
+    auto connection = acquire();
+    auto& statement = connection->prepare(sql);
+    duckdb::vector<duckdb::Value> values;
+    for (auto& param : params) {
+        values.push_back(to_duckdb_value(*param));
+    }
+    auto result = statement.Execute(values, true);
+    if (result->HasError()) {
+        throw std::runtime_error("DuckDB query failed: " + result->GetError());
+    }
+    std::cout << "Query " << sql << std::endl;
+    cb(std::make_shared<StreamReader>(std::move(connection), std::move(result)));
+}
+
+void LocalDuckdb::query(std::string sql, std::function<void(std::shared_ptr<arrow::Table>)> cb)
+{
+    std::shared_ptr<arrow::Table> table;
+    query_stream(std::move(sql), [&table](std::shared_ptr<arrow::RecordBatchReader> reader) {
+        auto result = reader->ToTable();
+        pvd::check_cancelled();
+        table = result.ValueOrDie();
+    });
+    // the connection is back to the pool before the rest of the plan runs
+    cb(table);
+}
+
+std::shared_ptr<arrow::Table> LocalDuckdb::query_table(duckdb::Connection& con, const std::string& sql)
+{
+    duckdb_arrow result;
+    if (duckdb_query_arrow((duckdb_connection)&con, sql.c_str(), &result) == DuckDBError) {
+        std::string error = duckdb_query_arrow_error(result);
+        duckdb_destroy_arrow(&result);
+        throw std::runtime_error("DuckDB query failed: " + error);
+    }
+    return fetch_table(result);
+}
+
+std::shared_ptr<arrow::Table> LocalDuckdb::fetch_table(duckdb_arrow result)
+{
+    ArrowSchema result_schema;
+    duckdb_arrow_schema result_schema_ptr = (duckdb_arrow_schema)&result_schema;
+    duckdb_query_arrow_schema(result, &result_schema_ptr);
+
+    auto arrow_schema = arrow::ImportSchema(&result_schema).ValueOrDie();
+
+    std::vector<std::shared_ptr<arrow::RecordBatch>> batches;
+
+    while (!pvd::is_cancelled()) {
+        ArrowArray result_array{};
+        auto result_array_ptr = &result_array;
+        duckdb_query_arrow_array(result, (duckdb_arrow_array*)&result_array_ptr);
+        auto batch_result = arrow::ImportRecordBatch(&result_array, arrow_schema);
+        if (!batch_result.ok()) {
+            break;
+        }
+        batches.push_back(batch_result.ValueOrDie());
+    }
+
+    duckdb_destroy_arrow(&result);
+    pvd::check_cancelled();
+
+    return arrow::Table::FromRecordBatches(arrow_schema, batches).ValueOrDie();
+}
@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <cstring>
+
+#include "loopback.h"
+
+namespace pvd
+{
+    LinkShape::clock::time_point LinkShape::arrival(clock::time_point now, size_t size, clock::time_point& link_free) const
+    {
+        auto start = std::max(now, link_free);
+        link_free = start;
+        if (bytes_per_second > 0) {
+            link_free += std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(size / bytes_per_second));
+        }
+        return link_free + latency;
+    }
+
+    void NativeSender::Inbox::push_reply(std::shared_ptr<ar::Buffer> reply)
+    {
+        size_t size = reply->size();
+        push({clock::time_point(), std::move(reply), ""}, size);
+    }
+
+    void NativeSender::Inbox::push_error(const std::string& error)
+    {
+        push({clock::time_point(), nullptr, error}, error.size());
+    }
+
+    void NativeSender::Inbox::push(Entry entry, size_t size)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        entry.arrival = shape.arrival(clock::now(), size, link_free);
+        entries.push_back(std::move(entry));
+        cv.notify_one();
+    }
+
+    NativeSender::NativeSender(LinkShape shape) : inbox(std::make_shared<Inbox>())
+    {
+        inbox->shape = shape;
+    }
+
+    void NativeSender::send(const Query& query, void* data, query_callback_t cb)
+    {
+        int32_t id = 0;
+        // the reply continues the execution of the view that sent the query
+        if (auto execution = ViewExecution::current()) {
+            cb = [execution, cb = std::move(cb)](Reply reply) {
+                ViewScope scope(execution);
+                cb(reply);
+            };
+        }
+        // the server never replies to a Log
+        if (query.msg != Query::Log) {
+            id = pending.add(cb);
+        }
+        query_callback_t superseded;
+        if (query.msg == Query::Execute || query.msg == Query::ExecuteBatch) {
+            // the server cancels the previous execution of the node by the view and never replies to it
+            auto [it, inserted] = latest_execute.try_emplace({query.view, query.node_id}, id);
+            if (!inserted) {
+                superseded = pending.take(it->second);
+                it->second = id;
+            }
+        }
+
+        auto message = std::make_shared<std::string>(sizeof(int32_t) + sizeof(query) + query.data_size, '\0');
+        std::memcpy(message->data(), &id, sizeof(id));
+        std::memcpy(message->data() + sizeof(id), &query, sizeof(query));
+        std::memcpy(message->data() + sizeof(id) + sizeof(query), data, query.data_size);
+
+        if (!inbox->shape.is_shaped()) {
+            transmit(message);
+        }
+        else {
+            outbox.push_back({inbox->shape.arrival(clock::now(), message->size(), link_free), message});
+        }
+        if (superseded) {
+            superseded(Reply::failed(Reply::Cancelled));
+        }
+    }
+
+    void NativeSender::receive(void* reply, int64_t size)
+    {
+        int32_t id = *(int32_t*)reply;
+        Reply r = Reply{static_cast<int64_t>(size - sizeof(int32_t)), (void*)((char*)reply + sizeof(int32_t))};
+        query_callback_t cb = pending.take(id);
+        if (!cb) {
+            // reply of a superseded query, already called back as cancelled
+            return;
+        }
+        cb(r);
+    }
+
+    void NativeSender::run_until_idle()
+    {
+        while (pending.size() > 0 || !outbox.empty()) {
+            while (!outbox.empty() && outbox.front().arrival <= clock::now()) {
+                auto message = std::move(outbox.front().message);
+                outbox.pop_front();
+                transmit(message);
+            }
+            Inbox::Entry entry;
+            {
+                std::unique_lock<std::mutex> lock(inbox->mutex);
+                // wake up for the next reply, or the next delayed message
+                while (true) {
+                    auto now = clock::now();
+                    auto wake = outbox.empty() ? clock::time_point::max() : outbox.front().arrival;
+                    if (!inbox->entries.empty()) {
+                        if (inbox->entries.front().arrival <= now) {
+                            entry = std::move(inbox->entries.front());
+                            inbox->entries.pop_front();
+                            break;
+                        }
+                        wake = std::min(wake, inbox->entries.front().arrival);
+                    }
+                    if (wake <= now) {
+                        break;
+                    }
+                    if (wake == clock::time_point::max()) {
+                        inbox->cv.wait(lock);
+                    }
+                    else {
+                        inbox->cv.wait_until(lock, wake);
+                    }
+                }
+            }
+            if (!entry.error.empty()) {
+                throw std::runtime_error(entry.error);
+            }
+            if (entry.reply) {
+                receive((void*)entry.reply->data(), entry.reply->size());
+            }
+        }
+    }
+
+    LoopbackSender::~LoopbackSender()
+    {
+        handler.close(this);
+    }
+
+    void LoopbackSender::transmit(std::shared_ptr<const std::string> message)
+    {
+        auto reply = [inbox = inbox](std::shared_ptr<ar::Buffer> buffer) { inbox->push_reply(std::move(buffer)); };
+        auto error = [inbox = inbox](const std::string& message) { inbox->push_error(message); };
+        // the handler is server code, which runs without a SENDER
+        auto client = std::exchange(SENDER, nullptr);
+        try {
+            handler.handle(this, message, reply, error);
+        }
+        catch (...) {
+            SENDER = client;
+            throw;
+        }
+        SENDER = client;
+    }
+}
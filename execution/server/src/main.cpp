@@ -2,182 +2,155 @@
 
 #include <websocketpp/config/asio_no_tls.hpp>
 #include <websocketpp/server.hpp>
+#include <filesystem>
 #include <iostream>
 #include <random>
-#include <arrow/c/bridge.h>
-
-#include "duckdb.hpp"
 
 #include "network.h"
 #include "plan.h"
-#include "binding.h"
 #include "cloud_api.h"
 #include "metrics.h"
-
-class LocalDuckdb : public pvd::CloudApi {
-public:
-    void query(std::string sql, std::function<void(std::shared_ptr<arrow::Table>)> cb) override
-    {
-        duckdb::DuckDB db("../../data/pvd.db");
-        duckdb::Connection con(db);
-        duckdb_arrow result;
-        duckdb_query_arrow((duckdb_connection)&con, sql.c_str(), &result);
-
-        std::cout << "Query " << sql << std::endl;
-
-        ArrowSchema result_schema;
-        duckdb_arrow_schema result_schema_ptr = (duckdb_arrow_schema)&result_schema;
-        duckdb_query_arrow_schema(result, &result_schema_ptr);
-
-        auto arrow_schema = arrow::ImportSchema(&result_schema).ValueOrDie();
-
-        std::vector<std::shared_ptr<arrow::RecordBatch>> batches;
-
-        while (true) {
-            auto result_array = new ArrowArray();
-            duckdb_query_arrow_array(result, (duckdb_arrow_array*)&result_array);
-            auto batch_result = arrow::ImportRecordBatch(result_array, arrow_schema);
-            if (batch_result.ok()) {
-                batches.push_back(batch_result.ValueOrDie());
-            } else {
-                delete result_array;
-                break;
-            }
-            delete result_array;
-        }
-
-        auto table = arrow::Table::FromRecordBatches(batches).ValueOrDie();
-        cb(table);
-    }
-};
-
+#include "server_handler.h"
+#include "unix_socket.h"
+#include "executor.h"
+#include "domain.h"
+#include "local_duckdb.h"
+#include "trace.h"
 
 typedef websocketpp::server<websocketpp::config::asio> webserver;
+typedef asio::strand<asio::io_context::executor_type> strand_t;
 webserver server;
 
 // The global SENDER is always nullptr in server
-pvd::QuerySender* pvd::SENDER = nullptr;
+thread_local pvd::QuerySender* pvd::SENDER = nullptr;
 
-pvd::CloudApi* pvd::cloud = new LocalDuckdb();
+// created in main, with one database connection per execution thread
+pvd::CloudApi* pvd::cloud = nullptr;
 
-std::ofstream pvd::log_file("pvd_log.txt", std::ios::out | std::ios::app);
+// the trace of the server and the clients, Chrome trace JSON array format (the closing ] is optional)
+const char* TRACE_FILE = "pvd_trace.json";
+std::ofstream pvd::log_file(TRACE_FILE, std::ios::out | std::ios::app);
 
-// plan root id -> plan
-//std::map<int, std::shared_ptr<pvd::Plan>> registered_plans;
-int cur_plan_id = 0;
-std::shared_ptr<pvd::Plan> cur_plan;
-// plan node id -> plan root id
-std::map<int, int> node_to_root;
+// executes the plans, the websocket threads only parse and dispatch messages
+std::unique_ptr<pvd::Executor> executor;
+// all plans registered by all connections
+std::unique_ptr<pvd::ServerHandler> handler;
 
-void recursive_set_node_to_root(std::shared_ptr<pvd::Plan> plan, int root, std::map<int, int>& node_to_root) {
-    node_to_root[plan->id] = root;
-    for (auto input: plan->input_plans()) {
-        recursive_set_node_to_root(input, root, node_to_root);
-    }
+// replies of a connection are sent in order from the strand of the connection
+std::mutex strands_mutex;
+std::map<pvd::ConnectionId, std::shared_ptr<strand_t>> strands;
+
+pvd::ConnectionId connection_id(websocketpp::connection_hdl hdl) {
+    return hdl.lock().get();
 }
 
-void on_message(websocketpp::connection_hdl hdl, webserver::message_ptr msg) {
-    // received the binary data
-    const char* data = msg->get_payload().data();
-    // the first 4-bytes of the data denotes the query id
-    int32_t query_id = *(int32_t*)data;
-    // the following sizeof(Query) bytes of the data is the query info
-    pvd::Query* query = (pvd::Query*)(data + sizeof(int32_t));
-    // the remaining bytes of the data is the query content
-    // if is a init query, the content is the plan json string
-    // if is a execution query, the content is the binding json string
-    void* content = (void*)(data + sizeof(int32_t) + sizeof(pvd::Query));
-
-    switch (query->msg)
+void reply(websocketpp::connection_hdl hdl, std::shared_ptr<ar::Buffer> buffer) {
+    std::shared_ptr<strand_t> strand;
     {
-        // initialize a plan
-        case pvd::Query::Message::Init: {
-            std::cout << "Init" << std::endl;
-            // message content is the json string of the plan
-            std::string plan_json = (char*)content;
-            std::cout << plan_json << std::endl;
-            pvd::logging("{\"register_plan\": \"" + plan_json + "\"}");
-            // parse the json string to a plan
-            auto plan = pvd::parse_json_plan(json::parse(plan_json));
-            // initialize the plan, register the plan with the root id
-            cur_plan_id = plan->id;
-            cur_plan = plan;
-            // registered_plans[plan->id] = plan;
-            node_to_root.clear();
-            node_to_root[plan->id] = plan->id;
-
-            recursive_set_node_to_root(plan, plan->id, node_to_root);
-
-            // Find SCache and initialize
-            try {
-                std::cout << "Initializing Plan" << std::endl;
-                plan->initialize([plan, query_id, hdl]() {
-                    std::cout << "Plan Initialized" << std::endl;
-                    auto out = ar::io::BufferOutputStream::Create().ValueOrDie();
-                    { auto _ = out->Write(reinterpret_cast<const uint8_t *>(&query_id), sizeof(query_id)); }
-                    auto plan_str = plan->to_string();
-                    { auto _ = out->Write(plan_str.c_str(), plan_str.size() + 1); }
-                    std::cout << "Sending Plan" << std::endl;
-                    std::cout << plan->to_string() << std::endl;
-                    auto buffer = out->Finish().ValueOrDie();
-                    server.send(hdl, buffer->data(), buffer->size(), websocketpp::frame::opcode::binary);
-                });
-            }
-            catch (std::exception& e) {
-                std::string error = "ERROR: " + std::string(e.what());
-                server.send(hdl, error.c_str(), error.size() + 1, websocketpp::frame::opcode::text);
-            }
-            break;
-        }
-        case pvd::Query::Message::Execute: {
-            int node = query->node_id;
-            std::cout << "Execute " << node << std::endl;
-            if (!node_to_root.contains(node)) {
-                std::string error = "ERROR: Plan id not found: " + std::to_string(node);
-                server.send(hdl, error.c_str(), error.size() + 1, websocketpp::frame::opcode::text);
-            }
-            auto plan = cur_plan; // registered_plans.at(node_to_root.at(node));
-            std::cout <<"Found plan " << plan->id << std::endl;
-            // query content is the binding json string
-            std::string binding_json = (char*)content;
-            std::cout << binding_json << std::endl;
-            // parse the json string to a binding
-            auto binding = pvd::parse_json_binding(json::parse(binding_json));
-            std::cout <<"Parsed binding " << std::endl;
-            plan->execute_subplan(binding, node, [hdl, query_id](std::shared_ptr<pvd::SerialData> data) {
-                std::cout <<"Plan Executed " << std::endl;
-                // send the result to the client
-                auto out = ar::io::BufferOutputStream::Create().ValueOrDie();
-                { auto _ = out->Write(reinterpret_cast<const uint8_t *>(&query_id), sizeof(query_id)); }
-                data->serialize(out);
-                auto buffer = out->Finish().ValueOrDie();
-                server.send(hdl, buffer->data(), buffer->size(), websocketpp::frame::opcode::binary);
-            });
-            break;
-        }
-        case pvd::Query::Message::Log: {
-            std::string log = (char*)content;
-            pvd::logging(log);
-            break;
+        std::lock_guard<std::mutex> lock(strands_mutex);
+        auto it = strands.find(connection_id(hdl));
+        if (it == strands.end()) {
+            // the connection is closed
+            return;
         }
+        strand = it->second;
     }
+    asio::post(*strand, [hdl, buffer]() {
+        websocketpp::lib::error_code ec;
+        server.send(hdl, buffer->data(), buffer->size(), websocketpp::frame::opcode::binary, ec);
+    });
 }
 
-int main()
+void reply_error(websocketpp::connection_hdl hdl, const std::string& message) {
+    std::string error = "ERROR: " + message;
+    websocketpp::lib::error_code ec;
+    server.send(hdl, error.c_str(), error.size() + 1, websocketpp::frame::opcode::text, ec);
+}
+
+void on_open(websocketpp::connection_hdl hdl) {
+    std::lock_guard<std::mutex> lock(strands_mutex);
+    strands[connection_id(hdl)] = std::make_shared<strand_t>(asio::make_strand(server.get_io_service()));
+}
+
+void on_close(websocketpp::connection_hdl hdl) {
+    {
+        std::lock_guard<std::mutex> lock(strands_mutex);
+        strands.erase(connection_id(hdl));
+    }
+    // release all plans (and their caches) registered by the connection
+    handler->close(connection_id(hdl));
+    std::cout << "Connection closed, " << handler->num_sessions() << " sessions alive" << std::endl;
+}
+
+void on_message(websocketpp::connection_hdl hdl, webserver::message_ptr msg) {
+    // the payload shares the ownership of the message
+    std::shared_ptr<const std::string> message(msg, &msg->get_payload());
+    handler->handle(connection_id(hdl), message,
+                    [hdl](std::shared_ptr<ar::Buffer> buffer) { reply(hdl, buffer); },
+                    [hdl](const std::string& error) { reply_error(hdl, error); });
+}
+
+/*
+ * usage: pvd_server [--port N] [--io-threads N] [--exec-threads N] [--domain-cache FILE] [--unix PATH]
+ *
+ * --unix also accepts native clients (pvd_replay --unix) on a Unix socket
+ */
+int main(int argc, char** argv)
 {
+    srand(static_cast<unsigned int>(time(nullptr)));
+
+    int port = rand() % 50000 + 8000;
+    int num_cores = std::max(1u, std::thread::hardware_concurrency());
+    int io_threads = std::max(1, num_cores / 4);
+    int exec_threads = num_cores;
+    std::string unix_path;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--port") port = std::stoi(argv[i + 1]);
+        else if (arg == "--io-threads") io_threads = std::stoi(argv[i + 1]);
+        else if (arg == "--exec-threads") exec_threads = std::stoi(argv[i + 1]);
+        else if (arg == "--domain-cache") pvd::DomainCatalog::instance().persist(argv[i + 1]);
+        else if (arg == "--unix") unix_path = argv[i + 1];
+        else {
+            std::cout << "Unknown argument " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (std::filesystem::file_size(TRACE_FILE) == 0) {
+        pvd::logging("[");
+    }
+    pvd::start_trace_exporter(std::chrono::milliseconds(500));
+
+    executor = std::make_unique<pvd::Executor>(exec_threads);
+    handler = std::make_unique<pvd::ServerHandler>(executor.get());
+    pvd::cloud = new LocalDuckdb("../../data/pvd.db", exec_threads);
+    std::unique_ptr<pvd::UnixSocketServer> unix_server;
+    if (!unix_path.empty()) {
+        unix_server = std::make_unique<pvd::UnixSocketServer>(*handler, unix_path);
+        unix_server->start();
+        std::cout << "Native clients at " << unix_path << std::endl;
+    }
+
+    server.set_open_handler(&on_open);
     server.set_message_handler(&on_message);
+    server.set_close_handler(&on_close);
     server.clear_access_channels(websocketpp::log::alevel::frame_header | websocketpp::log::alevel::frame_payload);
 
     server.init_asio();
 
-    srand(static_cast<unsigned int>(time(nullptr)));
-
-    int port = rand() % 50000 + 8000;
     server.listen(port);
     server.start_accept();
 
-    std::cout << "Server started at port " << port << std::endl;
+    std::cout << "Server started at port " << port << " with " << io_threads << " io threads and "
+              << exec_threads << " execution threads" << std::endl;
 
-    server.run();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < io_threads; i++) {
+        threads.emplace_back([]() { server.run(); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
     return 0;
 }
@@ -0,0 +1,252 @@
+#include <iostream>
+
+#include "server_handler.h"
+#include "network.h"
+#include "binding.h"
+#include "metrics.h"
+#include "cancel.h"
+#include "trace.h"
+#include "memory_accounting.h"
+
+namespace pvd
+{
+    // send the error of an execution to the client, a cancelled execution has no reply
+    static void report_error(std::exception_ptr e, const std::string& execution, const ServerHandler::error_t& error)
+    {
+        try {
+            std::rethrow_exception(e);
+        }
+        catch (Cancelled&) {
+            std::cout << execution << " cancelled" << std::endl;
+        }
+        catch (std::exception& e) {
+            error(e.what());
+        }
+        catch (...) {
+            error(execution + " failed");
+        }
+    }
+
+    void ServerHandler::handle(ConnectionId conn, std::shared_ptr<const std::string> message, reply_t reply, error_t error)
+    {
+        // received the binary data
+        const char* data = message->data();
+        // the first 4-bytes of the data denotes the query id
+        int32_t query_id = *(int32_t*)data;
+        // the following sizeof(Query) bytes of the data is the query info
+        Query* query = (Query*)(data + sizeof(int32_t));
+        // the remaining bytes of the data is the query content
+        // if is a init query, the content is the plan json string
+        // if is a execution query, the content is the binding json string
+        // if is a batch execution query, the content is the json of the node ids and the binding
+        // message is captured by the tasks below to keep the content alive
+        const char* content = data + sizeof(int32_t) + sizeof(Query);
+
+        switch (query->msg)
+        {
+            // initialize a plan
+            case Query::Message::Init: {
+                std::cout << "Init" << std::endl;
+                // message content is the json string of the plan
+                std::string plan_json = content;
+                std::cout << plan_json << std::endl;
+                std::shared_ptr<Session> session;
+                try {
+                    // parse the json string to a plan, register the plan as a session of the connection
+                    session = registry.register_plan(conn, json::parse(plan_json), executor);
+                }
+                catch (std::exception& e) {
+                    error(e.what());
+                    break;
+                }
+                logging(trace_instant_json("register_plan", "{\"plan\": " + plan_json + "}"));
+                // Find SCache and initialize
+                session->strand->post([session, query_id, reply, error, executor = executor]() {
+                    auto plan = session->plan;
+                    try {
+                        std::cout << "Initializing Plan" << std::endl;
+                        // the independent SCaches are built in parallel, the reply is sent when the
+                        // last one is built, the executions of the session wait until then
+                        plan->initialize([session, plan, query_id, reply, error](std::exception_ptr e) {
+                            session->finish_initialization();
+                            if (e) {
+                                report_error(e, "Init", error);
+                                return;
+                            }
+                            std::cout << "Plan Initialized" << std::endl;
+                            auto out = ar::io::BufferOutputStream::Create().ValueOrDie();
+                            { auto _ = out->Write(reinterpret_cast<const uint8_t *>(&query_id), sizeof(query_id)); }
+                            auto plan_str = plan->to_string();
+                            { auto _ = out->Write(plan_str.c_str(), plan_str.size() + 1); }
+                            std::cout << "Sending Plan" << std::endl;
+                            std::cout << plan_str << std::endl;
+                            reply(out->Finish().ValueOrDie());
+                        }, executor);
+                    }
+                    catch (std::exception& e) {
+                        session->finish_initialization();
+                        error(e.what());
+                    }
+                });
+                break;
+            }
+            case Query::Message::Execute: {
+                int node = query->node_id;
+                std::cout << "Execute " << node << std::endl;
+                auto session = registry.find(conn, node);
+                if (session == nullptr) {
+                    error("Plan id not found: " + std::to_string(node));
+                    break;
+                }
+                std::cout <<"Found plan " << session->root_id << std::endl;
+                // a new execution of the node by a view cancels its previous one, whose result is no longer needed
+                int view = query->view;
+                auto token = session->begin_execution(view, node);
+                // executions of the same session run in order, different sessions run in parallel
+                session->post([session, view, node, query_id, reply, error, message, content, token]() {
+                    if (token->is_cancelled()) {
+                        // superseded while waiting in the queue, the client does not expect a reply
+                        return;
+                    }
+                    // the execution ends when the task does, it may suspend past spawn
+                    auto failed = [session, view, node, token, error](std::exception_ptr e) {
+                        session->end_execution(view, node, token);
+                        report_error(e, "Execute " + std::to_string(node), error);
+                    };
+                    try {
+                        CancelScope scope(token);
+                        // query content is the binding json string
+                        // parse the json string to a binding
+                        auto binding = parse_json_binding(json::parse(content));
+                        spawn(session->execute(std::move(binding), node), [session, view, node, token, reply, query_id](std::shared_ptr<SerialData> data) {
+                            session->end_execution(view, node, token);
+                            std::cout << "Plan Executed " << std::endl;
+                            // send the result to the client
+                            auto out = ar::io::BufferOutputStream::Create().ValueOrDie();
+                            { auto _ = out->Write(reinterpret_cast<const uint8_t *>(&query_id), sizeof(query_id)); }
+                            data->serialize(out);
+                            reply(out->Finish().ValueOrDie());
+                        }, failed);
+                    }
+                    catch (...) {
+                        failed(std::current_exception());
+                    }
+                });
+                break;
+            }
+            case Query::Message::ExecuteBatch: {
+                // content is {"nodes": [node ids], "binding": {...}}, all nodes belong to one plan
+                std::vector<int> nodes;
+                BindingMap binding;
+                try {
+                    parse_batch_request(content, nodes, binding);
+                }
+                catch (std::exception& e) {
+                    error(e.what());
+                    break;
+                }
+                std::cout << "Execute batch of " << nodes.size() << " nodes" << std::endl;
+                auto session = registry.find(conn, nodes[0]);
+                if (session == nullptr) {
+                    error("Plan id not found: " + std::to_string(nodes[0]));
+                    break;
+                }
+                // the batch is superseded by the next execution of its first node by the view
+                int view = query->view;
+                auto token = session->begin_execution(view, nodes[0]);
+                session->post([session, view, nodes, binding, query_id, reply, error, token]() {
+                    if (token->is_cancelled()) {
+                        return;
+                    }
+                    auto failed = [session, view, nodes, token, error](std::exception_ptr e) {
+                        session->end_execution(view, nodes[0], token);
+                        report_error(e, "Execute batch", error);
+                    };
+                    try {
+                        CancelScope scope(token);
+                        spawn(session->execute_batch(binding, nodes), [session, view, token, reply, query_id, nodes](std::vector<std::shared_ptr<SerialData>> results) {
+                            session->end_execution(view, nodes[0], token);
+                            std::cout << "Batch Executed " << std::endl;
+                            // [query_id] [num results] { [node id] [size] [result] } ...
+                            auto out = ar::io::BufferOutputStream::Create().ValueOrDie();
+                            { auto _ = out->Write(reinterpret_cast<const uint8_t *>(&query_id), sizeof(query_id)); }
+                            int32_t num = static_cast<int32_t>(results.size());
+                            { auto _ = out->Write(reinterpret_cast<const uint8_t *>(&num), sizeof(num)); }
+                            for (size_t i = 0; i < results.size(); i++) {
+                                auto result_out = ar::io::BufferOutputStream::Create().ValueOrDie();
+                                results[i]->serialize(result_out);
+                                auto result = result_out->Finish().ValueOrDie();
+                                int32_t node = nodes[i];
+                                int64_t size = result->size();
+                                { auto _ = out->Write(reinterpret_cast<const uint8_t *>(&node), sizeof(node)); }
+                                { auto _ = out->Write(reinterpret_cast<const uint8_t *>(&size), sizeof(size)); }
+                                { auto _ = out->Write(result->data(), result->size()); }
+                            }
+                            reply(out->Finish().ValueOrDie());
+                        }, failed);
+                    }
+                    catch (...) {
+                        failed(std::current_exception());
+                    }
+                });
+                break;
+            }
+            case Query::Message::Stats: {
+                stats(query_id, reply);
+                break;
+            }
+            case Query::Message::Log: {
+                // a batch of trace events of the client
+                std::string log = content;
+                logging(log);
+                break;
+            }
+        }
+    }
+
+    void ServerHandler::close(ConnectionId conn)
+    {
+        registry.drop(conn);
+    }
+
+    void ServerHandler::stats(int32_t query_id, reply_t reply)
+    {
+        json stats;
+        stats["process"] = {
+            {"rss_bytes", current_rss_bytes()},
+            {"peak_rss_bytes", peak_rss_bytes()},
+            {"arrow_bytes", ar::default_memory_pool()->bytes_allocated()},
+            {"arrow_peak_bytes", ar::default_memory_pool()->max_memory()},
+        };
+        stats["sessions"] = json::array();
+
+        auto sessions = registry.all_sessions();
+        auto result = std::make_shared<std::pair<std::mutex, json>>();
+        result->second = std::move(stats);
+        auto remaining = std::make_shared<std::atomic<size_t>>(sessions.size());
+        auto send = [reply, query_id, result]() {
+            auto content = result->second.dump();
+            auto out = ar::io::BufferOutputStream::Create().ValueOrDie();
+            { auto _ = out->Write(reinterpret_cast<const uint8_t *>(&query_id), sizeof(query_id)); }
+            { auto _ = out->Write(content.c_str(), content.size() + 1); }
+            reply(out->Finish().ValueOrDie());
+        };
+        if (sessions.empty()) {
+            send();
+            return;
+        }
+        for (auto& session : sessions) {
+            session->post([session, result, remaining, send]() {
+                auto memory = session->memory_stats();
+                memory["root"] = session->root_id;
+                {
+                    std::lock_guard<std::mutex> lock(result->first);
+                    result->second["sessions"].push_back(std::move(memory));
+                }
+                if (--*remaining == 0) {
+                    send();
+                }
+            });
+        }
+    }
+}
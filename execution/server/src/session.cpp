@@ -0,0 +1,173 @@
+#include "session.h"
+
+namespace pvd
+{
+    task<std::shared_ptr<SerialData>> Session::execute(BindingMap binding, int node_id)
+    {
+        auto it = context.nodes.find(node_id);
+        if (it == context.nodes.end()) {
+            throw std::runtime_error("Plan id not found: " + std::to_string(node_id));
+        }
+        co_return co_await it->second->execute_async(std::move(binding));
+    }
+
+    task<std::vector<std::shared_ptr<SerialData>>> Session::execute_batch(BindingMap binding, std::vector<int> node_ids)
+    {
+        std::vector<std::shared_ptr<Plan>> plans;
+        for (int node_id : node_ids) {
+            auto it = context.nodes.find(node_id);
+            if (it == context.nodes.end()) {
+                throw std::runtime_error("Plan id not found: " + std::to_string(node_id));
+            }
+            plans.push_back(it->second);
+        }
+
+        auto batch = std::make_shared<ExecutionBatch>(std::move(binding));
+        std::vector<task<std::shared_ptr<SerialData>>> executions;
+        for (auto& plan : plans) {
+            executions.push_back(plan->execute_async(batch->get_binding(), batch));
+        }
+        co_return co_await when_all(std::move(executions));
+    }
+
+    std::shared_ptr<CancelToken> Session::begin_execution(int view, int node_id)
+    {
+        auto token = std::make_shared<CancelToken>();
+        std::shared_ptr<CancelToken> previous;
+        {
+            std::lock_guard<std::mutex> lock(executions_mutex);
+            previous = std::exchange(executions[{view, node_id}], token);
+        }
+        if (previous) {
+            previous->cancel();
+        }
+        return token;
+    }
+
+    void Session::end_execution(int view, int node_id, const std::shared_ptr<CancelToken>& token)
+    {
+        std::lock_guard<std::mutex> lock(executions_mutex);
+        auto it = executions.find({view, node_id});
+        if (it != executions.end() && it->second == token) {
+            executions.erase(it);
+        }
+    }
+
+    void Session::post(task_t task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(init_mutex);
+            if (!initialized) {
+                deferred.push_back(std::move(task));
+                return;
+            }
+        }
+        strand->post(std::move(task));
+    }
+
+    void Session::finish_initialization()
+    {
+        std::vector<task_t> tasks;
+        {
+            std::lock_guard<std::mutex> lock(init_mutex);
+            initialized = true;
+            tasks.swap(deferred);
+        }
+        for (auto& task : tasks) {
+            strand->post(std::move(task));
+        }
+    }
+
+    json Session::memory_stats()
+    {
+        json caches = json::array();
+        json operators = json::array();
+        // a buffer shared by several caches of the session is counted by the first one
+        BufferSet counted;
+        for (auto& [node_id, node] : context.nodes) {
+            if (auto pool = node->allocated_pool()) {
+                operators.push_back({
+                    {"node", node->label()}, {"live_bytes", pool->bytes_allocated()}, {"peak_bytes", pool->max_memory()}});
+            }
+            auto memory = node->cache_memory(counted);
+            if (memory.num_bindings == 0) {
+                continue;
+            }
+            caches.push_back({
+                {"node", node->label()},
+                {"num_bindings", memory.num_bindings},
+                {"retained_bytes", memory.retained_bytes},
+                {"max_binding_bytes", memory.max_binding_bytes},
+            });
+        }
+        return {{"caches", std::move(caches)}, {"operators", std::move(operators)}};
+    }
+
+    std::shared_ptr<Session> PlanRegistry::register_plan(ConnectionId conn, const json& plan_json, Executor* executor)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // forget SCache stores that are no longer used by any session
+        for (auto it = shared_scaches.begin(); it != shared_scaches.end();) {
+            if (it->second.expired()) it = shared_scaches.erase(it);
+            else ++it;
+        }
+
+        auto session = std::make_shared<Session>();
+        session->conn = conn;
+        session->strand = std::make_shared<Strand>(executor);
+        session->context.shared_scaches = &shared_scaches;
+        session->plan = parse_json_plan(plan_json, session->context);
+        session->root_id = session->plan->id;
+
+        sessions[conn][session->root_id] = session;
+        auto& nodes = node_to_root[conn];
+        for (auto& [node_id, _] : session->context.nodes) {
+            nodes[node_id] = session->root_id;
+        }
+        return session;
+    }
+
+    std::shared_ptr<Session> PlanRegistry::find(ConnectionId conn, int node_id) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto nodes = node_to_root.find(conn);
+        if (nodes == node_to_root.end() || !nodes->second.contains(node_id)) {
+            return nullptr;
+        }
+        auto& conn_sessions = sessions.at(conn);
+        auto session = conn_sessions.find(nodes->second.at(node_id));
+        if (session == conn_sessions.end()) {
+            return nullptr;
+        }
+        return session->second;
+    }
+
+    void PlanRegistry::drop(ConnectionId conn)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sessions.erase(conn);
+        node_to_root.erase(conn);
+    }
+
+    std::vector<std::shared_ptr<Session>> PlanRegistry::all_sessions() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<std::shared_ptr<Session>> result;
+        for (auto& [_, conn_sessions] : sessions) {
+            for (auto& [_, session] : conn_sessions) {
+                result.push_back(session);
+            }
+        }
+        return result;
+    }
+
+    size_t PlanRegistry::num_sessions() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t total = 0;
+        for (auto& [_, conn_sessions] : sessions) {
+            total += conn_sessions.size();
+        }
+        return total;
+    }
+}
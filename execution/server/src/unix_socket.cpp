@@ -0,0 +1,219 @@
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+
+#include "unix_socket.h"
+
+namespace pvd
+{
+    static bool write_all(int fd, const void* data, size_t size)
+    {
+        auto bytes = static_cast<const char*>(data);
+        while (size > 0) {
+            auto n = ::send(fd, bytes, size, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            bytes += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    static bool read_all(int fd, void* data, size_t size)
+    {
+        auto bytes = static_cast<char*>(data);
+        while (size > 0) {
+            auto n = ::recv(fd, bytes, size, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            bytes += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    static bool write_frame(int fd, FrameKind kind, const void* data, size_t size)
+    {
+        char header[sizeof(uint32_t) + 1];
+        auto frame_size = static_cast<uint32_t>(size);
+        std::memcpy(header, &frame_size, sizeof(frame_size));
+        header[sizeof(uint32_t)] = static_cast<char>(kind);
+        return write_all(fd, header, sizeof(header)) && write_all(fd, data, size);
+    }
+
+    // false when the connection is closed
+    static bool read_frame(int fd, FrameKind& kind, std::string& payload)
+    {
+        char header[sizeof(uint32_t) + 1];
+        if (!read_all(fd, header, sizeof(header))) {
+            return false;
+        }
+        uint32_t size;
+        std::memcpy(&size, header, sizeof(size));
+        kind = static_cast<FrameKind>(header[sizeof(uint32_t)]);
+        payload.resize(size);
+        return read_all(fd, payload.data(), size);
+    }
+
+    static sockaddr_un socket_address(const std::string& path)
+    {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path)) {
+            throw std::runtime_error("Socket path is too long: " + path);
+        }
+        std::strcpy(address.sun_path, path.c_str());
+        return address;
+    }
+
+    UnixSocketServer::UnixSocketServer(ServerHandler& handler, const std::string& path) : handler(handler), path(path)
+    {
+        auto address = socket_address(path);
+        listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        ::unlink(path.c_str());
+        if (listen_fd < 0 || ::bind(listen_fd, (sockaddr*)&address, sizeof(address)) < 0 || ::listen(listen_fd, 64) < 0) {
+            throw std::runtime_error("Can not listen on " + path + ": " + std::strerror(errno));
+        }
+    }
+
+    UnixSocketServer::~UnixSocketServer()
+    {
+        // stop accepting, then end the connections: their threads see the end of the socket
+        ::shutdown(listen_fd, SHUT_RDWR);
+        if (acceptor.joinable()) {
+            acceptor.join();
+        }
+        std::vector<std::thread> threads;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (auto& [fd, _] : readers) {
+                ::shutdown(fd, SHUT_RDWR);
+            }
+            readers_done.wait(lock, [this]() { return readers.empty(); });
+            threads.swap(finished);
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        ::close(listen_fd);
+        ::unlink(path.c_str());
+    }
+
+    void UnixSocketServer::start()
+    {
+        acceptor = std::thread([this]() {
+            while (true) {
+                int fd = ::accept(listen_fd, nullptr, nullptr);
+                if (fd < 0) {
+                    if (errno == EINTR) continue;
+                    return;
+                }
+                std::vector<std::thread> threads;
+                {
+                    // the thread removes itself from readers when the connection closes, not before it is added
+                    std::lock_guard<std::mutex> lock(mutex);
+                    threads.swap(finished);
+                    readers.emplace(fd, std::thread([this, fd]() { serve(fd); }));
+                }
+                for (auto& thread : threads) {
+                    thread.join();
+                }
+            }
+        });
+    }
+
+    void UnixSocketServer::serve(int fd)
+    {
+        // the replies are written by the execution threads, one at a time, until the connection closes
+        struct Connection
+        {
+            int fd;
+            std::mutex mutex;
+            bool closed = false;
+
+            void write(FrameKind kind, const void* data, size_t size)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!closed) {
+                    write_frame(fd, kind, data, size);
+                }
+            }
+        };
+        auto conn = std::make_shared<Connection>();
+        conn->fd = fd;
+
+        FrameKind kind;
+        while (true) {
+            auto message = std::make_shared<std::string>();
+            if (!read_frame(fd, kind, *message) || kind != FrameKind::Message) {
+                break;
+            }
+            handler.handle(conn.get(), message,
+                           [conn](std::shared_ptr<ar::Buffer> buffer) {
+                               conn->write(FrameKind::Reply, buffer->data(), buffer->size());
+                           },
+                           [conn](const std::string& error) {
+                               conn->write(FrameKind::Error, error.data(), error.size());
+                           });
+        }
+        // release all plans (and their caches) registered by the connection
+        handler.close(conn.get());
+        std::cout << "Connection closed, " << handler.num_sessions() << " sessions alive" << std::endl;
+        {
+            std::lock_guard<std::mutex> lock(conn->mutex);
+            conn->closed = true;
+        }
+        // the socket is closed with the thread handed over, a new connection may reuse it
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = readers.find(fd);
+        finished.push_back(std::move(it->second));
+        readers.erase(it);
+        ::close(fd);
+        readers_done.notify_all();
+    }
+
+    UnixSocketSender::UnixSocketSender(const std::string& path, LinkShape shape) : NativeSender(shape)
+    {
+        auto address = socket_address(path);
+        fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || ::connect(fd, (sockaddr*)&address, sizeof(address)) < 0) {
+            int error = errno;
+            if (fd >= 0) ::close(fd);
+            throw std::runtime_error("Can not connect to " + path + ": " + std::strerror(error));
+        }
+        reader = std::thread([fd = fd, inbox = inbox]() {
+            FrameKind kind;
+            std::string payload;
+            while (read_frame(fd, kind, payload)) {
+                if (kind == FrameKind::Reply) {
+                    inbox->push_reply(ar::Buffer::FromString(std::move(payload)));
+                    payload = std::string();
+                }
+                else if (kind == FrameKind::Error) {
+                    inbox->push_error(payload);
+                }
+            }
+            // wake up the client if it is waiting for a reply
+            inbox->push_error("Connection to the server closed");
+        });
+    }
+
+    UnixSocketSender::~UnixSocketSender()
+    {
+        ::shutdown(fd, SHUT_RDWR);
+        reader.join();
+        ::close(fd);
+    }
+
+    void UnixSocketSender::transmit(std::shared_ptr<const std::string> message)
+    {
+        if (!write_frame(fd, FrameKind::Message, message->data(), message->size())) {
+            throw std::runtime_error(std::string("Can not send to the server: ") + std::strerror(errno));
+        }
+    }
+}
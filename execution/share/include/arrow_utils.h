@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdlib>
 #include <iostream>
 #include <vector>
 #include <type_traits>
@@ -11,11 +12,45 @@
 #include <arrow/compute/api.h>
 #include <arrow/compute/api_vector.h>
 
+#include "cancel.h"
+
 namespace ar = arrow;
 namespace cp = arrow::compute;
 namespace ac = arrow::acero;
 
-const int MAX_BATCH_SIZE = 1000000000;
+// Tables are read by acero in batches (morsels) of this many rows, so the operators of a plan
+// run on several threads and the plan streams. Set per node with "batch_size" in the plan json,
+// override the default with the PVD_BATCH_SIZE environment variable.
+const int64_t DEFAULT_BATCH_SIZE = 64 * 1024;
+
+inline int64_t default_batch_size()
+{
+    static const int64_t batch_size = []() {
+        auto env = std::getenv("PVD_BATCH_SIZE");
+        return env ? std::stoll(env) : DEFAULT_BATCH_SIZE;
+    }();
+    return batch_size;
+}
+
+// the batch size of a node, 0 for the default
+inline int64_t batch_size_or_default(int64_t batch_size)
+{
+    return batch_size > 0 ? batch_size : default_batch_size();
+}
+
+// Inputs of at most this many rows are filtered and projected directly with arrow compute
+// kernels instead of an Acero plan, whose fixed setup cost dominates for small tables.
+// Calibrated with pvd_inline_bench, override with the PVD_INLINE_MAX_ROWS environment variable.
+const int64_t DEFAULT_INLINE_MAX_ROWS = 16384;
+
+inline int64_t inline_max_rows()
+{
+    static const int64_t max_rows = []() {
+        auto env = std::getenv("PVD_INLINE_MAX_ROWS");
+        return env ? std::stoll(env) : DEFAULT_INLINE_MAX_ROWS;
+    }();
+    return max_rows;
+}
 
 // Convert a std::vector to an arrow::Array
 // Currently support:
@@ -126,7 +161,7 @@ static std::shared_ptr<arrow::Table> empty_table_from_schema(std::shared_ptr<arr
 
 static ac::Declaration get_test_plan(std::shared_ptr<arrow::Table> table)
 {
-    auto table_source_option = ac::TableSourceNodeOptions{table, MAX_BATCH_SIZE};
+    auto table_source_option = ac::TableSourceNodeOptions{table, default_batch_size()};
     auto filter_option = ac::FilterNodeOptions{
         cp::greater(cp::field_ref("a"), cp::literal(3))};
     auto project_option = ac::ProjectNodeOptions{{cp::field_ref("a"), cp::field_ref("b")}};
@@ -138,6 +173,91 @@ static ac::Declaration get_test_plan(std::shared_ptr<arrow::Table> table)
     return std::move(project_node);
 }
 
+// Evaluate an expression over all the rows of a table (without Acero), allocating from [pool]
+static ar::Datum evaluate_on_table(const cp::Expression& expr, const std::shared_ptr<arrow::Table>& table,
+                                   ar::MemoryPool* pool = ar::default_memory_pool())
+{
+    cp::ExecContext context(pool);
+    auto bound = expr.Bind(*table->schema(), &context).ValueOrDie();
+    auto batch = cp::ExecBatch(*table->CombineChunksToBatch(pool).ValueOrDie());
+    return cp::ExecuteScalarExpression(bound, batch, &context).ValueOrDie();
+}
+
+// The rows of a table where the condition is true (as an Acero filter node)
+static std::shared_ptr<arrow::Table> filter_table(const std::shared_ptr<arrow::Table>& table, const cp::Expression& cond,
+                                                  ar::MemoryPool* pool = ar::default_memory_pool())
+{
+    auto mask = evaluate_on_table(cond, table, pool);
+    if (mask.is_scalar()) {
+        // a condition without column (e.g. a bound literal) keeps all the rows or none, null drops them
+        auto& keep = *mask.scalar();
+        bool all = keep.is_valid && static_cast<const arrow::BooleanScalar&>(keep).value;
+        return all ? table : table->Slice(0, 0);
+    }
+    cp::ExecContext context(pool);
+    return cp::Filter(table, mask, cp::FilterOptions::Defaults(), &context).ValueOrDie().table();
+}
+
+// The projection of a table (as an Acero project node)
+static std::shared_ptr<arrow::Table> project_table(const std::shared_ptr<arrow::Table>& table,
+                                                   const std::vector<cp::Expression>& exprs,
+                                                   const std::vector<std::string>& names,
+                                                   ar::MemoryPool* pool = ar::default_memory_pool())
+{
+    arrow::FieldVector fields;
+    arrow::ArrayVector columns;
+    for (int i = 0; i < exprs.size(); i++) {
+        auto result = evaluate_on_table(exprs[i], table, pool);
+        auto column = result.is_scalar() ? arrow::MakeArrayFromScalar(*result.scalar(), table->num_rows(), pool).ValueOrDie()
+                                         : result.make_array();
+        fields.push_back(arrow::field(names[i], column->type()));
+        columns.push_back(column);
+    }
+    return arrow::Table::Make(arrow::schema(fields), columns, table->num_rows());
+}
+
+// Run an acero plan and collect the result table.
+// If the current execution can be cancelled, the plan is pulled batch by batch and
+// stopped (throwing pvd::Cancelled) as soon as the execution is cancelled.
+// A failing plan (e.g. a source stream interrupted by a cancel) throws instead of aborting.
+// The batches of a source are processed by several threads, with [ordered] the rows of the
+// result are in the order of the source rows (for plans without aggregation).
+// The plan allocates from [pool], the memory pool of the plan node running it.
+static std::shared_ptr<arrow::Table> declaration_to_table(ac::Declaration plan, bool ordered = false,
+                                                          arrow::MemoryPool* pool = arrow::default_memory_pool())
+{
+    ac::QueryOptions options;
+    options.memory_pool = pool;
+    if (ordered) {
+        options.sequence_output = true;
+    }
+    auto check = [](const arrow::Status& status) {
+        if (!status.ok()) {
+            pvd::check_cancelled();
+            throw std::runtime_error(status.ToString());
+        }
+    };
+    if (!pvd::current_cancel_token()) {
+        auto table = ac::DeclarationToTable(std::move(plan), options);
+        check(table.status());
+        return table.MoveValueUnsafe();
+    }
+    auto reader = ac::DeclarationToReader(std::move(plan), options).ValueOrDie();
+    std::vector<std::shared_ptr<arrow::RecordBatch>> batches;
+    while (true) {
+        if (pvd::is_cancelled()) {
+            // stops the exec plan
+            auto _ = reader->Close();
+            throw pvd::Cancelled();
+        }
+        auto batch = reader->Next();
+        check(batch.status());
+        if (!*batch) break;
+        batches.push_back(batch.MoveValueUnsafe());
+    }
+    return arrow::Table::FromRecordBatches(reader->schema(), batches).ValueOrDie();
+}
+
 // write an arrow Table to a buffer stream
 static std::shared_ptr<arrow::Buffer> table_to_buffer(const std::shared_ptr<arrow::Table>& table, const void* msg, int64_t size)
 {
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "data.h"
+#include "binding.h"
+#include "network.h"
+
+namespace pvd
+{
+    class Plan;
+    typedef std::function<void(std::shared_ptr<SerialData> table)> execute_callback_t;
+    typedef std::function<void(Reply reply)> remote_callback_t;
+
+    /*
+     * Shared intermediate results of one batch of executions (Query::ExecuteBatch).
+     *
+     * All nodes of a batch are executed with the same binding. While the batch is the
+     * current batch of the thread, Plan::execute_shared computes every subplan with the
+     * same fingerprint and binding only once, and later requests get the same result.
+     * At the client side, the executions of Network nodes are deferred and sent to the
+     * server together in one ExecuteBatch message by flush().
+     *
+     * A batch is used by one thread at a time (a session strand or the browser thread).
+     */
+    class ExecutionBatch : public std::enable_shared_from_this<ExecutionBatch>
+    {
+        struct Result
+        {
+            bool done = false;
+            std::shared_ptr<SerialData> data;
+            std::vector<execute_callback_t> waiters;
+        };
+
+        // a subplan and the binding it runs with, plans without a fingerprint are only equal to themselves
+        struct Key
+        {
+            uint64_t fingerprint;
+            const Plan* plan;
+            FlatBinding binding;
+
+            bool operator==(const Key& other) const = default;
+        };
+        struct KeyHash
+        {
+            size_t operator()(const Key& key) const;
+        };
+
+        BindingMap binding;
+        FlatBinding flat_binding;
+        std::unordered_map<Key, Result, KeyHash> results;
+        // server node id -> callbacks of the Network nodes waiting for it
+        std::vector<std::pair<int, remote_callback_t>> remote;
+
+    public:
+        explicit ExecutionBatch(BindingMap binding);
+
+        const BindingMap& get_binding() const { return binding; }
+        /*
+         * execute the plan unless the same subplan has been executed in this batch
+         */
+        void execute(Plan* plan, const BindingMap& binding, execute_callback_t cb);
+        /*
+         * defer a server execution of [node_id] with the batch binding until flush()
+         * return false if the binding is not the batch binding (the caller sends it alone)
+         */
+        bool defer_remote(int node_id, const BindingMap& binding, remote_callback_t cb);
+        /*
+         * send all deferred server executions in one ExecuteBatch message
+         */
+        void flush();
+
+        // the batch of the executions running on the current thread, nullptr if none
+        static std::shared_ptr<ExecutionBatch> current();
+    };
+
+    /*
+     * Sets the current batch of the thread for the lifetime of the scope
+     */
+    class BatchScope
+    {
+        std::shared_ptr<ExecutionBatch> previous;
+    public:
+        explicit BatchScope(std::shared_ptr<ExecutionBatch> batch);
+        ~BatchScope();
+    };
+
+    /*
+     * ExecuteBatch content:  {"nodes": [node ids], "binding": {binding json}}
+     * ExecuteBatch reply:    [int32 num results] { [int32 node id] [int64 size] [serialized result] } ...
+     */
+    std::string batch_request_to_string(const std::vector<int>& nodes, const BindingMap& binding);
+    void parse_batch_request(const std::string& content, std::vector<int>& nodes, BindingMap& binding);
+    /*
+     * split a ExecuteBatch reply into the replies of each node
+     */
+    std::vector<std::pair<int, Reply>> split_batch_reply(Reply reply);
+}
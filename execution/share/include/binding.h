@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <map>
 #include <vector>
 #include <variant>
@@ -28,7 +29,7 @@ public:
     Binding(float value) : kind(Kind::Float), _value(value) {}
     Binding(bool value) : kind(Kind::Bool), _value(value) {}
     Binding(const std::string& value) : kind(Kind::String), _value(value) {}
-    Binding(const std::vector<BindingMap> &value) : kind(Kind::String), _value(value) {}
+    Binding(const std::vector<BindingMap> &value) : kind(Kind::Multi), _value(value) {}
 
     // identify binding type
     // for AnyNode
@@ -63,8 +64,56 @@ public:
     bool operator==(const Binding& another) const;
 };
 
+/*
+ * A BindingMap flattened for the cache lookups: the choice ids are interned to small integers,
+ * the values are in one vector (in the order of the map, sorted by choice id) and the strings in
+ * one buffer. Hashing is one pass over the values and equality a linear compare, without an
+ * allocation per value. The hash and the interned ids are only valid in this process.
+ */
+class FlatBinding
+{
+public:
+    struct Value
+    {
+        // interned choice id, END closes the sub binding of a Multi
+        uint32_t id;
+        Binding::Kind kind;
+        // the int, the bits of the float, the bool, [offset, length] of the string in strings,
+        // or the number of sub bindings (which follow, each closed by END)
+        uint64_t bits;
+
+        bool operator==(const Value& other) const = default;
+    };
+    static constexpr uint32_t END = UINT32_MAX;
+
+    FlatBinding() = default;
+    explicit FlatBinding(const BindingMap& binding);
+
+    uint64_t hash() const { return _hash; }
+    // number of values (with the sub bindings)
+    size_t size() const { return values.size(); }
+    bool operator==(const FlatBinding& other) const;
+    bool operator!=(const FlatBinding& other) const { return !(*this == other); }
+
+    // the small integer of a choice id, the same for the life of the process
+    static uint32_t intern(const std::string& choice_id);
+
+private:
+    std::vector<Value> values;
+    std::string strings;
+    uint64_t _hash = 0;
+
+    void append(const BindingMap& binding);
+};
+
+struct FlatBindingHash
+{
+    size_t operator()(const FlatBinding& binding) const { return binding.hash(); }
+};
+
 void binding_to_json(const BindingMap& binding, json& binding_json);
 BindingMap parse_json_binding(const json& binding);
+// FlatBinding(binding).hash()
 uint64_t hash_binding(const BindingMap& binding);
 
 }
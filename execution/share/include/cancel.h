@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace pvd
+{
+    /*
+     * Thrown by an operator that stops because its execution was cancelled
+     */
+    struct Cancelled : public std::runtime_error
+    {
+        Cancelled() : std::runtime_error("execution cancelled") {}
+    };
+
+    /*
+     * Cancellation flag of one execution request.
+     * Operators that block for a long time (cloud queries) register a callback
+     * to be interrupted when the token is cancelled from another thread.
+     */
+    class CancelToken
+    {
+        std::atomic<bool> cancelled;
+        std::mutex mutex;
+        int next_callback_id;
+        std::vector<std::pair<int, std::function<void()>>> callbacks;
+
+    public:
+        CancelToken() : cancelled(false), next_callback_id(0) {}
+
+        void cancel();
+        bool is_cancelled() const;
+        /*
+         * register a callback invoked on cancel (immediately if already cancelled),
+         * return an id to unregister it
+         */
+        int on_cancel(std::function<void()> callback);
+        void remove_callback(int id);
+    };
+
+    /*
+     * Sets the token of the execution running on the current thread for the lifetime of the scope.
+     * Operators read it with current_cancel_token() / check_cancelled().
+     */
+    class CancelScope
+    {
+        std::shared_ptr<CancelToken> previous;
+    public:
+        explicit CancelScope(std::shared_ptr<CancelToken> token);
+        ~CancelScope();
+    };
+
+    // nullptr if the current execution cannot be cancelled
+    std::shared_ptr<CancelToken> current_cancel_token();
+    bool is_cancelled();
+    // throw Cancelled if the current execution has been cancelled
+    void check_cancelled();
+}
@@ -1,5 +1,10 @@
 #pragma once
+#include <algorithm>
+#include <cctype>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
 #include <arrow/api.h>
 #include <arrow/io/api.h>
 
@@ -9,6 +14,82 @@ namespace pvd {
     class CloudApi {
     public:
         virtual void query(std::string sql, std::function<void(std::shared_ptr<arrow::Table>)> cb) = 0;
+        /*
+         * run the query and read the result as a stream of record batches
+         * (by default the result is materialized by query() first)
+         */
+        virtual void query_stream(std::string sql, std::function<void(std::shared_ptr<arrow::RecordBatchReader>)> cb)
+        {
+            query(std::move(sql), [cb](std::shared_ptr<arrow::Table> table) {
+                cb(std::make_shared<arrow::TableBatchReader>(table));
+            });
+        }
+        /*
+         * run a query with parameters $1, $2, ... (params[0], params[1], ...)
+         * (by default the parameters are inlined in the SQL)
+         */
+        virtual void query_stream(std::string sql, std::vector<std::shared_ptr<arrow::Scalar>> params,
+                                  std::function<void(std::shared_ptr<arrow::RecordBatchReader>)> cb)
+        {
+            query_stream(inline_params(sql, params), std::move(cb));
+        }
+
+        /*
+         * replace the parameters $1, $2, ... outside of the quoted strings and identifiers by the SQL
+         * literals of params, in one pass (a value containing "$1" is not substituted again)
+         */
+        static std::string inline_params(const std::string& sql, const std::vector<std::shared_ptr<arrow::Scalar>>& params)
+        {
+            std::string inlined;
+            inlined.reserve(sql.size());
+            // the quote of the string or identifier being read, 0 outside ('' inside a string closes and reopens it)
+            char quote = 0;
+            for (size_t i = 0; i < sql.size(); ) {
+                char c = sql[i];
+                if (quote == 0 && c == '$' && i + 1 < sql.size() && std::isdigit(static_cast<unsigned char>(sql[i + 1]))) {
+                    size_t end = i + 1;
+                    size_t n = 0;
+                    while (end < sql.size() && std::isdigit(static_cast<unsigned char>(sql[end]))) {
+                        n = std::min<size_t>(n * 10 + (sql[end] - '0'), params.size() + 1);
+                        end++;
+                    }
+                    if (n == 0 || n > params.size()) {
+                        throw std::runtime_error("No value for parameter " + sql.substr(i, end - i));
+                    }
+                    inlined += param_sql(*params[n - 1]);
+                    i = end;
+                    continue;
+                }
+                if (quote == 0 && (c == '\'' || c == '"')) {
+                    quote = c;
+                }
+                else if (c == quote) {
+                    quote = 0;
+                }
+                inlined += c;
+                i++;
+            }
+            return inlined;
+        }
+
+        // the SQL literal of a parameter
+        static std::string param_sql(const arrow::Scalar& param)
+        {
+            if (param.type->id() == arrow::Type::STRING && param.is_valid) {
+                return quote_sql_string(static_cast<const arrow::StringScalar&>(param).value->ToString());
+            }
+            return param.ToString();
+        }
+
+        static std::string quote_sql_string(const std::string& value)
+        {
+            std::string quoted = "'";
+            for (char c : value) {
+                if (c == '\'') quoted += '\'';
+                quoted += c;
+            }
+            return quoted + "'";
+        }
     };
 
     extern CloudApi* cloud;
@@ -13,6 +13,7 @@
 #include <arrow/compute/api.h>
 #include <arrow/compute/api_vector.h>
 #include "metrics.h"
+#include "memory_accounting.h"
 
 namespace ar = arrow;
 namespace cp = arrow::compute;
@@ -27,6 +28,11 @@ namespace pvd {
         virtual void deserialize(std::shared_ptr<ar::io::BufferReader> buffer) = 0;
 
         virtual uint64_t size() = 0;
+        /*
+         * the bytes of memory kept alive by the data, without the buffers in [counted]
+         * (the memory shared with data counted before)
+         */
+        virtual uint64_t retained_size(BufferSet& counted) { return size(); }
     };
 
     // A wrapper of arrow::Table
@@ -53,5 +59,34 @@ namespace pvd {
         std::shared_ptr<TableData> select_rows(const std::vector<int64_t> &indices);
 
         uint64_t size() override;
+        uint64_t retained_size(BufferSet& counted) override;
     };
+
+    // A stream of record batches that can be read once, e.g. the result of a cloud query being scanned
+    struct StreamData : public SerialData {
+        std::shared_ptr<ar::RecordBatchReader> reader;
+
+        StreamData(std::shared_ptr<ar::RecordBatchReader> reader) : reader(std::move(reader)) {}
+
+        // write the batches while reading them from the stream
+        void serialize(std::shared_ptr<ar::io::BufferOutputStream> out) override;
+        // a stream is never sent to the server, the client receives a TableData
+        void deserialize(std::shared_ptr<ar::io::BufferReader> buffer) override;
+        // unknown before the stream is read
+        uint64_t size() override;
+        // read the rest of the stream into a table
+        std::shared_ptr<TableData> to_table();
+    };
+
+    /*
+     * Data that is kept (caches) or used several times must be materialized,
+     * a stream is read into a table, other data is returned as is
+     */
+    std::shared_ptr<SerialData> materialize(std::shared_ptr<SerialData> data);
+    std::shared_ptr<TableData> materialize_table(std::shared_ptr<SerialData> data);
+    /*
+     * the acero source node reading a table (in batches of [batch_size] rows, 0 for the default)
+     * or a stream, the table is recorded as the input of [metrics] (nullptr for a stream)
+     */
+    ac::Declaration source_declaration(std::shared_ptr<SerialData> data, Metrics& metrics, int64_t batch_size = 0);
 }
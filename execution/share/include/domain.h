@@ -0,0 +1,54 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <arrow/api.h>
+
+namespace pvd
+{
+    /*
+     * The domains of the columns used by VAL choice nodes: domain(table.column).
+     *
+     * Each domain is queried from the cloud once and kept as a sorted array of distinct
+     * values, shared by all the choice nodes and SCaches that enumerate it. The domains
+     * of several columns of a table are fetched together by one scan of the table.
+     *
+     * With a persistence file, the catalog is loaded from it and every newly fetched
+     * domain is written back, so a restarted server does not query the domains again
+     * (delete the file when the data changes).
+     */
+    class DomainCatalog
+    {
+        std::mutex mutex;
+        // "table.column" -> domain
+        std::unordered_map<std::string, std::shared_ptr<arrow::Array>> domains;
+        // one fetch at a time, so a domain is never queried twice
+        std::mutex fetch_mutex;
+        std::string persist_path;
+
+        std::shared_ptr<arrow::Array> find(const std::string& key);
+        void fetch(const std::string& table, const std::vector<std::string>& columns);
+        void save();
+
+    public:
+        /*
+         * the sorted distinct values of table.column
+         */
+        std::shared_ptr<arrow::Array> get(const std::string& table, const std::string& column);
+        /*
+         * fetch the missing domains of several columns, one query per table
+         */
+        void prefetch(const std::map<std::string, std::vector<std::string>>& columns_by_table);
+        /*
+         * load the domains saved in [path] (if it exists) and save new domains to it
+         */
+        void persist(const std::string& path);
+        void clear();
+
+        static DomainCatalog& instance();
+    };
+}
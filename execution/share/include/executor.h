@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pvd
+{
+    typedef std::function<void()> task_t;
+
+    /*
+     * A work-stealing thread pool.
+     * Each worker owns a deque of tasks: it pops its own tasks from the back (LIFO),
+     * and steals from the front of the other workers' deques (FIFO) when it runs out of work.
+     * Tasks submitted from outside the pool are distributed round-robin.
+     */
+    class Executor
+    {
+        struct Worker
+        {
+            std::deque<task_t> tasks;
+            std::mutex mutex;
+        };
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::vector<std::thread> threads;
+        std::atomic<size_t> next_worker;
+        std::atomic<int64_t> num_pending;
+        std::mutex sleep_mutex;
+        std::condition_variable sleep_cv;
+        bool stopping;
+
+        bool pop_task(size_t self, task_t& task);
+        void run(size_t self);
+
+    public:
+        explicit Executor(size_t num_threads);
+        ~Executor();
+
+        void submit(task_t task);
+        size_t num_threads() const;
+        // the executor of the calling worker thread, nullptr outside the pool
+        static Executor* current();
+    };
+
+    /*
+     * Runs the posted tasks one at a time and in order on an Executor.
+     * Tasks of different strands run in parallel.
+     */
+    class Strand : public std::enable_shared_from_this<Strand>
+    {
+        Executor* executor;
+        std::deque<task_t> tasks;
+        std::mutex mutex;
+        bool running;
+
+        void run_next();
+
+    public:
+        explicit Strand(Executor* executor) : executor(executor), running(false) {}
+        void post(task_t task);
+        // the strand of the running task, nullptr outside the tasks of a strand
+        static std::shared_ptr<Strand> current();
+    };
+
+    /*
+     * Where the calling code runs, to continue there when a callback arrives from another thread:
+     * on its strand, else on its executor, else (outside the pool) inline on the calling thread.
+     */
+    class Continuation
+    {
+        std::shared_ptr<Strand> strand;
+        Executor* executor = nullptr;
+
+    public:
+        static Continuation here();
+        void resume(task_t task) const;
+    };
+}
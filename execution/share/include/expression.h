@@ -4,6 +4,8 @@
 #include <vector>
 #include <variant>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 
 #include <arrow/compute/expression.h>
 
@@ -27,6 +29,13 @@ public:
     virtual void pick_useful_binding(const BindingMap& binding, BindingMap& useful_binding) = 0;
     virtual void get_all_choice_nodes(std::unordered_map<std::string, std::shared_ptr<ChoiceExpr>> &choice_nodes) = 0;
     virtual std::string to_string() const = 0;
+    /*
+     * bind the expression like bind(), but the values bound to choice nodes become query
+     * parameters ($1, $2, ...) appended to [params], so the SQL of the result does not
+     * change with the binding (by default the expression is bound as is)
+     */
+    virtual std::shared_ptr<Expression> bind_params(const BindingMap& binding,
+                                                    std::vector<std::shared_ptr<arrow::Scalar>>& params) const;
 
     /*
      * 1. bind the expression with the binding
@@ -120,6 +129,27 @@ public:
     std::string to_string() const override;
 };
 
+/*
+ * A query parameter: $[index] in SQL, the bound value elsewhere
+ */
+class Param : public Literal
+{
+public:
+    int index;
+    std::shared_ptr<arrow::Scalar> value;
+    // the choice node the value is bound to
+    std::string choice_id;
+
+    Param(int index, std::shared_ptr<arrow::Scalar> value, std::string choice_id);
+    void get_all_choice_nodes(std::unordered_map<std::string, std::shared_ptr<ChoiceExpr>> &choice_nodes) override;
+    std::shared_ptr<Expression> bind(const BindingMap& binding) const override;
+    std::shared_ptr<Expression> evaluate(const BindingMap& binding) const override;
+    std::shared_ptr<arrow::Scalar> to_arrow_scalar() const override;
+    void pick_useful_binding(const BindingMap& binding, BindingMap& useful_binding) override;
+    cp::Expression to_arrow_expr() const override;
+    std::string to_string() const override;
+};
+
 /*
  * Expression Operations
  */
@@ -136,6 +166,8 @@ public:
     Op(Operator op, std::initializer_list<std::shared_ptr<Expression>> operands);
     void get_all_choice_nodes(std::unordered_map<std::string, std::shared_ptr<ChoiceExpr>> &choice_nodes) override;
     std::shared_ptr<Expression> bind(const BindingMap& binding) const override;
+    std::shared_ptr<Expression> bind_params(const BindingMap& binding,
+                                            std::vector<std::shared_ptr<arrow::Scalar>>& params) const override;
     std::shared_ptr<Expression> evaluate(const BindingMap& binding) const override;
     void pick_useful_binding(const BindingMap& binding, BindingMap& useful_binding) override;
     cp::Expression to_arrow_expr() const override;
@@ -152,6 +184,8 @@ public:
     Func(const std::string& fname, std::initializer_list<std::shared_ptr<Expression>> operands);
     void get_all_choice_nodes(std::unordered_map<std::string, std::shared_ptr<ChoiceExpr>> &choice_nodes) override;
     std::shared_ptr<Expression> bind(const BindingMap& binding) const override;
+    std::shared_ptr<Expression> bind_params(const BindingMap& binding,
+                                            std::vector<std::shared_ptr<arrow::Scalar>>& params) const override;
     std::shared_ptr<Expression> evaluate(const BindingMap& binding) const override;
     void pick_useful_binding(const BindingMap& binding, BindingMap& useful_binding) override;
     cp::Expression to_arrow_expr() const override;
@@ -181,6 +215,8 @@ public:
 
     void get_all_choice_nodes(std::unordered_map<std::string, std::shared_ptr<ChoiceExpr>> &choice_nodes) override;
     std::shared_ptr<Expression> bind(const BindingMap& binding) const override;
+    std::shared_ptr<Expression> bind_params(const BindingMap& binding,
+                                            std::vector<std::shared_ptr<arrow::Scalar>>& params) const override;
     std::shared_ptr<Expression> evaluate(const BindingMap& binding) const override;
     void pick_useful_binding(const BindingMap& binding, BindingMap& useful_binding) override;
     cp::Expression to_arrow_expr() const override;
@@ -209,6 +245,8 @@ public:
     std::string choice_id() const override;
     void get_all_choice_nodes(std::unordered_map<std::string, std::shared_ptr<ChoiceExpr>> &choice_nodes) override;
     std::shared_ptr<Expression> bind(const BindingMap& binding) const override;
+    std::shared_ptr<Expression> bind_params(const BindingMap& binding,
+                                            std::vector<std::shared_ptr<arrow::Scalar>>& params) const override;
     std::vector<Binding> all_choices() override;
     std::shared_ptr<Expression> evaluate(const BindingMap& binding) const override;
     void pick_useful_binding(const BindingMap& binding, BindingMap& useful_binding) override;
@@ -223,10 +261,14 @@ public:
     std::shared_ptr<Expression> domain;
 
     ValExpr(std::string  id, std::shared_ptr<Expression> domain);
+    // the column of domain(table.column), its values are the choices (from the DomainCatalog)
+    std::shared_ptr<ColumnRef> domain_column() const;
     std::string choice_id() const override;
     void get_all_choice_nodes(std::unordered_map<std::string, std::shared_ptr<ChoiceExpr>> &choice_nodes) override;
     std::vector<Binding> all_choices() override;
     std::shared_ptr<Expression> bind(const BindingMap& binding) const override;
+    std::shared_ptr<Expression> bind_params(const BindingMap& binding,
+                                            std::vector<std::shared_ptr<arrow::Scalar>>& params) const override;
     std::shared_ptr<Expression> evaluate(const BindingMap& binding) const override;
     void pick_useful_binding(const BindingMap& binding, BindingMap& useful_binding) override;
     cp::Expression to_arrow_expr() const override;
@@ -257,6 +299,65 @@ public:
     std::string to_string() const override;
 };
 
+/*
+ * An expression compiled for the executions of a plan node.
+ *
+ * The arrow expression of a binding is built from a template compiled once per
+ * structure of the expression (the choices of the AnyExpr among expressions and of
+ * the MultiExpr). The values bound to the ValExpr and to the AnyExpr among constants
+ * are parameters of the template, an execution only puts the bound scalars in their
+ * places and reuses the subtrees without parameters, instead of binding a copy of
+ * the expression tree and converting it.
+ */
+class CompiledExpr
+{
+public:
+    explicit CompiledExpr(std::shared_ptr<Expression> expr);
+
+    // same as expr->to_arrow_expr(binding)
+    cp::Expression to_arrow_expr(const BindingMap& binding);
+
+private:
+    struct Node
+    {
+        // the arrow expression of a subtree without parameters
+        cp::Expression constant;
+        // >= 0 for a parameter
+        int param = -1;
+        std::string function;
+        std::shared_ptr<cp::FunctionOptions> options;
+        std::vector<Node> arguments;
+    };
+
+    struct Slot
+    {
+        std::string choice_id;
+        // the scalars of the choices of an AnyExpr, empty for a ValExpr
+        std::vector<std::shared_ptr<arrow::Scalar>> choices;
+    };
+
+    struct Template
+    {
+        Node root;
+        std::vector<Slot> slots;
+    };
+
+    std::shared_ptr<Expression> expr;
+    // false if the expression can not be compiled (it has MultiExpr), it is bound for every execution
+    bool compilable = true;
+    // the choice nodes that change the structure of the expression
+    std::vector<std::string> structural_ids;
+    // AnyExpr id -> scalars of its constant choices
+    std::unordered_map<std::string, std::vector<std::shared_ptr<arrow::Scalar>>> any_choices;
+    std::mutex mutex;
+    // binding of the structural choices -> template
+    std::unordered_map<FlatBinding, std::shared_ptr<Template>, FlatBindingHash> templates;
+
+    std::shared_ptr<Template> compile(const BindingMap& binding);
+    static Node compile_node(const cp::Expression& arrow_expr, const std::vector<std::shared_ptr<arrow::Scalar>>& params);
+    static cp::Expression instantiate(const Node& node, const std::vector<std::shared_ptr<arrow::Scalar>>& scalars);
+};
+
 std::shared_ptr<Expression> parse_json_expression(const json& expr);
 
 }
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include <arrow/api.h>
+#include <arrow/memory_pool.h>
+
+namespace pvd
+{
+    /*
+     * Memory pools tracking the live and peak bytes allocated by each plan node.
+     *
+     * The Acero plans of a node allocate from its pool, so the bytes still allocated are
+     * held by the outputs of the node (e.g. the results kept by a cache above it) and the
+     * peak is the largest working set of its executions. Each plan node has its own pool
+     * (node ids are only unique in a plan, so the sessions and the client never share one),
+     * the stats of a session report the pools of its nodes. Pools are never freed, the
+     * buffers allocated from a pool may outlive the plan node and free their memory through it:
+     * the pool of a destroyed node is recycled for a new node once all its buffers are freed.
+     */
+    class MemoryAccounting
+    {
+    public:
+        // forwards the allocations to the default pool, counting the live and peak bytes
+        class NodePool : public arrow::MemoryPool
+        {
+            std::atomic<int64_t> live{0};
+            std::atomic<int64_t> peak{0};
+            std::atomic<int64_t> total{0};
+            std::atomic<int64_t> allocations{0};
+
+            void allocated(int64_t bytes);
+
+        public:
+            using arrow::MemoryPool::Allocate;
+            using arrow::MemoryPool::Reallocate;
+            using arrow::MemoryPool::Free;
+
+            arrow::Status Allocate(int64_t size, int64_t alignment, uint8_t** out) override;
+            arrow::Status Reallocate(int64_t old_size, int64_t new_size, int64_t alignment, uint8_t** ptr) override;
+            void Free(uint8_t* buffer, int64_t size, int64_t alignment) override;
+            int64_t bytes_allocated() const override { return live.load(std::memory_order_relaxed); }
+            int64_t max_memory() const override { return peak.load(std::memory_order_relaxed); }
+            int64_t total_bytes_allocated() const override { return total.load(std::memory_order_relaxed); }
+            int64_t num_allocations() const override { return allocations.load(std::memory_order_relaxed); }
+            std::string backend_name() const override { return arrow::default_memory_pool()->backend_name(); }
+            // forget the counts of the previous node
+            void reset();
+        };
+
+        static MemoryAccounting& instance();
+        // a pool for a new plan node
+        arrow::MemoryPool* acquire();
+        // the node of the pool is destroyed
+        void release(arrow::MemoryPool* pool);
+
+    private:
+        std::mutex mutex;
+        std::vector<std::unique_ptr<NodePool>> pools;
+        // the pools of destroyed nodes, some of their buffers may still be alive
+        std::vector<NodePool*> released;
+    };
+
+    // the buffers already counted by retained_bytes
+    typedef std::unordered_set<const arrow::Buffer*> BufferSet;
+
+    /*
+     * The bytes of memory kept alive by the table: a buffer shared by several arrays or
+     * slices is counted once, and a slice of a buffer counts its whole parent buffer
+     * (e.g. a table deserialized from a reply keeps the whole reply alive).
+     */
+    uint64_t retained_bytes(const arrow::Table& table, BufferSet& counted);
+
+    // the resident set size of the process, current and peak (0 if unknown)
+    int64_t current_rss_bytes();
+    int64_t peak_rss_bytes();
+}
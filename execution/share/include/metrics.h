@@ -2,14 +2,21 @@
 
 #include <iostream>
 #include <fstream>
+#include <cstring>
 #include <string>
 #include <chrono>
+#include <mutex>
 #include <unistd.h>
+#include <arrow/api.h>
 #include <network.h>
 
+#include "trace.h"
+
 namespace pvd
 {
     extern std::ofstream log_file;
+    // the server logs from several threads
+    inline std::mutex log_mutex;
 
     static void logging(std::string message) {
         if (SENDER) {
@@ -18,27 +25,38 @@ namespace pvd
             SENDER->send(query, (void*)message.c_str(), [](Reply _) {});
         }
         else {
+            std::lock_guard<std::mutex> lock(log_mutex);
             log_file << message << std::endl;
             log_file.flush();
         }
     }
 
+    /*
+     * The metrics of the execution of a plan node, recorded as an operator span of the trace
+     */
     struct Metrics
     {
         int id;
         std::string node;
-        uint64_t input_time;
-        uint64_t input_num_rows;
-        uint64_t input_num_cols;
-        uint64_t output_time;
-        uint64_t output_num_rows;
-        uint64_t output_num_cols;
-        uint64_t build_size;
+        // monotonic nanoseconds
+        uint64_t input_time = 0;
+        uint64_t input_num_rows = 0;
+        uint64_t input_num_cols = 0;
+        uint64_t output_time = 0;
+        uint64_t output_num_rows = 0;
+        uint64_t output_num_cols = 0;
+        uint64_t build_size = 0;
+        // time to build the plan of the node before it runs (microseconds)
+        uint64_t plan_time_us = 0;
 
         Metrics() {}
 
+        static uint64_t get_time_us() {
+            return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
         static uint64_t get_time() {
-            return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            return trace_now_ns();
         }
 
         void record_input(std::shared_ptr<arrow::Table> table, uint64_t _num_rows = 0, uint64_t _num_cols = 0) {
@@ -64,25 +82,35 @@ namespace pvd
                 output_num_rows = _num_rows;
                 output_num_cols = _num_cols;
             }
-            logging(to_json());
+            Tracer::instance().record(to_event());
+        }
+
+        // the span of the execution of the node and its inputs, started at [start_ns]
+        void record_execute(uint64_t start_ns) const {
+            auto event = make_event(TraceEvent::Execute);
+            event.start_ns = start_ns;
+            event.duration_ns = get_time() - start_ns;
+            Tracer::instance().record(event);
+        }
+
+        TraceEvent make_event(TraceEvent::Kind kind) const {
+            TraceEvent event{};
+            event.kind = kind;
+            std::strncpy(event.name, node.empty() ? "Plan" : node.c_str(), sizeof(event.name) - 1);
+            event.node_id = id;
+            return event;
         }
 
-        std::string to_json() {
-            std::string loc;
-            if (SENDER) loc = "client";
-            else loc = "server";
-            return std::string("{") +\
-            "\"id\": \"" + std::to_string(id) + "\"," +\
-            "\"node\": \"" + node + "\"," +\
-            "\"location\": \"" + loc + "\"," +\
-            "\"input_num_rows\": " + std::to_string(input_num_rows) + "," +\
-            "\"input_num_cols\": " + std::to_string(input_num_cols) + "," +\
-            "\"output_num_rows\": " + std::to_string(output_num_rows) + "," +\
-            "\"output_num_cols\": " + std::to_string(output_num_cols) + "," +\
-            "\"input_time\": " + std::to_string(input_time) + "," +\
-            "\"output_time\": " + std::to_string(output_time) + "," +\
-            "\"exec_time\": " + std::to_string(output_time - input_time) + "," +\
-            "\"build_size\": " + std::to_string(build_size) + "}";
+        TraceEvent to_event() const {
+            auto event = make_event(TraceEvent::Operator);
+            // an operator without input (e.g. a table source) starts at its output
+            event.start_ns = input_time > 0 ? input_time : output_time;
+            event.duration_ns = output_time - event.start_ns;
+            event.plan_ns = plan_time_us * 1000;
+            event.input_rows = input_num_rows;
+            event.output_rows = output_num_rows;
+            event.build_size = build_size;
+            return event;
         }
     };
 }
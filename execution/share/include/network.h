@@ -1,31 +1,247 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <semaphore>
+#include <stdexcept>
+#include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace pvd
 {
     struct Query
     {
-        enum Message { Init, Execute, Log };
+        // Stats: admin query of the memory of the server (reply: JSON)
+        enum Message { Init, Execute, Log, ExecuteBatch, Stats };
         Message msg;
         int32_t node_id;
         int64_t data_size;
+        // the view (client root node) executing the query, -1 outside of the execution of a view
+        int32_t view = -1;
     };
 
     struct Reply
     {
+        // a query without a reply from the server is still called back, with an empty reply
+        enum Status { Ok, Cancelled, TimedOut };
+
         const int64_t size;
         void *const data;
+        const Status status = Ok;
+
+        static Reply failed(Status status) { return Reply{0, nullptr, status}; }
+        bool ok() const { return status == Ok; }
+        const char* status_name() const { return status == Ok ? "ok" : status == Cancelled ? "cancelled" : "timed out"; }
         void free() {
-            delete[] ((char*)(data) - sizeof(int32_t));
+            if (data) delete[] ((char*)(data) - sizeof(int32_t));
         }
     };
 
     typedef std::function<void(Reply reply)> query_callback_t;
 
+    /*
+     * Callbacks of the queries waiting for a reply, indexed by query id.
+     * A query id is [generation (15 bits) | slot (16 bits)]. The slot is recycled once the
+     * query completes, times out or is dropped, and the generation makes sure a late reply of
+     * a released query never reaches the next query using the same slot.
+     */
+    class PendingRequests
+    {
+        typedef std::chrono::steady_clock clock;
+        static constexpr int32_t SLOT_BITS = 16;
+        static constexpr int32_t SLOT_MASK = (1 << SLOT_BITS) - 1;
+
+        struct Slot
+        {
+            query_callback_t cb;
+            clock::time_point deadline;
+            int32_t generation = 0;
+            bool busy = false;
+        };
+        std::vector<Slot> slots;
+        std::vector<int32_t> free_slots;
+        size_t in_flight = 0;
+
+        int32_t to_id(int32_t slot) const { return (slots[slot].generation << SLOT_BITS) | slot; }
+
+        void release(int32_t slot)
+        {
+            auto& s = slots[slot];
+            s.cb = nullptr;
+            s.busy = false;
+            s.generation = (s.generation + 1) & 0x7FFF;
+            free_slots.push_back(slot);
+            in_flight--;
+        }
+
+        // the slot of a query id, -1 if the query is no longer pending
+        int32_t find(int32_t id) const
+        {
+            int32_t slot = id & SLOT_MASK;
+            if (id < 0 || slot >= (int32_t)slots.size() || !slots[slot].busy || slots[slot].generation != (id >> SLOT_BITS)) {
+                return -1;
+            }
+            return slot;
+        }
+
+    public:
+        /*
+         * register the callback of a new query and return its id
+         * timeout 0 means the query never times out
+         */
+        int32_t add(query_callback_t cb, std::chrono::milliseconds timeout = std::chrono::milliseconds(0))
+        {
+            int32_t slot;
+            if (!free_slots.empty()) {
+                slot = free_slots.back();
+                free_slots.pop_back();
+            }
+            else {
+                if (slots.size() > SLOT_MASK) {
+                    throw std::runtime_error("Too many queries in flight");
+                }
+                slot = static_cast<int32_t>(slots.size());
+                slots.emplace_back();
+            }
+            auto& s = slots[slot];
+            s.cb = std::move(cb);
+            s.deadline = timeout.count() > 0 ? clock::now() + timeout : clock::time_point::max();
+            s.busy = true;
+            in_flight++;
+            return to_id(slot);
+        }
+
+        /*
+         * remove the query and return its callback
+         * return an empty callback if the query has completed, timed out or been dropped
+         */
+        query_callback_t take(int32_t id)
+        {
+            int32_t slot = find(id);
+            if (slot < 0) {
+                return nullptr;
+            }
+            auto cb = std::move(slots[slot].cb);
+            release(slot);
+            return cb;
+        }
+
+        // forget the query, its reply will be ignored
+        void drop(int32_t id)
+        {
+            int32_t slot = find(id);
+            if (slot >= 0) {
+                release(slot);
+            }
+        }
+
+        /*
+         * remove the queries whose deadline has passed and return their ids and callbacks
+         */
+        std::vector<std::pair<int32_t, query_callback_t>> expire(clock::time_point now = clock::now())
+        {
+            std::vector<std::pair<int32_t, query_callback_t>> expired;
+            if (in_flight == 0) {
+                return expired;
+            }
+            for (int32_t slot = 0; slot < (int32_t)slots.size(); slot++) {
+                if (slots[slot].busy && slots[slot].deadline <= now) {
+                    expired.emplace_back(to_id(slot), std::move(slots[slot].cb));
+                    release(slot);
+                }
+            }
+            return expired;
+        }
+
+        // the earliest deadline of the pending queries, time_point::max() if none can time out
+        clock::time_point next_deadline() const
+        {
+            auto deadline = clock::time_point::max();
+            if (in_flight == 0) {
+                return deadline;
+            }
+            for (auto& slot : slots) {
+                if (slot.busy) {
+                    deadline = std::min(deadline, slot.deadline);
+                }
+            }
+            return deadline;
+        }
+
+        // number of queries waiting for a reply
+        size_t size() const { return in_flight; }
+    };
+
+    /*
+     * An execution of a view (a root node) by the client. The queries sent during the execution
+     * carry the view, and their replies run in its scope again. A new execution of the view
+     * supersedes its queries still in flight: they are called back with a Cancelled reply, which
+     * aborts the execution instead of delivering a result.
+     */
+    class ViewExecution
+    {
+        bool finished = false;
+        std::function<void(const std::string& reason)> on_abort;
+
+        static std::shared_ptr<ViewExecution>& current_ref()
+        {
+            static thread_local std::shared_ptr<ViewExecution> current;
+            return current;
+        }
+
+    public:
+        const int32_t view;
+
+        ViewExecution(int32_t view, std::function<void(const std::string& reason)> on_abort)
+                : on_abort(std::move(on_abort)), view(view) {}
+
+        // false if the execution has already finished or been aborted
+        bool finish()
+        {
+            return !std::exchange(finished, true);
+        }
+
+        bool is_finished() const { return finished; }
+
+        void abort(const std::string& reason)
+        {
+            if (finish() && on_abort) {
+                on_abort(reason);
+            }
+        }
+
+        // the execution running on this thread, nullptr if none
+        static std::shared_ptr<ViewExecution> current() { return current_ref(); }
+        static int32_t current_view() { return current_ref() ? current_ref()->view : -1; }
+
+        // abort the current execution with the status of a failed reply
+        static void abort_current(const Reply& reply)
+        {
+            if (auto execution = current()) {
+                execution->abort(reply.status_name());
+            }
+        }
+
+        friend class ViewScope;
+    };
+
+    class ViewScope
+    {
+        std::shared_ptr<ViewExecution> previous;
+
+    public:
+        explicit ViewScope(std::shared_ptr<ViewExecution> execution)
+                : previous(std::exchange(ViewExecution::current_ref(), std::move(execution))) {}
+        ~ViewScope() { ViewExecution::current_ref() = std::move(previous); }
+        ViewScope(const ViewScope&) = delete;
+        ViewScope& operator=(const ViewScope&) = delete;
+    };
+
     class QuerySender
     {
     public:
@@ -33,5 +249,9 @@ namespace pvd
         virtual void receive(void* reply, int64_t size) = 0;
     };
 
-    extern QuerySender* SENDER;
+    /*
+     * the sender of the client, nullptr on the server (and on the server threads of pvd_replay,
+     * which runs the client and the server in one process)
+     */
+    extern thread_local QuerySender* SENDER;
 }
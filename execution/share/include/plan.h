@@ -2,9 +2,12 @@
 
 #include <iostream>
 #include <vector>
+#include <list>
 #include <memory>
 #include <variant>
 #include <map>
+#include <mutex>
+#include <atomic>
 #include <arrow/api.h>
 #include <arrow/io/api.h>
 #include <arrow/ipc/api.h>
@@ -21,6 +24,9 @@
 #include "arrow_utils.h"
 #include "rtree.h"
 #include "metrics.h"
+#include "batch.h"
+#include "task.h"
+#include "executor.h"
 
 namespace ar = arrow;
 namespace cp = arrow::compute;
@@ -29,9 +35,46 @@ using json = nlohmann::json;
 
 namespace pvd
 {
-    typedef std::function<void(ac::Declaration plan)> compile_callback_t;
-    typedef std::function<void(std::shared_ptr<SerialData> table)> execute_callback_t;
-    typedef std::function<void()> build_callback_t;
+    // the output of an operator chain run inline (small input), or else the acero plan of the chain
+    typedef std::function<void(std::shared_ptr<ar::Table> table, ac::Declaration plan)> compile_callback_t;
+    // called with the error of the build, nullptr if it succeeded
+    typedef std::function<void(std::exception_ptr error)> build_callback_t;
+
+    class PlanIndex;
+
+    /*
+     * One SELECT flattened from a chain of operators, e.g.
+     *      Projection -> Filter -> Filter -> TableSource
+     *      SELECT proj FROM table WHERE (cond_1) AND (cond_2)
+     * The values bound to choice nodes are query parameters, so the SQL is the same
+     * for every binding and the database only prepares it once.
+     */
+    struct SqlSelect
+    {
+        std::string select = "*";
+        std::string from;
+        std::vector<std::string> where;
+        std::string group_by;
+        // whether select is set, an operator above a projection reads it as a subquery
+        bool projected = false;
+        // $1, $2, ...
+        std::vector<std::shared_ptr<ar::Scalar>> params;
+
+        // the SQL of the expression bound with the binding, its bound values become parameters
+        std::string bind(const std::shared_ptr<Expression>& expr, const BindingMap& binding);
+        // make the current select a subquery: SELECT * FROM (current)
+        void wrap();
+        std::string to_string() const;
+    };
+
+    // the memory retained by the results cached by a node
+    struct CacheMemory
+    {
+        int64_t num_bindings = 0;
+        uint64_t retained_bytes = 0;
+        // the largest result of one binding
+        uint64_t max_binding_bytes = 0;
+    };
 
     class Plan
     {
@@ -42,6 +85,23 @@ namespace pvd
          * The global id of the plan operator
          */
         const int id;
+        /*
+         * Structural hash of the subplan rooted at this node (ids excluded).
+         * Two subplans with the same fingerprint compute the same result.
+         */
+        uint64_t fingerprint;
+        /*
+         * The number of plans that read this plan as their input
+         */
+        int num_parents = 0;
+        /*
+         * Rows per batch of the tables read by the acero plans of this node (0 for default_batch_size())
+         */
+        int64_t batch_size = 0;
+        /*
+         * The compiled plan (see PlanIndex), set on the root by parse_json_plan
+         */
+        std::shared_ptr<const PlanIndex> index;
         /* return all the input plans of this plan
          * Plan:
          *      projection
@@ -57,6 +117,18 @@ namespace pvd
          *      if networking roundtrip, wait server return a TableSource
          */
         virtual void execute(const BindingMap& binding, execute_callback_t cb) = 0;
+        /*
+         * execute the plan as an input of another plan,
+         * reuse the result of the same subplan if it has been executed in the current ExecutionBatch
+         */
+        void execute_shared(const BindingMap& binding, execute_callback_t cb);
+        /*
+         * execute the plan as a coroutine (see task.h), as a node of [batch] if set (see execute_shared).
+         * The task resumes with the cancel token that was current when it started.
+         * Only the top of the execution is a coroutine: the operators below still chain
+         * execute_callback_t closures, one per hop.
+         */
+        task<std::shared_ptr<SerialData>> execute_async(BindingMap binding, std::shared_ptr<ExecutionBatch> batch = nullptr);
         /*
          * construct a new binding_map that only contains the bindings used in the current plan
          */
@@ -64,30 +136,106 @@ namespace pvd
 
         // convert the plan to SQL query. Used for querying cloud DB
         virtual std::string to_sql(const BindingMap& binding) const = 0;
+        /*
+         * add the plan to a flattened parameterized SELECT
+         * (by default the plan is a subquery with its bound values inlined)
+         */
+        virtual void to_sql_select(const BindingMap& binding, SqlSelect& select) const;
         virtual std::string to_string() const = 0;
         virtual void get_all_choice_nodes(std::unordered_map<std::string, std::shared_ptr<ChoiceExpr>> &choice_nodes) = 0;
 
         Plan(int id);
-        // Precompute all SCache
-        void initialize(build_callback_t cb);
+        virtual ~Plan();
+        /*
+         * Precompute all SCache
+         * with [executor], the independent SCaches of a compiled plan are built in parallel on it (see PlanIndex)
+         */
+        void initialize(build_callback_t cb, Executor* executor = nullptr);
         bool at_server() const;
         /*
          * execute a subplan rooted at [id] using the binding
          */
         void execute_subplan(const BindingMap& binding, int id, execute_callback_t cb);
+        /*
+         * the memory pool of the acero plans of this node (see MemoryAccounting)
+         */
+        ar::MemoryPool* memory_pool();
+        // the memory pool of this node, nullptr if it has not allocated yet
+        ar::MemoryPool* allocated_pool() const { return pool.load(std::memory_order_acquire); }
+        /*
+         * the memory of the results cached by this node (caches only),
+         * the buffers in [counted] are not counted again
+         */
+        virtual CacheMemory cache_memory(BufferSet& counted) { return {}; }
+        // the label of the node in traces and memory stats, e.g. "Filter[3]"
+        std::string label() const;
     protected:
         void _initialize(build_callback_t cb, std::vector<std::shared_ptr<Plan>> inputs);
+    private:
+        friend class PlanIndex;
+        std::atomic<ar::MemoryPool*> pool{nullptr};
+        // 1 at the server, 0 at the client, -1 until the plan is compiled
+        int8_t placement = -1;
     };
 
+    /*
+     * A plan node run by Acero.
+     *
+     * The declaration built by build_plan only depends on the values bound to the choice
+     * nodes of the node's own expressions. It is prepared once per such binding, with
+     * an empty declaration in place of the input, and an execution only puts the source
+     * of the input data in its place. Executions that only change the bindings of the
+     * inputs (e.g. an upstream filter) reuse the prepared declaration.
+     *
+     * Consecutive Acero operators run as one pipeline: the declaration of an AceroPlan
+     * input read by no other plan becomes the input of the declaration, and only the
+     * last operator of the chain materializes its output. The metrics of a fused
+     * operator are not logged, its output is part of the pipeline.
+     *
+     * An operator chain reading a small table (at most inline_max_rows()) runs the arrow
+     * compute kernels of each operator directly on the table (execute_inline), without
+     * an Acero plan.
+     */
     class AceroPlan : public Plan
     {
     protected:
         std::shared_ptr<Plan> input;
     public:
         virtual ac::Declaration build_plan(const BindingMap& binding, ac::Declaration input_plan) = 0;
+        // the expressions of the node itself, without the inputs
+        virtual std::vector<std::shared_ptr<Expression>> plan_expressions() const = 0;
+        /*
+         * run the operator on a small input table without Acero, allocating from memory_pool(),
+         * return nullptr if the operator has no inline execution
+         */
+        virtual std::shared_ptr<ar::Table> execute_inline(const BindingMap& binding, const std::shared_ptr<ar::Table>& input);
+        // false if the output of build_plan is not the output of the operator, it can not be fused into its parent
+        virtual bool fusable() const { return true; }
         void compile(const BindingMap& binding, compile_callback_t cb);
         void execute(const BindingMap& binding, execute_callback_t cb) override;
         AceroPlan(int id, std::shared_ptr<Plan> input) : Plan(id), input(input) {};
+
+    private:
+        // at most this many prepared declarations are kept per node
+        static constexpr size_t MAX_PREPARED = 64;
+
+        std::mutex prepared_mutex;
+        bool own_choices_known = false;
+        // false if the expressions have MultiExpr, the bindings can not be listed
+        bool preparable = true;
+        std::vector<std::string> own_choice_ids;
+        // the own bindings and their declaration with an empty input, most recently used first
+        std::list<std::pair<FlatBinding, ac::Declaration>> prepared_order;
+        std::unordered_map<FlatBinding, std::list<std::pair<FlatBinding, ac::Declaration>>::iterator, FlatBindingHash> prepared;
+
+        // build_plan with the prepared declaration when there is one
+        ac::Declaration prepare(const BindingMap& binding, ac::Declaration source);
+        // whether the input is an Acero operator fused into the plan of this operator
+        bool fuses_input() const;
+        // the plan of this operator reading the input data
+        ac::Declaration compile_input(const BindingMap& binding, std::shared_ptr<SerialData> data);
+        // run this operator on the small output of its input chain
+        void compile_inline(const BindingMap& binding, std::shared_ptr<ar::Table> table, compile_callback_t cb);
     };
 
     class Projection : public AceroPlan
@@ -97,6 +245,7 @@ namespace pvd
         std::vector<std::shared_ptr<Expression>> proj_exprs;
         // projection names for arrow tables
         std::vector<std::string> proj_names;
+        std::vector<std::shared_ptr<CompiledExpr>> compiled_projs;
 
     public:
         Projection(int id,
@@ -105,8 +254,11 @@ namespace pvd
                    std::vector<std::string> proj_names);
         std::vector<std::shared_ptr<Plan>> input_plans() const override;
         ac::Declaration build_plan(const BindingMap& binding, ac::Declaration input_plan) override;
+        std::vector<std::shared_ptr<Expression>> plan_expressions() const override;
+        std::shared_ptr<ar::Table> execute_inline(const BindingMap& binding, const std::shared_ptr<ar::Table>& input) override;
         void pick_useful_binding(const BindingMap& binding, BindingMap& useful_binding) override;
         std::string to_sql(const BindingMap& binding) const override;
+        void to_sql_select(const BindingMap& binding, SqlSelect& select) const override;
         std::string to_string() const override;
         void get_all_choice_nodes(std::unordered_map<std::string, std::shared_ptr<ChoiceExpr>> &choice_nodes) override;
     };
@@ -115,23 +267,49 @@ namespace pvd
     {
         // Boolean
         std::shared_ptr<Expression> cond_expr;
+        std::shared_ptr<CompiledExpr> compiled_cond;
     public:
         Filter(int id, std::shared_ptr<Plan> input,
                std::shared_ptr<Expression> cond_expr);
         std::vector<std::shared_ptr<Plan>> input_plans() const override;
         ac::Declaration build_plan(const BindingMap& binding, ac::Declaration input_plan) override;
+        std::vector<std::shared_ptr<Expression>> plan_expressions() const override;
+        std::shared_ptr<ar::Table> execute_inline(const BindingMap& binding, const std::shared_ptr<ar::Table>& input) override;
         void pick_useful_binding(const BindingMap& binding, BindingMap& useful_binding) override;
         std::string to_sql(const BindingMap& binding) const override;
+        void to_sql_select(const BindingMap& binding, SqlSelect& select) const override;
         std::string to_string() const override;
         void get_all_choice_nodes(std::unordered_map<std::string, std::shared_ptr<ChoiceExpr>> &choice_nodes) override;
     };
 
+    /*
+     * Aggregates: count, sum, avg, min, max, count_distinct, stddev, variance, median.
+     *
+     * The approximate aggregates keep a mergeable sketch per group (sketch.h):
+     *   approx_count_distinct(x)  HyperLogLog estimate of the distinct values
+     *   approx_quantile(x, q)     t-digest estimate of the q-quantile
+     *   hll_state(x), tdigest_state(x)  the serialized sketch itself (a binary column)
+     * A binary argument holds sketch states, which are merged: partial states precomputed
+     * per group of a cached partition are combined at query time by aggregating them again,
+     * e.g. approx_quantile(state, 0.9) over the tdigest_state of the partitions.
+     * Without group by expressions the whole input is one group.
+     */
     class Aggregate : public AceroPlan
     {
         std::vector<std::shared_ptr<Expression>> groupby_exprs;
         std::vector<std::string> groupby_names;
         std::vector<std::shared_ptr<Expression>> aggregate_exprs;
         std::vector<std::string> aggregate_names;
+        // the group by expressions and the arguments of the aggregate functions (nullptr for count())
+        std::vector<std::shared_ptr<CompiledExpr>> compiled_groupby;
+        std::vector<std::shared_ptr<CompiledExpr>> compiled_aggregate_args;
+        // the aggregates built with a sketch from the list of values of each group
+        std::vector<int> sketch_aggregates;
+
+        // replace the lists of values of the sketch aggregates by their results
+        std::shared_ptr<ar::Table> finish_sketches(const BindingMap& binding, std::shared_ptr<ar::Table> table) const;
+        // the row of an aggregate without group by over no row (count 0, the other aggregates null)
+        std::shared_ptr<ar::Table> empty_input_row(std::shared_ptr<ar::Table> table) const;
     public:
         Aggregate(int id,
                   std::shared_ptr<Plan> input,
@@ -141,8 +319,12 @@ namespace pvd
                   std::vector<std::string> aggregate_names);
         std::vector<std::shared_ptr<Plan>> input_plans() const override;
         ac::Declaration build_plan(const BindingMap& binding, ac::Declaration input_plan) override;
+        std::vector<std::shared_ptr<Expression>> plan_expressions() const override;
+        bool fusable() const override;
+        void execute(const BindingMap& binding, execute_callback_t cb) override;
         void pick_useful_binding(const BindingMap& binding, BindingMap& useful_binding) override;
         std::string to_sql(const BindingMap& binding) const override;
+        void to_sql_select(const BindingMap& binding, SqlSelect& select) const override;
         std::string to_string() const override;
         void get_all_choice_nodes(std::unordered_map<std::string, std::shared_ptr<ChoiceExpr>> &choice_nodes) override;
     };
@@ -156,6 +338,7 @@ namespace pvd
         void execute(const BindingMap& binding, execute_callback_t cb) override;
         void pick_useful_binding(const BindingMap& binding, BindingMap& useful_binding) override;
         std::string to_sql(const BindingMap& binding) const override;
+        void to_sql_select(const BindingMap& binding, SqlSelect& select) const override;
         std::string to_string() const override;
         void get_all_choice_nodes(std::unordered_map<std::string, std::shared_ptr<ChoiceExpr>> &choice_nodes) override;
     };
@@ -163,6 +346,8 @@ namespace pvd
     class Network : public Plan
     {
         std::shared_ptr<Plan> input;
+        // deserialize the server reply of the input plan
+        void receive(Reply reply, execute_callback_t cb);
     public:
         Network(int id, std::shared_ptr<Plan> input);
         std::vector<std::shared_ptr<Plan>> input_plans() const override;
@@ -182,16 +367,33 @@ namespace pvd
         void execute(const BindingMap& binding, execute_callback_t cb) override;
         void pick_useful_binding(const BindingMap& binding, BindingMap& useful_binding) override;
         std::string to_sql(const BindingMap& binding) const override;
+        // the flattened SELECT of the input chain with bound values as parameters
+        std::string to_param_sql(const BindingMap& binding, std::vector<std::shared_ptr<ar::Scalar>>& params) const;
         std::string to_string() const override;
         void get_all_choice_nodes(std::unordered_map<std::string, std::shared_ptr<ChoiceExpr>> &choice_nodes) override;
     };
 
+    /*
+     * The results of an SCache for all the bindings of its choices, and the state of their build.
+     * The SCaches of sessions with identical subplans share one store (see PlanContext) and build it
+     * once, each session keeps its own SCache node over its own input.
+     */
+    struct SCacheStore
+    {
+        std::mutex mutex;
+        bool cached = false;
+        bool caching = false;
+        std::unordered_map<FlatBinding, std::shared_ptr<SerialData>, FlatBindingHash> data;
+        // the sessions waiting for the build of another one, resumed where they waited
+        std::vector<std::pair<build_callback_t, Continuation>> waiters;
+    };
+
     class SCache : public Plan
     {
         std::shared_ptr<Plan> input;
-        std::unordered_map<uint64_t, std::shared_ptr<SerialData>> data;
+        std::shared_ptr<SCacheStore> store;
     public:
-        SCache(int id, std::shared_ptr<Plan> input);
+        SCache(int id, std::shared_ptr<Plan> input, std::shared_ptr<SCacheStore> store = nullptr);
         std::vector<std::shared_ptr<Plan>> input_plans() const override;
         void execute(const BindingMap& binding, execute_callback_t cb) override;
         void pick_useful_binding(const BindingMap& binding, BindingMap& useful_binding) override;
@@ -199,19 +401,23 @@ namespace pvd
         std::string to_string() const override;
         void get_all_choice_nodes(std::unordered_map<std::string, std::shared_ptr<ChoiceExpr>> &choice_nodes) override;
         void cache_data(build_callback_t cb);
+        bool is_cached() const;
+        CacheMemory cache_memory(BufferSet& counted) override;
     private:
         void _cache_data(build_callback_t cb, std::shared_ptr<std::vector<BindingMap>> bindings, int i);
+        bool finish_build(const build_callback_t& cb, std::exception_ptr error);
     };
 
     class DCache : public Plan
     {
         std::shared_ptr<Plan> input;
         std::shared_ptr<SerialData> data;
-        BindingMap current_binding;
+        FlatBinding current_binding;
     public:
         DCache(int id, std::shared_ptr<Plan> input);
         std::vector<std::shared_ptr<Plan>> input_plans() const override;
         void execute(const BindingMap& binding, execute_callback_t cb) override;
+        CacheMemory cache_memory(BufferSet& counted) override;
         void pick_useful_binding(const BindingMap& binding, BindingMap& useful_binding) override;
         std::string to_sql(const BindingMap& binding) const override;
         std::string to_string() const override;
@@ -234,6 +440,7 @@ namespace pvd
         void serialize(std::shared_ptr<ar::io::BufferOutputStream> out) override;
         void deserialize(std::shared_ptr<ar::io::BufferReader> buffer) override;
         uint64_t size() override;
+        uint64_t retained_size(BufferSet& counted) override;
     };
 
     class HashTableBuild : public Plan
@@ -529,9 +736,70 @@ namespace pvd
         void execute(const BindingMap& binding, execute_callback_t cb) override;
         void pick_useful_binding(const BindingMap& binding, BindingMap& useful_binding) override;
         std::string to_sql(const BindingMap& binding) const override;
+        void to_sql_select(const BindingMap& binding, SqlSelect& select) const override;
         std::string to_string() const override;
         void get_all_choice_nodes(std::unordered_map<std::string, std::shared_ptr<ChoiceExpr>> &choice_nodes) override;
     };
 
+    /*
+     * Per-session state of parsing plan jsons
+     *      nodes: plan node id -> plan node of the session
+     *      shared_scaches: fingerprint -> store of the SCaches, shared by all sessions (optional)
+     */
+    struct PlanContext
+    {
+        std::unordered_map<int, std::shared_ptr<Plan>> nodes;
+        std::unordered_map<uint64_t, std::weak_ptr<SCacheStore>>* shared_scaches = nullptr;
+    };
+
+    /*
+     * The compiled form of a plan: its nodes in post order (inputs first) with dense indices,
+     * the parent of each node and where it runs. It is built once when the plan is parsed, so
+     * an execution finds its node with one lookup and the initialization is a loop over the SCaches.
+     *
+     * The SCaches of each side are split into independent groups: two SCaches are in the same group
+     * if their subtrees share a node (e.g. an SCache reading another one). A group is built in post
+     * order, different groups touch different nodes and are built concurrently.
+     */
+    class PlanIndex : public std::enable_shared_from_this<PlanIndex>
+    {
+    public:
+        struct Node
+        {
+            Plan* plan;
+            // the first parent of the node in post order, -1 for the root
+            int32_t parent;
+            bool at_server;
+            // reached from the root without crossing a Network, i.e. initialized by the client
+            bool client_side;
+        };
+
+        explicit PlanIndex(const std::shared_ptr<Plan>& root);
+        // -1 if the node is not in the plan
+        int32_t index_of(int id) const;
+        // nullptr if the node is not in the plan
+        Plan* find(int id) const;
+        const Node& node(int32_t index) const { return nodes[index]; }
+        size_t size() const { return nodes.size(); }
+        /*
+         * precompute the SCaches of the current side (the client if SENDER is set)
+         * The groups run on [executor] if set, the calling thread builds the first one. Otherwise they
+         * are interleaved: a group continues when its SCache is built (e.g. the client waiting for the
+         * server). Nothing blocks: cb is called once, by the last group to finish.
+         */
+        void initialize(build_callback_t cb, Executor* executor = nullptr) const;
+        // the SCache groups of a side
+        const std::vector<std::vector<SCache*>>& groups(bool at_server) const { return at_server ? server_groups : client_groups; }
+
+    private:
+        std::vector<Node> nodes;
+        std::unordered_map<int, int32_t> indices;
+        std::vector<std::vector<SCache*>> client_groups;
+        std::vector<std::vector<SCache*>> server_groups;
+
+        void initialize(const std::vector<SCache*>& scaches, size_t i, build_callback_t cb) const;
+    };
+
+    std::shared_ptr<Plan> parse_json_plan(const json& plan, PlanContext& context);
     std::shared_ptr<Plan> parse_json_plan(const json& plan);
 }
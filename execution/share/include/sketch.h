@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <arrow/api.h>
+
+namespace pvd
+{
+    /*
+     * HyperLogLog sketch of the distinct values of a column.
+     *
+     * 2^precision registers of one byte, the standard error of the estimate is
+     * 1.04 / sqrt(2^precision) (1.6% with the default precision). Sketches of the same
+     * precision merge by taking the maximum of each register, so the distinct count of a
+     * union of partitions is estimated from the sketches of the partitions.
+     */
+    class HyperLogLog
+    {
+        int precision;
+        std::vector<uint8_t> registers;
+    public:
+        static constexpr int DEFAULT_PRECISION = 12;
+
+        explicit HyperLogLog(int precision = DEFAULT_PRECISION);
+        void add_hash(uint64_t hash);
+        void merge(const HyperLogLog& other);
+        double estimate() const;
+
+        // [precision: uint8][registers]
+        std::string serialize() const;
+        static HyperLogLog deserialize(std::string_view data);
+    };
+
+    /*
+     * t-digest sketch of the distribution of a numeric column (merging variant).
+     *
+     * The values are summarized by at most about [compression] centroids (mean, weight),
+     * small centroids near the tails keep the extreme quantiles accurate. Digests merge by
+     * compressing the union of their centroids, so the quantiles of a union of partitions
+     * are estimated from the digests of the partitions.
+     */
+    class TDigest
+    {
+        struct Centroid
+        {
+            double mean;
+            double weight;
+        };
+
+        double compression;
+        // sorted by mean after compress()
+        std::vector<Centroid> centroids;
+        // added since the last compress()
+        std::vector<Centroid> unmerged;
+        double total_weight = 0;
+        double min;
+        double max;
+
+        void compress();
+    public:
+        static constexpr double DEFAULT_COMPRESSION = 100;
+
+        explicit TDigest(double compression = DEFAULT_COMPRESSION);
+        void add(double value, double weight = 1);
+        void merge(const TDigest& other);
+        // the estimated q-quantile, NaN if the digest is empty
+        double quantile(double q);
+        double count() const { return total_weight; }
+
+        // [compression, min, max: double][n: int64][n x (mean, weight): double]
+        std::string serialize();
+        static TDigest deserialize(std::string_view data);
+    };
+
+    /*
+     * The sketch of the values of an array. A binary array holds serialized sketches
+     * (partial states), they are merged instead.
+     */
+    HyperLogLog hyperloglog_of(const arrow::Array& values);
+    TDigest tdigest_of(const arrow::Array& values);
+}
@@ -0,0 +1,294 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace pvd
+{
+    /*
+     * A lazy coroutine returning T, started when it is awaited (co_await) or spawned.
+     *
+     * There is no scheduler thread: a task runs on the thread that starts it until it awaits a
+     * callback (see callback()), and is resumed by the thread that invokes the callback, i.e. where
+     * the callback of Plan::execute would run. On the server that is the strand of the session, in
+     * the browser it is the event loop delivering the replies of the server.
+     *
+     * An exception thrown in a task is rethrown where it is awaited, and handed to the error
+     * handler of spawn() at the top.
+     */
+    template<typename T = void>
+    class task;
+
+    namespace detail
+    {
+        struct promise_base
+        {
+            std::coroutine_handle<> continuation;
+            std::exception_ptr error;
+
+            struct final_awaiter
+            {
+                bool await_ready() noexcept { return false; }
+
+                template<typename P>
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept
+                {
+                    auto continuation = handle.promise().continuation;
+                    return continuation ? continuation : std::noop_coroutine();
+                }
+
+                void await_resume() noexcept {}
+            };
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            final_awaiter final_suspend() noexcept { return {}; }
+            void unhandled_exception() { error = std::current_exception(); }
+        };
+
+        template<typename T>
+        struct promise : promise_base
+        {
+            std::optional<T> value;
+
+            task<T> get_return_object();
+            void return_value(T v) { value.emplace(std::move(v)); }
+
+            T result()
+            {
+                if (error) std::rethrow_exception(error);
+                return std::move(*value);
+            }
+        };
+
+        template<>
+        struct promise<void> : promise_base
+        {
+            task<void> get_return_object();
+            void return_void() {}
+
+            void result()
+            {
+                if (error) std::rethrow_exception(error);
+            }
+        };
+
+        // runs a task to its end and frees itself
+        struct detached
+        {
+            struct promise_type
+            {
+                detached get_return_object() { return {}; }
+                std::suspend_never initial_suspend() noexcept { return {}; }
+                std::suspend_never final_suspend() noexcept { return {}; }
+                void return_void() {}
+                void unhandled_exception() { std::terminate(); }
+            };
+        };
+    }
+
+    template<typename T>
+    class task
+    {
+    public:
+        using promise_type = detail::promise<T>;
+
+        task() = default;
+        explicit task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+        task(task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+        task& operator=(task&& other) noexcept
+        {
+            if (this != &other) {
+                if (handle) handle.destroy();
+                handle = std::exchange(other.handle, nullptr);
+            }
+            return *this;
+        }
+        task(const task&) = delete;
+        task& operator=(const task&) = delete;
+        ~task()
+        {
+            if (handle) handle.destroy();
+        }
+
+        // run the task, the awaiting coroutine continues when it returns
+        auto operator co_await() && noexcept
+        {
+            struct awaiter
+            {
+                std::coroutine_handle<promise_type> handle;
+
+                bool await_ready() noexcept { return false; }
+
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+                {
+                    handle.promise().continuation = awaiting;
+                    return handle;
+                }
+
+                T await_resume() { return handle.promise().result(); }
+            };
+            return awaiter{handle};
+        }
+
+    private:
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    namespace detail
+    {
+        template<typename T>
+        task<T> promise<T>::get_return_object()
+        {
+            return task<T>(std::coroutine_handle<promise<T>>::from_promise(*this));
+        }
+
+        inline task<void> promise<void>::get_return_object()
+        {
+            return task<void>(std::coroutine_handle<promise<void>>::from_promise(*this));
+        }
+    }
+
+    /*
+     * Await a callback API: start(cb) is called when the awaiting coroutine suspends, and the
+     * coroutine continues with the value passed to cb (cb may be called before start returns,
+     * or later by another thread). cb only holds a pointer, so std::function does not allocate it.
+     */
+    template<typename T, typename Start>
+    class callback_awaiter
+    {
+        Start start;
+        std::optional<T> value;
+        std::coroutine_handle<> handle;
+        // set by the first of await_suspend and cb to finish, the second one continues
+        std::atomic<bool> done{false};
+
+    public:
+        explicit callback_awaiter(Start start) : start(std::move(start)) {}
+
+        bool await_ready() noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> awaiting)
+        {
+            handle = awaiting;
+            start([this](T v) {
+                value.emplace(std::move(v));
+                if (done.exchange(true, std::memory_order_acq_rel)) {
+                    handle.resume();
+                }
+            });
+            // false: cb has been called, do not suspend
+            return !done.exchange(true, std::memory_order_acq_rel);
+        }
+
+        T await_resume() { return std::move(*value); }
+    };
+
+    template<typename T, typename Start>
+    callback_awaiter<T, Start> callback(Start start)
+    {
+        return callback_awaiter<T, Start>(std::move(start));
+    }
+
+    /*
+     * Run the tasks concurrently: each one runs until it waits for a callback, then the next one
+     * starts. Return their results in the order of [tasks] when all have finished. If some fail,
+     * the exception of the first failed task (in the order of [tasks]) is rethrown.
+     */
+    template<typename T>
+    task<std::vector<T>> when_all(std::vector<task<T>> tasks)
+    {
+        struct join
+        {
+            std::vector<std::optional<T>> values;
+            std::vector<std::exception_ptr> errors;
+            // the running tasks, +1 until all are started
+            std::atomic<size_t> remaining;
+            std::coroutine_handle<> awaiting;
+
+            void finish()
+            {
+                if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    awaiting.resume();
+                }
+            }
+
+            static detail::detached run(join* self, size_t i, task<T> t)
+            {
+                try {
+                    self->values[i].emplace(co_await std::move(t));
+                }
+                catch (...) {
+                    self->errors[i] = std::current_exception();
+                }
+                self->finish();
+            }
+        };
+
+        struct start_all
+        {
+            join* self;
+            std::vector<task<T>>& tasks;
+
+            bool await_ready() noexcept { return false; }
+
+            bool await_suspend(std::coroutine_handle<> awaiting)
+            {
+                self->awaiting = awaiting;
+                for (size_t i = 0; i < tasks.size(); i++) {
+                    join::run(self, i, std::move(tasks[i]));
+                }
+                return self->remaining.fetch_sub(1, std::memory_order_acq_rel) != 1;
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        join state;
+        state.values.resize(tasks.size());
+        state.errors.resize(tasks.size());
+        state.remaining = tasks.size() + 1;
+        co_await start_all{&state, tasks};
+
+        std::vector<T> results;
+        results.reserve(tasks.size());
+        for (size_t i = 0; i < state.values.size(); i++) {
+            if (state.errors[i]) std::rethrow_exception(state.errors[i]);
+            results.push_back(std::move(*state.values[i]));
+        }
+        co_return results;
+    }
+
+    /*
+     * Start a task from callback code, without awaiting it.
+     * on_value(result) is called when it returns, on_error(std::exception_ptr) if it (or on_value)
+     * throws. on_error must not throw, nothing is left to catch it.
+     */
+    template<typename T, typename OnValue, typename OnError>
+    void spawn(task<T> t, OnValue on_value, OnError on_error)
+    {
+        [](task<T> t, OnValue on_value, OnError on_error) -> detail::detached {
+            std::exception_ptr error;
+            try {
+                if constexpr (std::is_void_v<T>) {
+                    co_await std::move(t);
+                    on_value();
+                }
+                else {
+                    on_value(co_await std::move(t));
+                }
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
+            if (error) {
+                on_error(error);
+            }
+        }(std::move(t), std::move(on_value), std::move(on_error));
+    }
+}
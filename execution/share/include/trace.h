@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace pvd
+{
+    // monotonic time in nanoseconds
+    inline uint64_t trace_now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    struct TraceEvent
+    {
+        enum Kind : uint8_t {
+            // the work of an operator, from its input to its output
+            Operator,
+            // the execution of a plan node including its inputs, operator spans of the subplan nest in it
+            Execute
+        };
+        Kind kind;
+        // the node type, e.g. "Filter"
+        char name[23];
+        int32_t node_id;
+        uint64_t start_ns;
+        uint64_t duration_ns;
+        uint64_t plan_ns;
+        int64_t input_rows;
+        int64_t output_rows;
+        int64_t build_size;
+    };
+
+    /*
+     * Low overhead tracing of the plan execution.
+     *
+     * Each thread records its events into its own fixed size ring: a record is two relaxed
+     * loads, a copy and a release store, without locks or allocation. A full ring drops
+     * new events (and counts them) until the exporter catches up. The exporter drains all
+     * the rings in one batch into Chrome trace events (JSON array format, readable by
+     * chrome://tracing and Perfetto), one process per location (server / client).
+     *
+     * Tracing is on by default, PVD_TRACE=0 turns it off.
+     */
+    class Tracer
+    {
+        // a single producer (the owner thread), single consumer (the exporter) ring
+        struct Ring
+        {
+            static constexpr uint64_t CAPACITY = 4096;
+            TraceEvent events[CAPACITY];
+            std::atomic<uint64_t> head{0};
+            std::atomic<uint64_t> tail{0};
+            std::atomic<uint64_t> dropped{0};
+            int tid;
+        };
+
+        bool enabled;
+        std::mutex rings_mutex;
+        std::vector<std::shared_ptr<Ring>> rings;
+        int next_tid = 1;
+        // one drain at a time
+        std::mutex drain_mutex;
+        bool process_named = false;
+
+        Tracer();
+        Ring& local_ring();
+
+    public:
+        static Tracer& instance();
+
+        bool is_enabled() const { return enabled; }
+        void record(const TraceEvent& event);
+        /*
+         * remove the recorded events of all threads and return them as Chrome trace events,
+         * each followed by a comma, or an empty string if there is none
+         */
+        std::string drain_json();
+    };
+
+    /*
+     * export the recorded events: appended to the trace file by the server,
+     * sent to the server in one Log message by the client
+     */
+    void flush_trace();
+    /*
+     * flush the trace every [interval] from a background thread (server)
+     */
+    void start_trace_exporter(std::chrono::milliseconds interval);
+    // a Chrome trace instant event (with a comma), args is a JSON object
+    std::string trace_instant_json(const std::string& name, const std::string& args);
+}
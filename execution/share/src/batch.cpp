@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <cstring>
+
+#include "batch.h"
+#include "plan.h"
+#include "json.h"
+
+using json = nlohmann::json;
+
+namespace pvd
+{
+    static thread_local std::shared_ptr<ExecutionBatch> current_batch = nullptr;
+
+    ExecutionBatch::ExecutionBatch(BindingMap binding)
+            : binding(std::move(binding))
+    {
+        flat_binding = FlatBinding(this->binding);
+    }
+
+    size_t ExecutionBatch::KeyHash::operator()(const Key& key) const
+    {
+        uint64_t h = key.binding.hash();
+        uint64_t plan = key.fingerprint ? key.fingerprint : reinterpret_cast<uintptr_t>(key.plan);
+        return h ^ (plan + 0x9e3779b97f4a7c15 + (h << 6) + (h >> 2));
+    }
+
+    void ExecutionBatch::execute(Plan* plan, const BindingMap& binding, execute_callback_t cb)
+    {
+        // almost every node of a batch runs with the batch binding, avoid flattening it again
+        Key key{plan->fingerprint, plan->fingerprint ? nullptr : plan,
+                binding == this->binding ? flat_binding : FlatBinding(binding)};
+
+        auto [it, inserted] = results.try_emplace(key);
+        auto& result = it->second;
+        if (result.done) {
+            cb(result.data);
+            return;
+        }
+        result.waiters.push_back(std::move(cb));
+        if (!inserted) {
+            // the same subplan is being executed, wait for its result
+            return;
+        }
+        // the elements of an unordered_map stay in place when it grows
+        try {
+            plan->execute(binding, [self = shared_from_this(), result = &result](std::shared_ptr<SerialData> data) {
+                // a result may be read by several plans of the batch
+                data = materialize(std::move(data));
+                result->done = true;
+                result->data = data;
+                auto waiters = std::move(result->waiters);
+                for (auto& waiter : waiters) {
+                    waiter(data);
+                }
+            });
+        }
+        catch (...) {
+            // the later nodes with the same key execute it again (and fail themselves)
+            if (!result.done) {
+                results.erase(key);
+            }
+            throw;
+        }
+    }
+
+    bool ExecutionBatch::defer_remote(int node_id, const BindingMap& binding, remote_callback_t cb)
+    {
+        if (!(binding == this->binding)) {
+            return false;
+        }
+        remote.emplace_back(node_id, std::move(cb));
+        return true;
+    }
+
+    void ExecutionBatch::flush()
+    {
+        if (remote.empty()) {
+            return;
+        }
+        auto callbacks = std::make_shared<std::vector<std::pair<int, remote_callback_t>>>(std::move(remote));
+        remote.clear();
+
+        std::vector<int> nodes;
+        for (auto& [node_id, _] : *callbacks) {
+            if (std::find(nodes.begin(), nodes.end(), node_id) == nodes.end()) {
+                nodes.push_back(node_id);
+            }
+        }
+        std::string content = batch_request_to_string(nodes, binding);
+        Query query = {Query::ExecuteBatch, nodes[0], static_cast<int64_t>(content.size() + 1), ViewExecution::current_view()};
+        SENDER->send(query, (void*)content.c_str(), [callbacks](Reply reply) {
+            if (!reply.ok()) {
+                ViewExecution::abort_current(reply);
+                return;
+            }
+            for (auto& [node_id, node_reply] : split_batch_reply(reply)) {
+                for (auto& [id, cb] : *callbacks) {
+                    if (id == node_id) {
+                        cb(node_reply);
+                    }
+                }
+            }
+        });
+    }
+
+    std::shared_ptr<ExecutionBatch> ExecutionBatch::current()
+    {
+        return current_batch;
+    }
+
+    BatchScope::BatchScope(std::shared_ptr<ExecutionBatch> batch) : previous(current_batch)
+    {
+        current_batch = std::move(batch);
+    }
+
+    BatchScope::~BatchScope()
+    {
+        current_batch = previous;
+    }
+
+    std::string batch_request_to_string(const std::vector<int>& nodes, const BindingMap& binding)
+    {
+        json request;
+        request["nodes"] = nodes;
+        binding_to_json(binding, request["binding"]);
+        return request.dump();
+    }
+
+    void parse_batch_request(const std::string& content, std::vector<int>& nodes, BindingMap& binding)
+    {
+        auto request = json::parse(content);
+        if (!request.contains("nodes") || !request["nodes"].is_array() || request["nodes"].empty()) {
+            throw std::runtime_error("ExecuteBatch without nodes");
+        }
+        nodes = request["nodes"].get<std::vector<int>>();
+        binding = parse_json_binding(request["binding"]);
+    }
+
+    std::vector<std::pair<int, Reply>> split_batch_reply(Reply reply)
+    {
+        std::vector<std::pair<int, Reply>> replies;
+        auto data = static_cast<char*>(reply.data);
+        // every read is checked against the size of the reply, a truncated reply must not read past it
+        auto read = [&](auto& value, int64_t& offset) {
+            if (offset < 0 || reply.size - offset < static_cast<int64_t>(sizeof(value))) {
+                throw std::runtime_error("Truncated ExecuteBatch reply");
+            }
+            std::memcpy(&value, data + offset, sizeof(value));
+            offset += sizeof(value);
+        };
+        int64_t offset = 0;
+        int32_t num;
+        read(num, offset);
+        if (num < 0) {
+            throw std::runtime_error("Invalid ExecuteBatch reply");
+        }
+        for (int i = 0; i < num; i++) {
+            int32_t node_id;
+            int64_t size;
+            read(node_id, offset);
+            read(size, offset);
+            if (size < 0 || size > reply.size - offset) {
+                throw std::runtime_error("Truncated ExecuteBatch reply");
+            }
+            replies.emplace_back(node_id, Reply{size, data + offset});
+            offset += size;
+        }
+        return replies;
+    }
+}
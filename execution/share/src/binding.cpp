@@ -1,7 +1,9 @@
+#include <cstring>
+#include <mutex>
 #include <stdexcept>
+#include <unordered_map>
 
 #include "binding.h"
-#include "arrow_utils.h"
 
 namespace pvd
 {
@@ -244,37 +246,104 @@ namespace pvd
         }
     }
 
-    uint64_t hash_binding(const BindingMap& binding) {
-        std::vector<std::string> ids;
-        for (auto &[key, value]: binding) {
-            ids.push_back(key);
+    // wyhash mixing: the folded 128-bit product
+    static inline uint64_t wymix(uint64_t a, uint64_t b)
+    {
+        __uint128_t r = (__uint128_t)a * b;
+        return (uint64_t)r ^ (uint64_t)(r >> 64);
+    }
+
+    static const uint64_t WYP0 = 0xa0761d6478bd642full, WYP1 = 0xe7037ed1a0b428dbull, WYP2 = 0x8ebc6af09c88c6e3ull;
+
+    uint32_t FlatBinding::intern(const std::string& choice_id)
+    {
+        // the few choice ids of the plans are looked up by every thread, the shared table is locked on a miss
+        static std::mutex mutex;
+        static std::unordered_map<std::string, uint32_t> ids;
+        thread_local std::unordered_map<std::string, uint32_t> local_ids;
+
+        auto it = local_ids.find(choice_id);
+        if (it != local_ids.end()) {
+            return it->second;
+        }
+        uint32_t id;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            id = ids.emplace(choice_id, (uint32_t)ids.size()).first->second;
         }
-        std::sort(ids.begin(), ids.end());
+        local_ids.emplace(choice_id, id);
+        return id;
+    }
+
+    FlatBinding::FlatBinding(const BindingMap& binding)
+    {
+        values.reserve(binding.size());
+        append(binding);
 
-        std::vector<std::shared_ptr<ar::Scalar>> scalars;
-        for (auto id: ids) {
-            auto &value = binding.at(id);
-            scalars.push_back(std::make_shared<ar::StringScalar>(id));
-            if (value.is_index()) {
-                scalars.push_back(std::make_shared<ar::Int64Scalar>(value.get_index()));
-            } else if (value.is_int()) {
-                scalars.push_back(std::make_shared<ar::Int64Scalar>(value.get_int()));
-            } else if (value.is_float()) {
-                scalars.push_back(std::make_shared<ar::FloatScalar>(value.get_float()));
-            } else if (value.is_bool()) {
-                scalars.push_back(std::make_shared<ar::BooleanScalar>(value.get_bool()));
-            } else if (value.is_string()) {
-                scalars.push_back(std::make_shared<ar::StringScalar>(value.get_string()));
-            } else if (value.is_sub_bindings()) {
-                std::vector<std::shared_ptr<ar::Scalar>> sub_scalars;
+        uint64_t h = WYP0 ^ values.size();
+        for (auto& value : values) {
+            h = wymix(h ^ value.bits, WYP1 ^ ((uint64_t)value.id << 8 | value.kind));
+        }
+        auto bytes = strings.data();
+        size_t i = 0;
+        for (; i + 8 <= strings.size(); i += 8) {
+            uint64_t word;
+            std::memcpy(&word, bytes + i, 8);
+            h = wymix(h ^ word, WYP2);
+        }
+        if (i < strings.size()) {
+            uint64_t word = 0;
+            std::memcpy(&word, bytes + i, strings.size() - i);
+            h = wymix(h ^ word, WYP2 ^ (strings.size() - i));
+        }
+        _hash = wymix(h, WYP1 ^ strings.size());
+    }
+
+    void FlatBinding::append(const BindingMap& binding)
+    {
+        for (auto& [key, value] : binding) {
+            Value flat{intern(key), value.kind, 0};
+            if (value.is_index() || value.is_int()) {
+                flat.bits = (uint64_t)(int64_t)std::get<int>(value._value);
+            }
+            else if (value.is_float()) {
+                uint32_t bits;
+                float f = value.get_float();
+                std::memcpy(&bits, &f, sizeof(bits));
+                flat.bits = bits;
+            }
+            else if (value.is_bool()) {
+                flat.bits = value.get_bool();
+            }
+            else if (value.is_string()) {
+                auto& str = value.get_string();
+                flat.bits = (uint64_t)strings.size() << 32 | str.size();
+                strings += str;
+            }
+            else if (value.is_sub_bindings()) {
+                flat.bits = value.get_sub_binding_num();
+                values.push_back(flat);
                 for (int i = 0; i < value.get_sub_binding_num(); i++) {
-                    sub_scalars.push_back(std::make_shared<ar::Int64Scalar>(hash_binding(value.get_sub_binding(i))));
+                    append(value.get_sub_binding(i));
+                    values.push_back({END, Binding::Kind::Multi, 0});
                 }
-                scalars.push_back(std::make_shared<ar::Int64Scalar>(hash_scalars(sub_scalars)));
-            } else {
+                continue;
+            }
+            else {
                 throw std::runtime_error("Invalid binding type");
             }
+            values.push_back(flat);
         }
-        return hash_scalars(scalars);
+    }
+
+    bool FlatBinding::operator==(const FlatBinding& other) const
+    {
+        // equal values give equal string offsets, so the strings compare as one buffer
+        return _hash == other._hash && values == other.values && strings == other.strings;
+    }
+
+    uint64_t hash_binding(const BindingMap& binding)
+    {
+        return FlatBinding(binding).hash();
     }
 }
@@ -0,0 +1,71 @@
+#include "cancel.h"
+
+namespace pvd
+{
+    static thread_local std::shared_ptr<CancelToken> current_token = nullptr;
+
+    void CancelToken::cancel()
+    {
+        // callbacks run under the lock, so once remove_callback returns the callback is never called
+        std::lock_guard<std::mutex> lock(mutex);
+        if (cancelled.exchange(true)) {
+            return;
+        }
+        for (auto& [_, callback] : callbacks) {
+            callback();
+        }
+        callbacks.clear();
+    }
+
+    bool CancelToken::is_cancelled() const
+    {
+        return cancelled.load();
+    }
+
+    int CancelToken::on_cancel(std::function<void()> callback)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!cancelled) {
+                int id = next_callback_id++;
+                callbacks.emplace_back(id, std::move(callback));
+                return id;
+            }
+        }
+        callback();
+        return -1;
+    }
+
+    void CancelToken::remove_callback(int id)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::erase_if(callbacks, [id](auto& callback) { return callback.first == id; });
+    }
+
+    CancelScope::CancelScope(std::shared_ptr<CancelToken> token) : previous(current_token)
+    {
+        current_token = std::move(token);
+    }
+
+    CancelScope::~CancelScope()
+    {
+        current_token = previous;
+    }
+
+    std::shared_ptr<CancelToken> current_cancel_token()
+    {
+        return current_token;
+    }
+
+    bool is_cancelled()
+    {
+        return current_token && current_token->is_cancelled();
+    }
+
+    void check_cancelled()
+    {
+        if (is_cancelled()) {
+            throw Cancelled();
+        }
+    }
+}
@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <arrow/compute/api.h>
+#include <arrow/io/api.h>
+#include <arrow/ipc/api.h>
+
+#include "domain.h"
+#include "cloud_api.h"
+
+namespace cp = arrow::compute;
+
+namespace pvd
+{
+    static std::string domain_key(const std::string& table, const std::string& column)
+    {
+        return table + "." + column;
+    }
+
+    DomainCatalog& DomainCatalog::instance()
+    {
+        static DomainCatalog catalog;
+        return catalog;
+    }
+
+    std::shared_ptr<arrow::Array> DomainCatalog::find(const std::string& key)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = domains.find(key);
+        return it == domains.end() ? nullptr : it->second;
+    }
+
+    std::shared_ptr<arrow::Array> DomainCatalog::get(const std::string& table, const std::string& column)
+    {
+        auto key = domain_key(table, column);
+        if (auto values = find(key)) {
+            return values;
+        }
+        fetch(table, {column});
+        return find(key);
+    }
+
+    void DomainCatalog::prefetch(const std::map<std::string, std::vector<std::string>>& columns_by_table)
+    {
+        for (auto& [table, columns] : columns_by_table) {
+            fetch(table, columns);
+        }
+    }
+
+    void DomainCatalog::fetch(const std::string& table, const std::vector<std::string>& columns)
+    {
+        std::lock_guard<std::mutex> fetch_lock(fetch_mutex);
+        std::vector<std::string> missing;
+        for (auto& column : columns) {
+            if (!find(domain_key(table, column)) &&
+                std::find(missing.begin(), missing.end(), column) == missing.end()) {
+                missing.push_back(column);
+            }
+        }
+        if (missing.empty()) {
+            return;
+        }
+
+        // one scan of the table for all the columns: SELECT list(DISTINCT a), list(DISTINCT b) FROM table
+        std::string select;
+        for (auto& column : missing) {
+            if (!select.empty()) select += ", ";
+            select += "list(DISTINCT " + column + ")";
+        }
+        std::shared_ptr<arrow::Table> result;
+        cloud->query("SELECT " + select + " FROM " + table, [&result](std::shared_ptr<arrow::Table> table) {
+            result = std::move(table);
+        });
+
+        std::unordered_map<std::string, std::shared_ptr<arrow::Array>> fetched;
+        for (int i = 0; i < missing.size(); i++) {
+            auto list_type = std::static_pointer_cast<arrow::BaseListType>(result->schema()->field(i)->type());
+            auto list = result->num_rows() > 0 ? result->column(i)->GetScalar(0).ValueOrDie() : nullptr;
+            std::shared_ptr<arrow::Array> values;
+            if (list && list->is_valid) {
+                values = std::static_pointer_cast<arrow::BaseListScalar>(list)->value;
+                values = cp::DropNull(values).ValueOrDie().make_array();
+                auto indices = cp::SortIndices(*values).ValueOrDie();
+                values = cp::Take(*values, *indices).ValueOrDie();
+            }
+            else {
+                // a list of an empty table is NULL
+                values = arrow::MakeEmptyArray(list_type->value_type()).ValueOrDie();
+            }
+            fetched[domain_key(table, missing[i])] = values;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            domains.insert(fetched.begin(), fetched.end());
+        }
+        if (!persist_path.empty()) {
+            save();
+        }
+    }
+
+    /*
+     * The persistence file is an Arrow IPC file with one row,
+     * a column "table.column" of type list<value type> per domain.
+     */
+    void DomainCatalog::save()
+    {
+        arrow::FieldVector fields;
+        arrow::ArrayVector columns;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& [key, values] : domains) {
+                arrow::Int32Builder offsets;
+                (void)offsets.AppendValues({0, static_cast<int32_t>(values->length())});
+                auto list = arrow::ListArray::FromArrays(*offsets.Finish().ValueOrDie(), *values).ValueOrDie();
+                columns.push_back(list);
+                fields.push_back(arrow::field(key, columns.back()->type()));
+            }
+        }
+        auto schema = arrow::schema(fields);
+        auto batch = arrow::RecordBatch::Make(schema, 1, columns);
+
+        // write to a temporary file first, a crash must not leave a truncated catalog
+        auto tmp_path = persist_path + ".tmp";
+        auto out = arrow::io::FileOutputStream::Open(tmp_path).ValueOrDie();
+        auto writer = arrow::ipc::MakeFileWriter(out, schema).ValueOrDie();
+        if (!writer->WriteRecordBatch(*batch).ok() || !writer->Close().ok() || !out->Close().ok()) {
+            std::cout << "Failed to save the domain catalog to " << persist_path << std::endl;
+            return;
+        }
+        std::filesystem::rename(tmp_path, persist_path);
+    }
+
+    void DomainCatalog::persist(const std::string& path)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            persist_path = path;
+        }
+        if (!std::filesystem::exists(path)) {
+            return;
+        }
+        auto file = arrow::io::ReadableFile::Open(path).ValueOrDie();
+        auto reader = arrow::ipc::RecordBatchFileReader::Open(file).ValueOrDie();
+        if (reader->num_record_batches() == 0) {
+            return;
+        }
+        auto batch = reader->ReadRecordBatch(0).ValueOrDie();
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = 0; i < batch->num_columns(); i++) {
+            auto list = std::static_pointer_cast<arrow::ListArray>(batch->column(i));
+            domains[batch->schema()->field(i)->name()] = list->value_slice(0);
+        }
+        std::cout << "Loaded " << batch->num_columns() << " domains from " << path << std::endl;
+    }
+
+    void DomainCatalog::clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        domains.clear();
+    }
+}
@@ -0,0 +1,191 @@
+#include "executor.h"
+
+#include <iostream>
+
+namespace pvd
+{
+    // index of the worker running on the current thread, -1 if not a worker thread
+    static thread_local int64_t current_worker = -1;
+    static thread_local Executor* current_executor = nullptr;
+    static thread_local Strand* current_strand = nullptr;
+
+    Executor::Executor(size_t num_threads) : next_worker(0), num_pending(0), stopping(false)
+    {
+        if (num_threads == 0) {
+            num_threads = 1;
+        }
+        for (size_t i = 0; i < num_threads; i++) {
+            workers.push_back(std::make_unique<Worker>());
+        }
+        for (size_t i = 0; i < num_threads; i++) {
+            threads.emplace_back([this, i]() { run(i); });
+        }
+    }
+
+    Executor::~Executor()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            stopping = true;
+        }
+        sleep_cv.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    size_t Executor::num_threads() const
+    {
+        return workers.size();
+    }
+
+    void Executor::submit(task_t task)
+    {
+        size_t target;
+        if (current_executor == this) {
+            // keep the task local to the submitting worker
+            target = current_worker;
+        }
+        else {
+            target = next_worker.fetch_add(1) % workers.size();
+        }
+        {
+            std::lock_guard<std::mutex> lock(workers[target]->mutex);
+            workers[target]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            num_pending++;
+        }
+        sleep_cv.notify_one();
+    }
+
+    Executor* Executor::current()
+    {
+        return current_executor;
+    }
+
+    bool Executor::pop_task(size_t self, task_t& task)
+    {
+        {
+            auto& own = *workers[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < workers.size(); i++) {
+            auto& victim = *workers[(self + i) % workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Executor::run(size_t self)
+    {
+        current_worker = self;
+        current_executor = this;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(sleep_mutex);
+                sleep_cv.wait(lock, [this]() { return stopping || num_pending > 0; });
+                if (stopping && num_pending == 0) {
+                    return;
+                }
+            }
+            task_t task;
+            if (!pop_task(self, task)) {
+                // another worker took it
+                std::this_thread::yield();
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> lock(sleep_mutex);
+                num_pending--;
+            }
+            try {
+                task();
+            }
+            catch (std::exception& e) {
+                std::cout << "Executor task failed: " << e.what() << std::endl;
+            }
+        }
+    }
+
+    void Strand::post(task_t task)
+    {
+        bool start;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+            start = !running;
+            running = true;
+        }
+        if (start) {
+            executor->submit([self = shared_from_this()]() { self->run_next(); });
+        }
+    }
+
+    void Strand::run_next()
+    {
+        task_t task;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        current_strand = this;
+        try {
+            task();
+        }
+        catch (std::exception& e) {
+            std::cout << "Strand task failed: " << e.what() << std::endl;
+        }
+        current_strand = nullptr;
+        bool more;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            more = !tasks.empty();
+            running = more;
+        }
+        if (more) {
+            // resubmit instead of looping, so that one busy strand does not starve the others
+            executor->submit([self = shared_from_this()]() { self->run_next(); });
+        }
+    }
+
+    std::shared_ptr<Strand> Strand::current()
+    {
+        return current_strand ? current_strand->shared_from_this() : nullptr;
+    }
+
+    Continuation Continuation::here()
+    {
+        Continuation continuation;
+        continuation.strand = Strand::current();
+        if (!continuation.strand) {
+            continuation.executor = Executor::current();
+        }
+        return continuation;
+    }
+
+    void Continuation::resume(task_t task) const
+    {
+        if (strand) {
+            strand->post(std::move(task));
+        }
+        else if (executor) {
+            executor->submit(std::move(task));
+        }
+        else {
+            task();
+        }
+    }
+}
@@ -24,6 +24,19 @@ namespace pvd
         return choices[binding.at(choice_id()).get_int()]->bind(binding);
     }
 
+    std::shared_ptr<Expression> AnyExpr::bind_params(const BindingMap& binding,
+                                                     std::vector<std::shared_ptr<arrow::Scalar>>& params) const
+    {
+        auto choice = choices[binding.at(choice_id()).get_int()];
+        // a choice among values is a parameter, a choice among expressions changes the query
+        if (std::dynamic_pointer_cast<IntConst>(choice) || std::dynamic_pointer_cast<FloatConst>(choice) ||
+            std::dynamic_pointer_cast<BoolConst>(choice)) {
+            params.push_back(std::dynamic_pointer_cast<Literal>(choice)->to_arrow_scalar());
+            return std::make_shared<Param>(params.size(), params.back(), choice_id());
+        }
+        return choice->bind_params(binding, params);
+    }
+
     std::vector<Binding> AnyExpr::all_choices()
     {
         std::vector<Binding> result;
@@ -0,0 +1,187 @@
+#include "expression.h"
+
+#include <memory>
+#include <arrow/compute/api.h>
+
+namespace pvd
+{
+    CompiledExpr::CompiledExpr(std::shared_ptr<Expression> expr) : expr(std::move(expr))
+    {
+        std::unordered_map<std::string, std::shared_ptr<ChoiceExpr>> choices;
+        try {
+            this->expr->get_all_choice_nodes(choices);
+        }
+        catch (const std::runtime_error&) {
+            // MultiExpr has no arrow expression, only SQL
+            compilable = false;
+            return;
+        }
+        for (auto& [id, choice] : choices) {
+            auto any = std::dynamic_pointer_cast<AnyExpr>(choice);
+            if (!any) {
+                // a ValExpr is always a parameter
+                continue;
+            }
+            std::vector<std::shared_ptr<arrow::Scalar>> scalars;
+            bool all_constant = true;
+            for (auto& option : any->choices) {
+                if (std::dynamic_pointer_cast<IntConst>(option) || std::dynamic_pointer_cast<FloatConst>(option) ||
+                    std::dynamic_pointer_cast<BoolConst>(option)) {
+                    scalars.push_back(std::dynamic_pointer_cast<Literal>(option)->to_arrow_scalar());
+                }
+                else {
+                    scalars.push_back(nullptr);
+                    all_constant = false;
+                }
+            }
+            if (!all_constant) {
+                structural_ids.push_back(id);
+            }
+            any_choices[id] = std::move(scalars);
+        }
+    }
+
+    // the scalar of the value bound to a ValExpr, of the same type as the bound literal
+    static std::shared_ptr<arrow::Scalar> binding_scalar(const Binding& binding)
+    {
+        if (binding.is_int()) {
+            return arrow::MakeScalar(static_cast<int64_t>(binding.get_int()));
+        }
+        else if (binding.is_float()) {
+            return arrow::MakeScalar(binding.get_float());
+        }
+        else if (binding.is_bool()) {
+            return arrow::MakeScalar(binding.get_bool());
+        }
+        else if (binding.is_string()) {
+            return arrow::MakeScalar(binding.get_string());
+        }
+        else {
+            throw std::runtime_error("invalid binding type for ValExpr");
+        }
+    }
+
+    // the parameters of a bound expression, by index
+    static void collect_params(const std::shared_ptr<Expression>& expr, std::vector<const Param*>& params)
+    {
+        if (auto param = std::dynamic_pointer_cast<Param>(expr)) {
+            params[param->index - 1] = param.get();
+        }
+        else if (auto op = std::dynamic_pointer_cast<Op>(expr)) {
+            for (auto& operand : op->operands) collect_params(operand, params);
+        }
+        else if (auto func = std::dynamic_pointer_cast<Func>(expr)) {
+            for (auto& argument : func->arguments) collect_params(argument, params);
+        }
+        else if (auto list = std::dynamic_pointer_cast<List>(expr)) {
+            for (auto& element : list->elements) collect_params(element, params);
+        }
+    }
+
+    cp::Expression CompiledExpr::to_arrow_expr(const BindingMap& binding)
+    {
+        if (!compilable) {
+            return expr->to_arrow_expr(binding);
+        }
+        FlatBinding key;
+        if (!structural_ids.empty()) {
+            BindingMap structure;
+            for (auto& id : structural_ids) {
+                auto it = binding.find(id);
+                if (it != binding.end()) structure.emplace(id, it->second);
+            }
+            key = FlatBinding(structure);
+        }
+
+        std::shared_ptr<Template> compiled;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = templates.find(key);
+            if (it != templates.end()) compiled = it->second;
+        }
+        if (!compiled) {
+            compiled = compile(binding);
+            std::lock_guard<std::mutex> lock(mutex);
+            templates.emplace(key, compiled);
+        }
+        if (compiled->slots.empty()) {
+            return compiled->root.constant;
+        }
+
+        std::vector<std::shared_ptr<arrow::Scalar>> scalars;
+        scalars.reserve(compiled->slots.size());
+        for (auto& slot : compiled->slots) {
+            auto& bound = binding.at(slot.choice_id);
+            scalars.push_back(slot.choices.empty() ? binding_scalar(bound) : slot.choices[bound.get_int()]);
+        }
+        return instantiate(compiled->root, scalars);
+    }
+
+    std::shared_ptr<CompiledExpr::Template> CompiledExpr::compile(const BindingMap& binding)
+    {
+        std::vector<std::shared_ptr<arrow::Scalar>> params;
+        auto bound = expr->bind_params(binding, params);
+
+        auto compiled = std::make_shared<Template>();
+        compiled->root = compile_node(bound->to_arrow_expr(), params);
+
+        std::vector<const Param*> found(params.size(), nullptr);
+        collect_params(bound, found);
+        for (auto param : found) {
+            Slot slot;
+            slot.choice_id = param->choice_id;
+            auto it = any_choices.find(param->choice_id);
+            if (it != any_choices.end()) {
+                slot.choices = it->second;
+            }
+            compiled->slots.push_back(std::move(slot));
+        }
+        return compiled;
+    }
+
+    CompiledExpr::Node CompiledExpr::compile_node(const cp::Expression& arrow_expr,
+                                                  const std::vector<std::shared_ptr<arrow::Scalar>>& params)
+    {
+        Node node;
+        if (auto literal = arrow_expr.literal()) {
+            // a parameter is the literal of the same scalar
+            for (int i = 0; i < params.size(); i++) {
+                if (literal->is_scalar() && literal->scalar().get() == params[i].get()) {
+                    node.param = i;
+                    return node;
+                }
+            }
+        }
+        else if (auto call = arrow_expr.call()) {
+            bool has_params = false;
+            for (auto& argument : call->arguments) {
+                node.arguments.push_back(compile_node(argument, params));
+                has_params |= node.arguments.back().param >= 0 || !node.arguments.back().arguments.empty();
+            }
+            if (has_params) {
+                node.function = call->function_name;
+                node.options = call->options;
+                return node;
+            }
+            node.arguments.clear();
+        }
+        node.constant = arrow_expr;
+        return node;
+    }
+
+    cp::Expression CompiledExpr::instantiate(const Node& node, const std::vector<std::shared_ptr<arrow::Scalar>>& scalars)
+    {
+        if (node.param >= 0) {
+            return cp::literal(scalars[node.param]);
+        }
+        if (node.arguments.empty()) {
+            return node.constant;
+        }
+        std::vector<cp::Expression> arguments;
+        arguments.reserve(node.arguments.size());
+        for (auto& argument : node.arguments) {
+            arguments.push_back(instantiate(argument, scalars));
+        }
+        return cp::call(node.function, std::move(arguments), node.options);
+    }
+}
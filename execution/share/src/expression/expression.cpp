@@ -10,4 +10,10 @@ namespace pvd
         auto bound_expr = bind(binding);
         return bound_expr->to_arrow_expr();
     }
+
+    std::shared_ptr<Expression> Expression::bind_params(const BindingMap& binding,
+                                                        std::vector<std::shared_ptr<arrow::Scalar>>& params) const
+    {
+        return bind(binding);
+    }
 }
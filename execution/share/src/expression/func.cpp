@@ -26,6 +26,17 @@ namespace pvd
         return std::make_shared<Func>(fname, new_arguments);
     }
 
+    std::shared_ptr<Expression> Func::bind_params(const BindingMap& binding,
+                                                  std::vector<std::shared_ptr<arrow::Scalar>>& params) const
+    {
+        std::vector<std::shared_ptr<Expression>> new_arguments;
+        for (auto operand : arguments)
+        {
+            new_arguments.push_back(operand->bind_params(binding, params));
+        }
+        return std::make_shared<Func>(fname, new_arguments);
+    }
+
     std::shared_ptr<Expression> Func::evaluate(const BindingMap& binding) const
     {
         // TODO: evaluate different functions
@@ -67,6 +78,13 @@ namespace pvd
         if (fname == "int") {
             return "CAST(" + arguments[0]->to_string() + " AS INTEGER)";
         }
+        if (fname == "count_distinct") {
+            return "count(DISTINCT " + arguments[0]->to_string() + ")";
+        }
+        if (fname == "median") {
+            // the median of Aggregate is approximate too
+            return "approx_quantile(" + arguments[0]->to_string() + ", 0.5)";
+        }
         std::string result = fname + "(";
         for (int i = 0; i < arguments.size(); i++)
         {
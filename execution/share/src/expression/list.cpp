@@ -34,6 +34,17 @@ namespace pvd
         return std::make_shared<List>(begin, end, delim, new_elements);
     }
 
+    std::shared_ptr<Expression> List::bind_params(const BindingMap& binding,
+                                                  std::vector<std::shared_ptr<arrow::Scalar>>& params) const
+    {
+        std::vector<std::shared_ptr<Expression>> new_elements;
+        for (auto element : elements)
+        {
+            new_elements.push_back(element->bind_params(binding, params));
+        }
+        return std::make_shared<List>(begin, end, delim, new_elements);
+    }
+
     std::shared_ptr<Expression> List::evaluate(const BindingMap& binding) const
     {
         std::vector<std::shared_ptr<Expression>> new_elements;
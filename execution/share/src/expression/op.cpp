@@ -27,6 +27,17 @@ namespace pvd
         return std::make_shared<Op>(op, new_operands);
     }
 
+    std::shared_ptr<Expression> Op::bind_params(const BindingMap& binding,
+                                                std::vector<std::shared_ptr<arrow::Scalar>>& params) const
+    {
+        std::vector<std::shared_ptr<Expression>> new_operands;
+        for (auto operand : operands)
+        {
+            new_operands.push_back(operand->bind_params(binding, params));
+        }
+        return std::make_shared<Op>(op, new_operands);
+    }
+
     void Op::pick_useful_binding(const BindingMap& binding, BindingMap& useful_binding)
     {
         for (auto operand : operands)
@@ -35,7 +46,7 @@ namespace pvd
         }
     }
 
-    static float get_float(std::shared_ptr<Expression> val)
+    static float get_float(const std::shared_ptr<Expression>& val)
     {
         auto int_val = std::dynamic_pointer_cast<IntConst>(val);
         auto float_val = std::dynamic_pointer_cast<FloatConst>(val);
@@ -48,10 +59,11 @@ namespace pvd
      * if both are int, return int
      * if at least one is float, return float
      */
-    static std::shared_ptr<Literal> evaluate_two_numerical(std::shared_ptr<Expression> val1,
-                                                           std::shared_ptr<Expression> val2,
-                                                           std::function<int(int, int)> int_op,
-                                                           std::function<float(float, float)> float_op)
+    template <typename IntOp, typename FloatOp>
+    static std::shared_ptr<Literal> evaluate_two_numerical(const std::shared_ptr<Expression>& val1,
+                                                           const std::shared_ptr<Expression>& val2,
+                                                           IntOp int_op,
+                                                           FloatOp float_op)
     {
         auto int_val1 = std::dynamic_pointer_cast<IntConst>(val1);
         auto int_val2 = std::dynamic_pointer_cast<IntConst>(val2);
@@ -68,11 +80,12 @@ namespace pvd
     }
 
     // const can be int, float, string
-    static std::shared_ptr<Literal> compare_two_const(std::shared_ptr<Expression> val1,
-                                                      std::shared_ptr<Expression> val2,
-                                                      std::function<bool(int, int)> int_op,
-                                                      std::function<bool(float, float)> float_op,
-                                                      std::function<bool(std::string, std::string)> string_op)
+    template <typename IntOp, typename FloatOp, typename StringOp>
+    static std::shared_ptr<Literal> compare_two_const(const std::shared_ptr<Expression>& val1,
+                                                      const std::shared_ptr<Expression>& val2,
+                                                      IntOp int_op,
+                                                      FloatOp float_op,
+                                                      StringOp string_op)
     {
         auto int_val1 = std::dynamic_pointer_cast<IntConst>(val1);
         auto int_val2 = std::dynamic_pointer_cast<IntConst>(val2);
@@ -100,7 +113,8 @@ namespace pvd
     std::shared_ptr<Expression> Op::evaluate(const BindingMap& binding) const
     {
         std::vector<std::shared_ptr<Expression>> args;
-        for (auto operand : operands)
+        args.reserve(operands.size());
+        for (auto& operand : operands)
         {
             args.push_back(operand->evaluate(binding));
         }
@@ -141,37 +155,37 @@ namespace pvd
                 return compare_two_const(args[0], args[1],
                                          [](int a, int b) { return a == b; },
                                          [](float a, float b) { return a == b; },
-                                         [](std::string a, std::string b) { return a == b; });
+                                         [](const std::string& a, const std::string& b) { return a == b; });
             }
             case Op::Operator::Ne: {
                 return compare_two_const(args[0], args[1],
                                          [](int a, int b) { return a != b; },
                                          [](float a, float b) { return a != b; },
-                                         [](std::string a, std::string b) { return a != b; });
+                                         [](const std::string& a, const std::string& b) { return a != b; });
             }
             case Op::Operator::Ge: {
                 return compare_two_const(args[0], args[1],
                                          [](int a, int b) { return a >= b; },
                                          [](float a, float b) { return a >= b; },
-                                         [](std::string a, std::string b) { return a >= b; });
+                                         [](const std::string& a, const std::string& b) { return a >= b; });
             }
             case Op::Operator::Gt: {
                 return compare_two_const(args[0], args[1],
                                          [](int a, int b) { return a > b; },
                                          [](float a, float b) { return a > b; },
-                                         [](std::string a, std::string b) { return a > b; });
+                                         [](const std::string& a, const std::string& b) { return a > b; });
             }
             case Op::Operator::Le: {
                 return compare_two_const(args[0], args[1],
                                          [](int a, int b) { return a <= b; },
                                          [](float a, float b) { return a <= b; },
-                                         [](std::string a, std::string b) { return a <= b; });
+                                         [](const std::string& a, const std::string& b) { return a <= b; });
             }
             case Op::Operator::Lt: {
                 return compare_two_const(args[0], args[1],
                                          [](int a, int b) { return a < b; },
                                          [](float a, float b) { return a < b; },
-                                         [](std::string a, std::string b) { return a < b; });
+                                         [](const std::string& a, const std::string& b) { return a < b; });
             }
             case Op::Operator::In: {
                 auto string_val = std::dynamic_pointer_cast<StringConst>(args[0]);
@@ -0,0 +1,42 @@
+#include "expression.h"
+
+#include <memory>
+#include <arrow/compute/api.h>
+
+namespace pvd
+{
+    Param::Param(int index, std::shared_ptr<arrow::Scalar> value, std::string choice_id)
+            : index(index), value(std::move(value)), choice_id(std::move(choice_id)) {}
+
+    void Param::get_all_choice_nodes(std::unordered_map<std::string, std::shared_ptr<ChoiceExpr>> &choice_nodes) {}
+
+    std::shared_ptr<Expression> Param::bind(const BindingMap& binding) const
+    {
+        return std::make_shared<Param>(index, value, choice_id);
+    }
+
+    void Param::pick_useful_binding(const BindingMap& binding, BindingMap& useful_binding)
+    {
+        // do nothing
+    }
+
+    std::shared_ptr<Expression> Param::evaluate(const BindingMap& binding) const
+    {
+        return std::make_shared<Param>(index, value, choice_id);
+    }
+
+    std::shared_ptr<arrow::Scalar> Param::to_arrow_scalar() const
+    {
+        return value;
+    }
+
+    cp::Expression Param::to_arrow_expr() const
+    {
+        return cp::literal(value);
+    }
+
+    std::string Param::to_string() const
+    {
+        return "$" + std::to_string(index);
+    }
+}
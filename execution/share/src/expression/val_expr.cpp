@@ -1,11 +1,10 @@
 #include "expression.h"
-#include "cloud_api.h"
+#include "domain.h"
 
 #include <memory>
 #include <arrow/compute/api.h>
 #include <iostream>
 #include <utility>
-#include <condition_variable>
 
 namespace pvd
 {
@@ -18,44 +17,68 @@ namespace pvd
         choice_nodes[_id] = std::make_shared<ValExpr>(_id, domain);
     }
 
-    std::vector<Binding> ValExpr::all_choices()
+    std::shared_ptr<ColumnRef> ValExpr::domain_column() const
     {
-        std::vector<Binding> result;
-
         if (auto func = std::dynamic_pointer_cast<Func>(domain)) {
             if (func->fname == "domain") {
                 if (auto col = std::dynamic_pointer_cast<ColumnRef>(func->arguments[0])) {
-                    cloud->query(
-                        "SELECT DISTINCT " + col->col + " FROM " + col->table,
-                        [&result](std::shared_ptr<ar::Table> table) {
-                            for (int i = 0; i < table->num_rows(); i++) {
-                                auto val = table->column(0)->GetScalar(i).ValueOrDie();
-                                switch (val->type->id()) {
-                                    case ar::Type::INT64: {
-                                        int64_t int_val = dynamic_pointer_cast<ar::Int64Scalar>(val)->value;
-                                        result.push_back(Binding(Binding::Kind::Int, int_val));
-                                        break;
-                                    }
-                                    case ar::Type::DOUBLE: {
-                                        float float_val = dynamic_pointer_cast<ar::FloatScalar>(val)->value;
-                                        result.push_back(Binding(float_val));
-                                        break;
-                                    }
-                                    case ar::Type::STRING: {
-                                        std::string str_val = dynamic_pointer_cast<ar::StringScalar>(val)->ToString();
-                                        result.push_back(Binding(str_val));
-                                        break;
-                                    }
-                                    default:
-                                        throw std::runtime_error("unsupported scalar type");
-                                }
-                            }
-                        });
-                    return result;
+                    return col;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    std::vector<Binding> ValExpr::all_choices()
+    {
+        auto col = domain_column();
+        if (!col) {
+            throw std::runtime_error("domain of is not a domain function");
+        }
+        auto values = DomainCatalog::instance().get(col->table, col->col);
+
+        std::vector<Binding> result;
+        result.reserve(values->length());
+        switch (values->type_id()) {
+            case ar::Type::INT64: {
+                auto& array = static_cast<const ar::Int64Array&>(*values);
+                for (int64_t i = 0; i < array.length(); i++) {
+                    result.push_back(Binding(Binding::Kind::Int, static_cast<int>(array.Value(i))));
+                }
+                break;
+            }
+            case ar::Type::INT32: {
+                auto& array = static_cast<const ar::Int32Array&>(*values);
+                for (int64_t i = 0; i < array.length(); i++) {
+                    result.push_back(Binding(Binding::Kind::Int, array.Value(i)));
+                }
+                break;
+            }
+            case ar::Type::DOUBLE: {
+                auto& array = static_cast<const ar::DoubleArray&>(*values);
+                for (int64_t i = 0; i < array.length(); i++) {
+                    result.push_back(Binding(static_cast<float>(array.Value(i))));
+                }
+                break;
+            }
+            case ar::Type::FLOAT: {
+                auto& array = static_cast<const ar::FloatArray&>(*values);
+                for (int64_t i = 0; i < array.length(); i++) {
+                    result.push_back(Binding(array.Value(i)));
+                }
+                break;
+            }
+            case ar::Type::STRING: {
+                auto& array = static_cast<const ar::StringArray&>(*values);
+                for (int64_t i = 0; i < array.length(); i++) {
+                    result.push_back(Binding(array.GetString(i)));
                 }
+                break;
             }
+            default:
+                throw std::runtime_error("unsupported scalar type");
         }
-        throw std::runtime_error("domain of is not a domain function");
+        return result;
     }
 
     std::shared_ptr<Expression> ValExpr::bind(const BindingMap& binding) const
@@ -78,6 +101,14 @@ namespace pvd
         }
     }
 
+    std::shared_ptr<Expression> ValExpr::bind_params(const BindingMap& binding,
+                                                     std::vector<std::shared_ptr<arrow::Scalar>>& params) const
+    {
+        auto bound = std::dynamic_pointer_cast<Literal>(bind(binding));
+        params.push_back(bound->to_arrow_scalar());
+        return std::make_shared<Param>(params.size(), params.back(), choice_id());
+    }
+
     std::shared_ptr<Expression> ValExpr::evaluate(const BindingMap& binding) const
     {
         auto bind = binding.at(choice_id());
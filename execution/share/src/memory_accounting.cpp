@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <cstdio>
+#if !defined(__EMSCRIPTEN__)
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include "memory_accounting.h"
+
+namespace pvd
+{
+    MemoryAccounting& MemoryAccounting::instance()
+    {
+        static MemoryAccounting accounting;
+        return accounting;
+    }
+
+    void MemoryAccounting::NodePool::allocated(int64_t bytes)
+    {
+        auto current = live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        auto max = peak.load(std::memory_order_relaxed);
+        while (current > max && !peak.compare_exchange_weak(max, current, std::memory_order_relaxed)) {
+        }
+    }
+
+    arrow::Status MemoryAccounting::NodePool::Allocate(int64_t size, int64_t alignment, uint8_t** out)
+    {
+        ARROW_RETURN_NOT_OK(arrow::default_memory_pool()->Allocate(size, alignment, out));
+        allocated(size);
+        total.fetch_add(size, std::memory_order_relaxed);
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        return arrow::Status::OK();
+    }
+
+    arrow::Status MemoryAccounting::NodePool::Reallocate(int64_t old_size, int64_t new_size, int64_t alignment,
+                                                         uint8_t** ptr)
+    {
+        ARROW_RETURN_NOT_OK(arrow::default_memory_pool()->Reallocate(old_size, new_size, alignment, ptr));
+        allocated(new_size - old_size);
+        if (new_size > old_size) {
+            total.fetch_add(new_size - old_size, std::memory_order_relaxed);
+        }
+        return arrow::Status::OK();
+    }
+
+    void MemoryAccounting::NodePool::Free(uint8_t* buffer, int64_t size, int64_t alignment)
+    {
+        arrow::default_memory_pool()->Free(buffer, size, alignment);
+        live.fetch_sub(size, std::memory_order_relaxed);
+    }
+
+    void MemoryAccounting::NodePool::reset()
+    {
+        peak = 0;
+        total = 0;
+        allocations = 0;
+    }
+
+    arrow::MemoryPool* MemoryAccounting::acquire()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // a released pool without live buffers is not read by anything anymore
+        auto it = std::find_if(released.begin(), released.end(),
+                               [](NodePool* pool) { return pool->bytes_allocated() == 0; });
+        if (it != released.end()) {
+            auto pool = *it;
+            released.erase(it);
+            pool->reset();
+            return pool;
+        }
+        pools.push_back(std::make_unique<NodePool>());
+        return pools.back().get();
+    }
+
+    void MemoryAccounting::release(arrow::MemoryPool* pool)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        released.push_back(static_cast<NodePool*>(pool));
+    }
+
+    static uint64_t retained_bytes(const arrow::ArrayData& data, BufferSet& counted)
+    {
+        uint64_t total = 0;
+        for (auto& buffer : data.buffers) {
+            if (!buffer) continue;
+            // the memory is owned by the root of the slices
+            const arrow::Buffer* root = buffer.get();
+            while (root->parent()) {
+                root = root->parent().get();
+            }
+            if (counted.insert(root).second) {
+                total += root->size();
+            }
+        }
+        for (auto& child : data.child_data) {
+            total += retained_bytes(*child, counted);
+        }
+        if (data.dictionary) {
+            total += retained_bytes(*data.dictionary, counted);
+        }
+        return total;
+    }
+
+    uint64_t retained_bytes(const arrow::Table& table, BufferSet& counted)
+    {
+        uint64_t total = 0;
+        for (auto& column : table.columns()) {
+            for (auto& chunk : column->chunks()) {
+                total += retained_bytes(*chunk->data(), counted);
+            }
+        }
+        return total;
+    }
+
+    int64_t current_rss_bytes()
+    {
+#if defined(__linux__)
+        long pages = 0;
+        if (auto file = std::fopen("/proc/self/statm", "r")) {
+            if (std::fscanf(file, "%*ld %ld", &pages) != 1) {
+                pages = 0;
+            }
+            std::fclose(file);
+        }
+        return static_cast<int64_t>(pages) * sysconf(_SC_PAGESIZE);
+#else
+        return 0;
+#endif
+    }
+
+    int64_t peak_rss_bytes()
+    {
+#if !defined(__EMSCRIPTEN__)
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) {
+            return 0;
+        }
+#if defined(__APPLE__)
+        return usage.ru_maxrss;
+#else
+        // kilobytes on linux
+        return static_cast<int64_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+        return 0;
+#endif
+    }
+}
@@ -4,34 +4,140 @@
 
 namespace pvd
 {
+    // the prepared declaration with the source in place of its empty input declaration
+    static ac::Declaration with_source(const ac::Declaration& plan, const ac::Declaration& source)
+    {
+        if (plan.factory_name.empty()) {
+            return source;
+        }
+        ac::Declaration result = plan;
+        for (auto& input : result.inputs) {
+            if (auto input_plan = std::get_if<ac::Declaration>(&input)) {
+                *input_plan = with_source(*input_plan, source);
+            }
+        }
+        return result;
+    }
+
+    ac::Declaration AceroPlan::prepare(const BindingMap& binding, ac::Declaration source)
+    {
+        std::unique_lock<std::mutex> lock(prepared_mutex);
+        if (!own_choices_known) {
+            own_choices_known = true;
+            std::unordered_map<std::string, std::shared_ptr<ChoiceExpr>> choices;
+            try {
+                for (auto& expr : plan_expressions()) {
+                    expr->get_all_choice_nodes(choices);
+                }
+            }
+            catch (const std::runtime_error&) {
+                // MultiExpr
+                preparable = false;
+            }
+            for (auto& [id, _] : choices) {
+                own_choice_ids.push_back(id);
+            }
+        }
+        if (!preparable) {
+            lock.unlock();
+            return build_plan(binding, std::move(source));
+        }
+
+        BindingMap own_binding;
+        for (auto& id : own_choice_ids) {
+            own_binding.emplace(id, binding.at(id));
+        }
+        FlatBinding key(own_binding);
+        auto it = prepared.find(key);
+        if (it != prepared.end()) {
+            prepared_order.splice(prepared_order.begin(), prepared_order, it->second);
+            return with_source(it->second->second, source);
+        }
+        lock.unlock();
+
+        auto plan = build_plan(binding, ac::Declaration());
+        lock.lock();
+        if (prepared.find(key) == prepared.end()) {
+            // evict the least recently used declaration
+            if (prepared.size() >= MAX_PREPARED) {
+                prepared.erase(prepared_order.back().first);
+                prepared_order.pop_back();
+            }
+            prepared_order.emplace_front(key, plan);
+            prepared.emplace(std::move(key), prepared_order.begin());
+        }
+        lock.unlock();
+        return with_source(plan, source);
+    }
+
+    bool AceroPlan::fuses_input() const
+    {
+        auto acero_input = std::dynamic_pointer_cast<AceroPlan>(input);
+        return acero_input && acero_input->num_parents == 1 && acero_input->fusable();
+    }
+
+    ac::Declaration AceroPlan::compile_input(const BindingMap& binding, std::shared_ptr<SerialData> data)
+    {
+        // a table, or a stream scanned while the plan runs
+        auto source = source_declaration(data, metrics, batch_size);
+        auto start = Metrics::get_time_us();
+        auto plan = prepare(binding, std::move(source));
+        metrics.plan_time_us = Metrics::get_time_us() - start;
+        return plan;
+    }
+
+    void AceroPlan::compile_inline(const BindingMap& binding, std::shared_ptr<ar::Table> table, compile_callback_t cb)
+    {
+        metrics.record_input(table);
+        if (auto output = execute_inline(binding, table)) {
+            cb(output, {});
+            return;
+        }
+        // no inline execution (e.g. Aggregate), the rest of the chain runs in Acero
+        cb(nullptr, compile_input(binding, std::make_shared<TableData>(table)));
+    }
+
     void AceroPlan::compile(const BindingMap& binding, compile_callback_t cb)
     {
-        /*
-        if (auto acero_input = std::dynamic_pointer_cast<AceroPlan>(input)) {
-            acero_input->compile(binding, [this, binding, cb](ac::Declaration input_plan) {
-                cb(this->build_plan(binding, std::move(input_plan)));
+        if (fuses_input()) {
+            // fuse the input pipeline, its output is not materialized
+            auto acero_input = std::static_pointer_cast<AceroPlan>(input);
+            acero_input->compile(binding, [this, binding, cb](std::shared_ptr<ar::Table> table, ac::Declaration input_plan) {
+                if (table) {
+                    compile_inline(binding, std::move(table), cb);
+                    return;
+                }
+                metrics.record_input(nullptr);
+                auto start = Metrics::get_time_us();
+                auto plan = prepare(binding, std::move(input_plan));
+                metrics.plan_time_us = Metrics::get_time_us() - start;
+                cb(nullptr, std::move(plan));
             });
+            return;
         }
-        else {
-         */
-            input->execute(binding, [this, binding, cb](std::shared_ptr<SerialData> data) {
-                //std::cout << "Acero compile data " << (unsigned long) data.get() << std::endl;
-                auto table = std::dynamic_pointer_cast<TableData>(data);
-                //std::cout << "Acero compile table " << (unsigned long) table->table->num_rows() << std::endl;
-                metrics.record_input(table->table);
-                auto table_source_option = ac::TableSourceNodeOptions{table->table, MAX_BATCH_SIZE};
-                auto source = ac::Declaration("table_source", {}, table_source_option);
-                cb(this->build_plan(binding, source));
-            });
-        //}
+        input->execute_shared(binding, [this, binding, cb](std::shared_ptr<SerialData> data) {
+            auto table = std::dynamic_pointer_cast<TableData>(data);
+            if (table && table->table->num_rows() <= inline_max_rows()) {
+                compile_inline(binding, table->table, cb);
+                return;
+            }
+            cb(nullptr, compile_input(binding, std::move(data)));
+        });
+    }
+
+    std::shared_ptr<ar::Table> AceroPlan::execute_inline(const BindingMap& binding, const std::shared_ptr<ar::Table>& input)
+    {
+        return nullptr;
     }
 
     void AceroPlan::execute(const BindingMap& binding, execute_callback_t cb)
     {
-        compile(binding, [this, cb](ac::Declaration plan) {
-            auto table = std::make_shared<TableData>(ac::DeclarationToTable(plan).ValueOrDie());
-            metrics.record_output(table->table);
-            cb(table);
+        compile(binding, [this, cb](std::shared_ptr<ar::Table> table, ac::Declaration plan) {
+            if (!table) {
+                table = declaration_to_table(std::move(plan), false, memory_pool());
+            }
+            metrics.record_output(table);
+            cb(std::make_shared<TableData>(table));
         });
     }
 }
@@ -1,12 +1,90 @@
+#include <cmath>
 #include <utility>
 
 #include "plan.h"
 #include "expression.h"
 #include "binding.h"
+#include "sketch.h"
 
 
 namespace pvd
 {
+    // the key of the single group of an aggregate without group by expressions
+    static const std::string ALL_ROWS_KEY = "__all_rows";
+
+    static bool is_sketch_aggregate(const std::string& fname)
+    {
+        return fname == "approx_count_distinct" || fname == "approx_quantile" ||
+               fname == "hll_state" || fname == "tdigest_state";
+    }
+
+    /*
+     * The arrow aggregate function of an aggregate: a hash_* function when the rows are grouped,
+     * else a scalar aggregate function, which gives one row (count 0, sum null...) for an empty input.
+     * The sketch aggregates collect the values of each group (hash_list), the sketches are built by
+     * finish_sketches: a group holds all its values until then, not only the state of its sketch.
+     */
+    static arrow::Aggregate acero_aggregate(const Func& func, const std::string& name, bool grouped)
+    {
+        auto& fname = func.fname;
+        std::string prefix = grouped ? "hash_" : "";
+        auto scalar_options = std::make_shared<cp::ScalarAggregateOptions>();
+        if (fname == "count" && func.arguments.empty()) {
+            // count() counts a literal 1
+            return {prefix + "count", std::make_shared<cp::CountOptions>(cp::CountOptions::ALL), name, name};
+        }
+        if (fname == "sum") {
+            return {prefix + "sum", scalar_options, name, name};
+        }
+        if (fname == "count") {
+            return {prefix + "count", std::make_shared<cp::CountOptions>(cp::CountOptions::ONLY_VALID), name, name};
+        }
+        if (fname == "avg") {
+            return {prefix + "mean", scalar_options, name, name};
+        }
+        if (fname == "min" || fname == "max") {
+            return {prefix + fname, scalar_options, name, name};
+        }
+        if (fname == "count_distinct") {
+            return {prefix + "count_distinct", std::make_shared<cp::CountOptions>(cp::CountOptions::ONLY_VALID), name, name};
+        }
+        if (fname == "stddev" || fname == "variance") {
+            // the sample statistics, as stddev / variance in SQL
+            return {prefix + fname, std::make_shared<cp::VarianceOptions>(/*ddof=*/1), name, name};
+        }
+        if (fname == "median") {
+            return {prefix + "approximate_median", scalar_options, name, name};
+        }
+        if (is_sketch_aggregate(fname)) {
+            // there is no scalar list function, an aggregate with sketches always has a key
+            return {"hash_list", nullptr, name, name};
+        }
+        throw std::runtime_error("aggregate function not supported: " + fname);
+    }
+
+    // the number of arguments of an aggregate function
+    static bool valid_arity(const Func& func)
+    {
+        if (func.fname == "count") {
+            return func.arguments.size() <= 1;
+        }
+        if (func.fname == "approx_quantile") {
+            return func.arguments.size() == 2;
+        }
+        return func.arguments.size() == 1;
+    }
+
+    // a constant argument of an aggregate function, e.g. the quantile of approx_quantile
+    static double constant_argument(const std::shared_ptr<Expression>& expr, const BindingMap& binding)
+    {
+        auto literal = std::dynamic_pointer_cast<Literal>(expr->evaluate(binding));
+        if (!literal) {
+            throw std::runtime_error("aggregate argument must be a constant: " + expr->to_string());
+        }
+        auto value = cp::Cast(ar::Datum(literal->to_arrow_scalar()), ar::float64()).ValueOrDie();
+        return std::static_pointer_cast<ar::DoubleScalar>(value.scalar())->value;
+    }
+
     Aggregate::Aggregate(int id,
                          std::shared_ptr<Plan> input,
                          std::vector<std::shared_ptr<Expression>> groupby_exprs,
@@ -15,6 +93,17 @@ namespace pvd
                          std::vector<std::string> aggregate_names)
             : AceroPlan(id, std::move(input)), groupby_exprs(groupby_exprs), aggregate_exprs(aggregate_exprs),
               groupby_names(groupby_names), aggregate_names(aggregate_names) {
+        for (auto& expr : this->groupby_exprs) {
+            compiled_groupby.push_back(std::make_shared<CompiledExpr>(expr));
+        }
+        for (int i = 0; i < this->aggregate_exprs.size(); i++) {
+            auto func = std::dynamic_pointer_cast<Func>(this->aggregate_exprs[i]);
+            bool has_argument = func && !func->arguments.empty();
+            compiled_aggregate_args.push_back(has_argument ? std::make_shared<CompiledExpr>(func->arguments[0]) : nullptr);
+            if (func && is_sketch_aggregate(func->fname)) {
+                sketch_aggregates.push_back(i);
+            }
+        }
         metrics.id = id;
         metrics.node = "Aggregate";
     }
@@ -29,21 +118,21 @@ namespace pvd
         std::vector<cp::Expression> proj_columns;
         std::vector<std::string> proj_names;
 
-        for (auto& expr : this->groupby_exprs) {
+        for (auto& expr : compiled_groupby) {
             proj_columns.push_back(expr->to_arrow_expr(binding));
         }
         proj_names.insert(proj_names.end(), this->groupby_names.begin(), this->groupby_names.end());
 
-        for (auto& expr : this->aggregate_exprs) {
-            if (auto func = std::dynamic_pointer_cast<Func>(expr)) {
-                if (func->arguments.size() == 1) {
-                    proj_columns.push_back(func->arguments[0]->to_arrow_expr(binding));
+        for (int i = 0; i < this->aggregate_exprs.size(); i++) {
+            if (auto func = std::dynamic_pointer_cast<Func>(this->aggregate_exprs[i])) {
+                if (!valid_arity(*func)) {
+                    throw std::runtime_error("Aggregate::to_acero_plan: wrong number of arguments of " + func->fname);
                 }
-                else if (func->fname == "count") {
-                    proj_columns.push_back(cp::literal(1));
+                if (compiled_aggregate_args[i]) {
+                    proj_columns.push_back(compiled_aggregate_args[i]->to_arrow_expr(binding));
                 }
                 else {
-                    throw std::runtime_error("Aggregate::to_acero_plan: aggregate function must have one argument");
+                    proj_columns.push_back(cp::literal(1));
                 }
             }
             else {
@@ -51,6 +140,13 @@ namespace pvd
             }
         }
         proj_names.insert(proj_names.end(), this->aggregate_names.begin(), this->aggregate_names.end());
+        // without group by, the scalar aggregate functions run on all the rows, the sketches need a
+        // key (hash_list) which all the rows share
+        bool all_rows_key = this->groupby_exprs.empty() && !sketch_aggregates.empty();
+        if (all_rows_key) {
+            proj_columns.push_back(cp::literal(true));
+            proj_names.push_back(ALL_ROWS_KEY);
+        }
 
         auto proj_option = ac::ProjectNodeOptions{proj_columns, proj_names};
         auto proj_plan = ac::Declaration("project", {input_plan}, proj_option);
@@ -64,29 +160,123 @@ namespace pvd
         for (int i = 0; i < n_groupby; i++) {
             keys.emplace_back(this->groupby_names[i]);
         }
+        if (all_rows_key) {
+            keys.emplace_back(ALL_ROWS_KEY);
+        }
         for (int i = 0; i < n_aggregate; i++) {
             auto func = std::dynamic_pointer_cast<Func>(this->aggregate_exprs[i]);
-            std::shared_ptr<cp::FunctionOptions> options;
-            std::string acero_fname;
-            if (func->fname == "count" || func->fname == "sum") {
-                options = std::make_shared<cp::ScalarAggregateOptions>();
-                acero_fname = "hash_sum";
-            }
-            else if (func->fname == "avg") {
-                options = std::make_shared<cp::ScalarAggregateOptions>();
-                acero_fname = "hash_mean";
-            }
-            else {
-                throw std::runtime_error("aggregate function not supported");
-            }
-            aggregates.emplace_back(acero_fname, options, this->aggregate_names[i], this->aggregate_names[i]);
+            aggregates.push_back(acero_aggregate(*func, this->aggregate_names[i], !keys.empty()));
         }
 
         auto aggregate_options = ac::AggregateNodeOptions{/*aggregates=*/aggregates, keys};
         ac::Declaration aggregate{
                 "aggregate", {std::move(proj_plan)}, std::move(aggregate_options)};
+        if (!all_rows_key) {
+            return aggregate;
+        }
+
+        // drop the key of the single group
+        std::vector<cp::Expression> output_columns;
+        for (auto& name : this->aggregate_names) {
+            output_columns.push_back(cp::field_ref(name));
+        }
+        return ac::Declaration("project", {std::move(aggregate)},
+                               ac::ProjectNodeOptions{output_columns, this->aggregate_names});
+    }
+
+    bool Aggregate::fusable() const
+    {
+        return sketch_aggregates.empty();
+    }
+
+    void Aggregate::execute(const BindingMap& binding, execute_callback_t cb)
+    {
+        if (sketch_aggregates.empty()) {
+            AceroPlan::execute(binding, std::move(cb));
+            return;
+        }
+        AceroPlan::execute(binding, [this, binding, cb](std::shared_ptr<SerialData> data) {
+            auto table = std::static_pointer_cast<TableData>(data)->table;
+            cb(std::make_shared<TableData>(finish_sketches(binding, std::move(table))));
+        });
+    }
+
+    std::shared_ptr<ar::Table> Aggregate::finish_sketches(const BindingMap& binding, std::shared_ptr<ar::Table> table) const
+    {
+        if (groupby_exprs.empty() && table->num_rows() == 0) {
+            // the key shared by all the rows has no group for an empty input, SQL still gives one row
+            table = empty_input_row(std::move(table));
+        }
+        for (int i : sketch_aggregates) {
+            auto func = std::static_pointer_cast<Func>(aggregate_exprs[i]);
+            auto& fname = func->fname;
+            double q = fname == "approx_quantile" ? constant_argument(func->arguments[1], binding) : 0;
+            int index = table->schema()->GetFieldIndex(aggregate_names[i]);
+
+            std::unique_ptr<ar::ArrayBuilder> builder;
+            if (fname == "approx_count_distinct") builder = std::make_unique<ar::Int64Builder>();
+            else if (fname == "approx_quantile") builder = std::make_unique<ar::DoubleBuilder>();
+            else builder = std::make_unique<ar::BinaryBuilder>();
+
+            for (auto& chunk : table->column(index)->chunks()) {
+                auto lists = std::static_pointer_cast<ar::ListArray>(chunk);
+                for (int64_t row = 0; row < lists->length(); row++) {
+                    if (lists->IsNull(row)) {
+                        (void)builder->AppendNull();
+                        continue;
+                    }
+                    auto values = lists->value_slice(row);
+                    if (fname == "approx_count_distinct") {
+                        auto estimate = std::llround(hyperloglog_of(*values).estimate());
+                        (void)static_cast<ar::Int64Builder&>(*builder).Append(estimate);
+                    }
+                    else if (fname == "approx_quantile") {
+                        auto value = tdigest_of(*values).quantile(q);
+                        auto& doubles = static_cast<ar::DoubleBuilder&>(*builder);
+                        (void)(std::isnan(value) ? doubles.AppendNull() : doubles.Append(value));
+                    }
+                    else {
+                        auto state = fname == "hll_state" ? hyperloglog_of(*values).serialize()
+                                                          : tdigest_of(*values).serialize();
+                        (void)static_cast<ar::BinaryBuilder&>(*builder).Append(state);
+                    }
+                }
+            }
+            auto result = builder->Finish().ValueOrDie();
+            auto field = ar::field(aggregate_names[i], result->type());
+            table = table->SetColumn(index, field, std::make_shared<ar::ChunkedArray>(result)).ValueOrDie();
+        }
+        return table;
+    }
+
+    std::shared_ptr<ar::Table> Aggregate::empty_input_row(std::shared_ptr<ar::Table> table) const
+    {
+        ar::ArrayVector columns;
+        for (int i = 0; i < aggregate_exprs.size(); i++) {
+            auto& fname = std::static_pointer_cast<Func>(aggregate_exprs[i])->fname;
+            auto type = table->schema()->field(i)->type();
+            std::shared_ptr<ar::Scalar> value;
+            if (fname == "count" || fname == "count_distinct") {
+                value = ar::MakeScalar(type, 0).ValueOrDie();
+            }
+            else if (is_sketch_aggregate(fname)) {
+                // the sketch of no value
+                auto values = ar::MakeEmptyArray(std::static_pointer_cast<ar::ListType>(type)->value_type()).ValueOrDie();
+                value = std::make_shared<ar::ListScalar>(values, type);
+            }
+            else {
+                value = ar::MakeNullScalar(type);
+            }
+            columns.push_back(ar::MakeArrayFromScalar(*value, 1).ValueOrDie());
+        }
+        return ar::Table::Make(table->schema(), columns, 1);
+    }
 
-        return aggregate;
+    std::vector<std::shared_ptr<Expression>> Aggregate::plan_expressions() const
+    {
+        auto exprs = groupby_exprs;
+        exprs.insert(exprs.end(), aggregate_exprs.begin(), aggregate_exprs.end());
+        return exprs;
     }
 
     void Aggregate::pick_useful_binding(const BindingMap& binding, BindingMap& useful_binding)
@@ -111,8 +301,20 @@ namespace pvd
         }
     }
 
+    // the sketch states have no SQL function (and neither has a quantile over them, above in the plan)
+    static void check_sql_aggregates(const std::vector<std::shared_ptr<Expression>>& aggregate_exprs)
+    {
+        for (auto& expr : aggregate_exprs) {
+            auto& fname = std::static_pointer_cast<Func>(expr)->fname;
+            if (fname == "hll_state" || fname == "tdigest_state") {
+                throw std::runtime_error("Aggregate " + fname + " has no SQL, it can not run in the database");
+            }
+        }
+    }
+
     std::string Aggregate::to_sql(const BindingMap& binding) const
     {
+        check_sql_aggregates(aggregate_exprs);
         std::string select_str;
         for (int i = 0; i < groupby_exprs.size(); i++) {
             select_str += groupby_exprs[i]->bind(binding)->to_string() + " AS " + groupby_names[i] + ", ";
@@ -126,7 +328,35 @@ namespace pvd
             if (i > 0) groupby_str += ", ";
             groupby_str += groupby_exprs[i]->bind(binding)->to_string();
         }
-        return "SELECT " + select_str + " FROM (" + input->to_sql(binding) + ") GROUP BY " + groupby_str;
+        auto sql = "SELECT " + select_str + " FROM (" + input->to_sql(binding) + ")";
+        if (!groupby_str.empty()) {
+            sql += " GROUP BY " + groupby_str;
+        }
+        return sql;
+    }
+
+    void Aggregate::to_sql_select(const BindingMap& binding, SqlSelect& select) const
+    {
+        check_sql_aggregates(aggregate_exprs);
+        input->to_sql_select(binding, select);
+        if (select.projected) {
+            select.wrap();
+        }
+        std::string select_str;
+        std::string groupby_str;
+        for (int i = 0; i < groupby_exprs.size(); i++) {
+            auto groupby = select.bind(groupby_exprs[i], binding);
+            select_str += groupby + " AS " + groupby_names[i] + ", ";
+            if (i > 0) groupby_str += ", ";
+            groupby_str += groupby;
+        }
+        for (int i = 0; i < aggregate_exprs.size(); i++) {
+            if (i > 0) select_str += ", ";
+            select_str += select.bind(aggregate_exprs[i], binding) + " AS " + aggregate_names[i];
+        }
+        select.select = select_str;
+        select.group_by = groupby_str;
+        select.projected = true;
     }
 
     std::string Aggregate::to_string() const
@@ -20,7 +20,12 @@ namespace pvd
     void AnyPlan::execute(const BindingMap& binding, execute_callback_t cb)
     {
         auto child = choices[binding.at(choice_id).get_index()];
-        child->execute(binding, cb);
+        child->execute_shared(binding, cb);
+    }
+
+    void AnyPlan::to_sql_select(const BindingMap& binding, SqlSelect& select) const
+    {
+        choices[binding.at(choice_id).get_index()]->to_sql_select(binding, select);
     }
 
     void AnyPlan::pick_useful_binding(const BindingMap& binding, BindingMap& useful_binding)
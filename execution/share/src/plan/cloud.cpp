@@ -5,6 +5,43 @@
 
 namespace pvd
 {
+    /*
+     * Forwards the batches of a cloud result and records the output metrics at the end of the stream
+     */
+    class RecordingReader : public ar::RecordBatchReader
+    {
+        std::shared_ptr<ar::RecordBatchReader> reader;
+        Metrics& metrics;
+        uint64_t num_rows = 0;
+        bool recorded = false;
+    public:
+        RecordingReader(std::shared_ptr<ar::RecordBatchReader> reader, Metrics& metrics)
+                : reader(std::move(reader)), metrics(metrics) {}
+
+        std::shared_ptr<ar::Schema> schema() const override
+        {
+            return reader->schema();
+        }
+
+        ar::Status ReadNext(std::shared_ptr<ar::RecordBatch>* batch) override
+        {
+            ARROW_RETURN_NOT_OK(reader->ReadNext(batch));
+            if (*batch) {
+                num_rows += (*batch)->num_rows();
+            }
+            else if (!recorded) {
+                recorded = true;
+                metrics.record_output(nullptr, 0, num_rows, reader->schema()->num_fields());
+            }
+            return ar::Status::OK();
+        }
+
+        ar::Status Close() override
+        {
+            return reader->Close();
+        }
+    };
+
     Cloud::Cloud(int id, std::shared_ptr<Plan> input)
             : Plan(id), input(input) {
         metrics.id = id;
@@ -19,9 +56,12 @@ namespace pvd
     void Cloud::execute(const BindingMap& binding, execute_callback_t cb)
     {
         metrics.record_input(nullptr);
-        cloud->query(to_sql(binding), [this, cb](std::shared_ptr<ar::Table> table) {
-            metrics.record_output(table);
-            cb(std::make_shared<TableData>(table));
+        // the SQL only depends on the structure of the chosen plan, the bound values are parameters
+        std::vector<std::shared_ptr<ar::Scalar>> params;
+        auto sql = to_param_sql(binding, params);
+        cloud->query_stream(sql, params, [this, cb](std::shared_ptr<ar::RecordBatchReader> reader) {
+            // the output is recorded when the stream has been read
+            cb(std::make_shared<StreamData>(std::make_shared<RecordingReader>(std::move(reader), metrics)));
         });
     }
 
@@ -40,6 +80,14 @@ namespace pvd
         return input->to_sql(binding);
     }
 
+    std::string Cloud::to_param_sql(const BindingMap& binding, std::vector<std::shared_ptr<ar::Scalar>>& params) const
+    {
+        SqlSelect select;
+        input->to_sql_select(binding, select);
+        params = std::move(select.params);
+        return select.to_string();
+    }
+
     std::string Cloud::to_string() const
     {
         return "Cloud[" + std::to_string(id) + "]\n|\n" + input->to_string();
@@ -43,16 +43,83 @@ namespace pvd
 
     uint64_t TableData::size()
     {
-        uint64_t total_size = 0;
-        for (int i = 0; i < table->num_columns(); ++i) {
-            auto col = table->column(i);
-            for (int j = 0; j < col->num_chunks(); ++j) {
-                auto chunk = col->chunk(j);
-                for (auto& buf : chunk->data()->buffers)
-                    if (buf)
-                        total_size += buf->size();
+        BufferSet counted;
+        return retained_size(counted);
+    }
+
+    uint64_t TableData::retained_size(BufferSet& counted)
+    {
+        return retained_bytes(*table, counted);
+    }
+
+    void StreamData::serialize(std::shared_ptr<ar::io::BufferOutputStream> out)
+    {
+        auto writer = ar::ipc::MakeStreamWriter(out, reader->schema()).ValueOrDie();
+        int64_t num_rows = 0;
+        while (true) {
+            auto batch = reader->Next();
+            if (!batch.ok()) {
+                check_cancelled();
+                throw std::runtime_error(batch.status().ToString());
             }
+            if (!*batch) break;
+            num_rows += (*batch)->num_rows();
+            { auto _ = writer->WriteRecordBatch(**batch); }
+        }
+        std::cout << "Serializing " << num_rows << " rows" << std::endl;
+        { auto _ = writer->Close(); }
+    }
+
+    void StreamData::deserialize(std::shared_ptr<ar::io::BufferReader> buffer)
+    {
+        throw std::runtime_error("StreamData can not be deserialized");
+    }
+
+    uint64_t StreamData::size()
+    {
+        return 0;
+    }
+
+    std::shared_ptr<TableData> StreamData::to_table()
+    {
+        auto table = reader->ToTable();
+        if (!table.ok()) {
+            check_cancelled();
+            throw std::runtime_error(table.status().ToString());
+        }
+        if ((*table)->num_columns() == 0 || (*table)->num_rows() == 0) {
+            return std::make_shared<TableData>(empty_table_from_schema(reader->schema()));
+        }
+        return std::make_shared<TableData>(table.MoveValueUnsafe());
+    }
+
+    std::shared_ptr<SerialData> materialize(std::shared_ptr<SerialData> data)
+    {
+        if (auto stream = std::dynamic_pointer_cast<StreamData>(data)) {
+            return stream->to_table();
+        }
+        return data;
+    }
+
+    std::shared_ptr<TableData> materialize_table(std::shared_ptr<SerialData> data)
+    {
+        if (auto stream = std::dynamic_pointer_cast<StreamData>(data)) {
+            return stream->to_table();
+        }
+        return std::dynamic_pointer_cast<TableData>(data);
+    }
+
+    ac::Declaration source_declaration(std::shared_ptr<SerialData> data, Metrics& metrics, int64_t batch_size)
+    {
+        if (auto stream = std::dynamic_pointer_cast<StreamData>(data)) {
+            // the plan runs while the source is still being scanned
+            metrics.record_input(nullptr);
+            auto source_option = ac::RecordBatchReaderSourceNodeOptions{stream->reader};
+            return ac::Declaration("record_batch_reader_source", {}, source_option);
         }
-        return total_size;
+        auto table = std::dynamic_pointer_cast<TableData>(data);
+        metrics.record_input(table->table);
+        auto table_source_option = ac::TableSourceNodeOptions{table->table, batch_size_or_default(batch_size)};
+        return ac::Declaration("table_source", {}, table_source_option);
     }
 }
@@ -4,7 +4,7 @@
 namespace pvd
 {
     DCache::DCache(int id, std::shared_ptr<Plan> input) :
-            Plan(id), input(input), data(nullptr), current_binding({}) {
+            Plan(id), input(input), data(nullptr) {
         metrics.id = id;
         metrics.node = "DCache";
     }
@@ -18,13 +18,16 @@ namespace pvd
     {
         BindingMap useful_binding;
         input->pick_useful_binding(binding, useful_binding);
+        FlatBinding flat(useful_binding);
 
-        if (data == nullptr || current_binding != useful_binding) {
-            this->current_binding = useful_binding;
-            input->execute(binding, [this, cb](std::shared_ptr<SerialData> output) {
+        if (data == nullptr || current_binding != flat) {
+            // only remember the binding once its result arrives, a cancelled execution must not leave stale data
+            input->execute_shared(binding, [this, useful_binding = std::move(flat), cb](std::shared_ptr<SerialData> output) {
+                output = materialize(std::move(output));
                 metrics.record_input(nullptr);
                 metrics.record_output(nullptr, output->size());
                 //std::cout << "Return from record_output" << std::endl;
+                this->current_binding = useful_binding;
                 this->data = std::move(output);
                 //std::cout << "Return from DCache" << std::endl;
                 cb(this->data);
@@ -35,6 +38,16 @@ namespace pvd
         }
     }
 
+    CacheMemory DCache::cache_memory(BufferSet& counted)
+    {
+        CacheMemory memory;
+        if (data) {
+            memory.num_bindings = 1;
+            memory.retained_bytes = memory.max_binding_bytes = data->retained_size(counted);
+        }
+        return memory;
+    }
+
     void DCache::pick_useful_binding(const BindingMap& binding, BindingMap& useful_binding)
     {
         input->pick_useful_binding(binding, useful_binding);
@@ -9,6 +9,7 @@ namespace pvd
     Filter::Filter(int id, std::shared_ptr<Plan> input,
                    std::shared_ptr<Expression> cond_expr)
             : AceroPlan(id, input), cond_expr(std::move(cond_expr)) {
+        compiled_cond = std::make_shared<CompiledExpr>(this->cond_expr);
         metrics.id = id;
         metrics.node = "Filter";
     }
@@ -20,7 +21,7 @@ namespace pvd
 
     ac::Declaration Filter::build_plan(const BindingMap& binding, ac::Declaration input_plan)
     {
-        auto cond = this->cond_expr->to_arrow_expr(binding);
+        auto cond = compiled_cond->to_arrow_expr(binding);
         //std::cout << "Filter condition: " << cond.ToString() << std::endl;
         auto option = ac::FilterNodeOptions{cond};
         auto acero_plan = ac::Declaration("filter", {input_plan}, option);
@@ -28,6 +29,16 @@ namespace pvd
         return acero_plan;
     }
 
+    std::shared_ptr<ar::Table> Filter::execute_inline(const BindingMap& binding, const std::shared_ptr<ar::Table>& input)
+    {
+        return filter_table(input, compiled_cond->to_arrow_expr(binding), memory_pool());
+    }
+
+    std::vector<std::shared_ptr<Expression>> Filter::plan_expressions() const
+    {
+        return {cond_expr};
+    }
+
     void Filter::pick_useful_binding(const BindingMap& binding, BindingMap& useful_binding)
     {
         input->pick_useful_binding(binding, useful_binding);
@@ -45,6 +56,16 @@ namespace pvd
         return "SELECT * FROM (" + input->to_sql(binding) + ") WHERE " + cond_expr->bind(binding)->to_string();
     }
 
+    void Filter::to_sql_select(const BindingMap& binding, SqlSelect& select) const
+    {
+        input->to_sql_select(binding, select);
+        if (select.projected) {
+            // the condition may refer to the projected names
+            select.wrap();
+        }
+        select.where.push_back(select.bind(cond_expr, binding));
+    }
+
     std::string Filter::to_string() const
     {
         return "Filter[" + std::to_string(id) + "]{" + cond_expr->to_string() + "}\n|\n" + input->to_string();
@@ -4,17 +4,32 @@
 
 namespace pvd
 {
-    std::unordered_map<int, std::shared_ptr<Plan>> id_to_plan;
+    /*
+     * Structural hash of a plan node: its own json without the id and the inputs,
+     * combined with the fingerprints of its inputs
+     */
+    static uint64_t plan_fingerprint(const json& plan, const std::vector<std::shared_ptr<Plan>>& inputs)
+    {
+        json node = plan;
+        node.erase("id");
+        node.erase("input");
+        node.erase("choices");
+        uint64_t seed = hash_str(node.dump());
+        for (auto& input : inputs) {
+            seed ^= input->fingerprint + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2);
+        }
+        return seed;
+    }
 
-    std::shared_ptr<Plan> parse_json_plan(const json& plan)
+    static std::shared_ptr<Plan> parse_json_node(const json& plan, PlanContext& context)
     {
         int id = plan["id"];
-        if (id_to_plan.find(id) != id_to_plan.end()) {
-            return id_to_plan[id];
+        if (context.nodes.find(id) != context.nodes.end()) {
+            return context.nodes[id];
         }
         std::shared_ptr<Plan> p;
         if (plan["type"] == "Projection") {
-            auto input = parse_json_plan(plan["input"]);
+            auto input = parse_json_node(plan["input"], context);
             auto names = std::vector<std::string>();
             auto exprs = std::vector<std::shared_ptr<Expression>>();
             for (auto proj : plan["projs"]) {
@@ -24,12 +39,12 @@ namespace pvd
             p = std::make_shared<Projection>(id, input, exprs, names);
         }
         else if (plan["type"] == "Filter") {
-            auto input = parse_json_plan(plan["input"]);
+            auto input = parse_json_node(plan["input"], context);
             auto expr = parse_json_expression(plan["cond"]);
             p = std::make_shared<Filter>(id, input, expr);
         }
         else if (plan["type"] == "Aggregate") {
-            auto input = parse_json_plan(plan["input"]);
+            auto input = parse_json_node(plan["input"], context);
             auto groupby_exprs = std::vector<std::shared_ptr<Expression>>();
             auto groupby_names = std::vector<std::string>();
             auto aggregate_exprs = std::vector<std::shared_ptr<Expression>>();
@@ -49,23 +64,36 @@ namespace pvd
             p = std::make_shared<TableSource>(id, name);
         }
         else if (plan["type"] == "Network") {
-            auto input = parse_json_plan(plan["input"]);
+            auto input = parse_json_node(plan["input"], context);
             p = std::make_shared<Network>(id, input);
         }
         else if (plan["type"] == "Cloud") {
-            auto input = parse_json_plan(plan["input"]);
+            auto input = parse_json_node(plan["input"], context);
             p = std::make_shared<Cloud>(id, input);
         }
         else if (plan["type"] == "SCache") {
-            auto input = parse_json_plan(plan["input"]);
-            p = std::make_shared<SCache>(id, input);
+            auto input = parse_json_node(plan["input"], context);
+            // share the cached data of an alive SCache of another session if the subplans are identical,
+            // the node and its input stay the ones of this session
+            auto fingerprint = plan_fingerprint(plan, {input});
+            std::shared_ptr<SCacheStore> store = nullptr;
+            if (context.shared_scaches) {
+                auto& shared = (*context.shared_scaches)[fingerprint];
+                store = shared.lock();
+                if (store == nullptr) {
+                    store = std::make_shared<SCacheStore>();
+                    shared = store;
+                }
+            }
+            p = std::make_shared<SCache>(id, input, store);
+            p->fingerprint = fingerprint;
         }
         else if (plan["type"] == "DCache") {
-            auto input = parse_json_plan(plan["input"]);
+            auto input = parse_json_node(plan["input"], context);
             p = std::make_shared<DCache>(id, input);
         }
         else if (plan["type"] == "HashTableBuild") {
-            auto input = parse_json_plan(plan["input"]);
+            auto input = parse_json_node(plan["input"], context);
             auto keys = std::vector<std::shared_ptr<Expression>>();
             for (auto key : plan["keys"]) {
                 keys.push_back(parse_json_expression(key));
@@ -73,7 +101,7 @@ namespace pvd
             p = std::make_shared<HashTableBuild>(id, input, keys);
         }
         else if (plan["type"] == "HashTableQuery") {
-            auto input = parse_json_plan(plan["input"]);
+            auto input = parse_json_node(plan["input"], context);
             auto keys = std::vector<std::shared_ptr<Expression>>();
             auto queries = std::vector<std::shared_ptr<Expression>>();
             for (auto query : plan["queries"]) {
@@ -82,7 +110,7 @@ namespace pvd
             p = std::make_shared<HashTableQuery>(id, input, queries);
         }
         else if (plan["type"] == "RTreeBuild") {
-            auto input = parse_json_plan(plan["input"]);
+            auto input = parse_json_node(plan["input"], context);
             auto keys = std::vector<std::shared_ptr<Expression>>();
             for (auto key : plan["keys"]) {
                 keys.push_back(parse_json_expression(key));
@@ -90,7 +118,7 @@ namespace pvd
             p = std::make_shared<RTreeBuild>(id, input, keys);
         }
         else if (plan["type"] == "RTreeQuery") {
-            auto input = parse_json_plan(plan["input"]);
+            auto input = parse_json_node(plan["input"], context);
             auto keys = std::vector<std::shared_ptr<Expression>>();
             auto lowers = std::vector<std::shared_ptr<Expression>>();
             auto uppers = std::vector<std::shared_ptr<Expression>>();
@@ -103,7 +131,7 @@ namespace pvd
             p = std::make_shared<RTreeQuery>(id, input, lowers, uppers);
         }
         else if (plan["type"] == "PrefixSumBuild") {
-            auto input = parse_json_plan(plan["input"]);
+            auto input = parse_json_node(plan["input"], context);
             std::string sum_col_name = plan["sum_col"]["name"];
             std::string target_col_name = plan["target_col"]["name"];
             std::string agg_col_name = plan["agg_col"]["name"];
@@ -116,13 +144,13 @@ namespace pvd
                                                  agg_col, agg_col_name);
         }
         else if (plan["type"] == "PrefixSumQuery") {
-            auto input = parse_json_plan(plan["input"]);
+            auto input = parse_json_node(plan["input"], context);
             auto lower = parse_json_expression(plan["lower"]);
             auto upper = parse_json_expression(plan["upper"]);
             p = std::make_shared<PrefixSumQuery>(id, input, lower, upper);
         }
         else if (plan["type"] == "PrefixSum2DBuild") {
-            auto input = parse_json_plan(plan["input"]);
+            auto input = parse_json_node(plan["input"], context);
             std::string sum_col_x_name = plan["sum_col_x"]["name"];
             std::string sum_col_y_name = plan["sum_col_y"]["name"];
             std::string target_col_name = plan["target_col"]["name"];
@@ -138,7 +166,7 @@ namespace pvd
                                                    agg_col, agg_col_name);
         }
         else if (plan["type"] == "PrefixSum2DQuery") {
-            auto input = parse_json_plan(plan["input"]);
+            auto input = parse_json_node(plan["input"], context);
             auto lower_x = parse_json_expression(plan["lower_x"]);
             auto upper_x = parse_json_expression(plan["upper_x"]);
             auto lower_y = parse_json_expression(plan["lower_y"]);
@@ -149,14 +177,36 @@ namespace pvd
             std::string cid = plan["choice_id"];
             std::vector<std::shared_ptr<Plan>> choices;
             for (auto choice : plan["choices"]) {
-                choices.push_back(parse_json_plan(choice));
+                choices.push_back(parse_json_node(choice, context));
             }
             p = std::make_shared<AnyPlan>(id, cid, choices);
         }
         else {
             throw std::runtime_error("Unknown plan type");
         }
-        id_to_plan[id] = p;
+        if (p->fingerprint == 0) {
+            p->fingerprint = plan_fingerprint(plan, p->input_plans());
+        }
+        for (auto& input : p->input_plans()) {
+            input->num_parents++;
+        }
+        if (plan.contains("batch_size")) {
+            p->batch_size = plan["batch_size"];
+        }
+        context.nodes[id] = p;
         return p;
     }
+
+    std::shared_ptr<Plan> parse_json_plan(const json& plan, PlanContext& context)
+    {
+        auto root = parse_json_node(plan, context);
+        root->index = std::make_shared<PlanIndex>(root);
+        return root;
+    }
+
+    std::shared_ptr<Plan> parse_json_plan(const json& plan)
+    {
+        PlanContext context;
+        return parse_json_plan(plan, context);
+    }
 }
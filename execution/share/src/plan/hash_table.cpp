@@ -51,10 +51,17 @@ namespace pvd
 
     uint64_t HashTableImpl::size()
     {
+        BufferSet counted;
+        return retained_size(counted);
+    }
+
+    uint64_t HashTableImpl::retained_size(BufferSet& counted)
+    {
+        // the partitions of a received hash table are slices of the same reply
         uint64_t total_size = 0;
         for (const auto& [key, data] : *table) {
             total_size += sizeof(key);
-            total_size += data->size();
+            total_size += data->retained_size(counted);
         }
         return total_size;
     }
@@ -70,8 +77,9 @@ namespace pvd
 
     void HashTableBuild::execute(const BindingMap& binding, execute_callback_t cb)
     {
-        input->execute(binding, [this, cb](std::shared_ptr<SerialData> data) {
-            std::shared_ptr<TableData> table = std::dynamic_pointer_cast<TableData>(data);
+        input->execute_shared(binding, [this, cb](std::shared_ptr<SerialData> data) {
+            // the rows of the input are kept in the data structure
+            std::shared_ptr<TableData> table = materialize_table(data);
             metrics.record_input(table->table);
 
             std::vector<ar::Expression> ar_keys;
@@ -79,11 +87,12 @@ namespace pvd
                 ar_keys.push_back(key->to_arrow_expr());
             }
 
-            auto table_source_option = ac::TableSourceNodeOptions{table->table, MAX_BATCH_SIZE};
+            auto table_source_option = ac::TableSourceNodeOptions{table->table, batch_size_or_default(batch_size)};
             auto source = ac::Declaration("table_source", {}, table_source_option);
             auto proj_option = ac::ProjectNodeOptions{ar_keys};
             auto calc_keys = ac::Declaration("project", {source}, proj_option);
-            auto keys_value = ac::DeclarationToTable(calc_keys).ValueOrDie();
+            // the keys are matched with the rows of the table by position
+            auto keys_value = declaration_to_table(calc_keys, true, memory_pool());
 
             std::unordered_map<uint64_t, std::vector<int64_t>> tmp_ht;
 
@@ -155,7 +164,7 @@ namespace pvd
 
     void HashTableQuery::execute(const BindingMap& binding, execute_callback_t cb)
     {
-        input->execute(binding, [this, binding, cb](std::shared_ptr<SerialData> data) {
+        input->execute_shared(binding, [this, binding, cb](std::shared_ptr<SerialData> data) {
             //std::cout << "Executing HashTableQuery" << std::endl;
             std::shared_ptr<HashTableImpl> hashtable = std::dynamic_pointer_cast<HashTableImpl>(data);
             //std::cout << "Executing HashTableQuery " << hashtable->table->size() << std::endl;
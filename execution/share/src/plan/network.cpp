@@ -19,46 +19,60 @@ namespace pvd
 
     void Network::execute(const BindingMap& binding, execute_callback_t cb)
     {
+        metrics.record_input(nullptr);
+        auto on_reply = [this, cb](Reply reply) { receive(reply, cb); };
+        // inside a batch, the query is sent to the server together with the other nodes of the batch
+        auto batch = ExecutionBatch::current();
+        if (batch && batch->defer_remote(input->id, binding, on_reply)) {
+            return;
+        }
+
         json binding_json;
         binding_to_json(binding, binding_json);
         std::string binding_str = binding_json.dump();
-        Query query = {Query::Execute, input->id, static_cast<int64_t>(binding_str.size() + 1)};
+        Query query = {Query::Execute, input->id, static_cast<int64_t>(binding_str.size() + 1), ViewExecution::current_view()};
+        SENDER->send(query, (void*)binding_str.c_str(), on_reply);
+    }
 
-        metrics.record_input(nullptr);
-        SENDER->send(query, (void*)binding_str.c_str(), [this, cb](Reply reply) {
-            auto builder = ar::BufferBuilder();
-            std::cout << "Network::execute: " << reply.size << std::endl;
-            { auto _ = builder.Append((void*) reply.data, reply.size); }
-            auto buffer = builder.Finish().ValueOrDie();
-            auto reader = std::make_shared<ar::io::BufferReader>(buffer);
-            auto node = input;
-            while (std::dynamic_pointer_cast<DCache>(node) || std::dynamic_pointer_cast<SCache>(node)) {
-                node = node->input_plans()[0];
-            }
-            if (auto hashtable = std::dynamic_pointer_cast<HashTableBuild>(node)) {
-                auto ht_impl = std::make_shared<HashTableImpl>();
-                ht_impl->deserialize(reader);
-                metrics.record_output(nullptr, ht_impl->size());
-                cb(ht_impl);
-            } else if (auto prefixsum = std::dynamic_pointer_cast<PrefixSumBuild>(node)) {
-                auto prefixsum_impl = std::make_shared<PrefixSumImpl>();
-                prefixsum_impl->deserialize(reader);
-                metrics.record_output(nullptr, prefixsum_impl->size(), prefixsum_impl->target_col_data->table->num_rows(),
-                                      prefixsum_impl->sum_col_data->table->num_rows());
-                cb(prefixsum_impl);
-            } else if (auto prefixsum2d = std::dynamic_pointer_cast<PrefixSum2DBuild>(node)) {
-                auto prefixsum2d_impl = std::make_shared<PrefixSum2DImpl>();
-                prefixsum2d_impl->deserialize(reader);
-                metrics.record_output(nullptr, prefixsum2d_impl->size(), prefixsum2d_impl->target_col_data->table->num_rows(),
-                                      prefixsum2d_impl->sum_col_x_data->table->num_rows() * prefixsum2d_impl->sum_col_y_data->table->num_rows());
-                cb(prefixsum2d_impl);
-            } else {
-                auto table = std::make_shared<TableData>();
-                table->deserialize(reader);
-                metrics.record_output(table->table);
-                cb(table);
-            }
-        });
+    void Network::receive(Reply reply, execute_callback_t cb)
+    {
+        if (!reply.ok()) {
+            // no result, the execution of the view ends here
+            ViewExecution::abort_current(reply);
+            return;
+        }
+        auto builder = ar::BufferBuilder();
+        std::cout << "Network::execute: " << reply.size << std::endl;
+        { auto _ = builder.Append((void*) reply.data, reply.size); }
+        auto buffer = builder.Finish().ValueOrDie();
+        auto reader = std::make_shared<ar::io::BufferReader>(buffer);
+        auto node = input;
+        while (std::dynamic_pointer_cast<DCache>(node) || std::dynamic_pointer_cast<SCache>(node)) {
+            node = node->input_plans()[0];
+        }
+        if (auto hashtable = std::dynamic_pointer_cast<HashTableBuild>(node)) {
+            auto ht_impl = std::make_shared<HashTableImpl>();
+            ht_impl->deserialize(reader);
+            metrics.record_output(nullptr, ht_impl->size());
+            cb(ht_impl);
+        } else if (auto prefixsum = std::dynamic_pointer_cast<PrefixSumBuild>(node)) {
+            auto prefixsum_impl = std::make_shared<PrefixSumImpl>();
+            prefixsum_impl->deserialize(reader);
+            metrics.record_output(nullptr, prefixsum_impl->size(), prefixsum_impl->target_col_data->table->num_rows(),
+                                  prefixsum_impl->sum_col_data->table->num_rows());
+            cb(prefixsum_impl);
+        } else if (auto prefixsum2d = std::dynamic_pointer_cast<PrefixSum2DBuild>(node)) {
+            auto prefixsum2d_impl = std::make_shared<PrefixSum2DImpl>();
+            prefixsum2d_impl->deserialize(reader);
+            metrics.record_output(nullptr, prefixsum2d_impl->size(), prefixsum2d_impl->target_col_data->table->num_rows(),
+                                  prefixsum2d_impl->sum_col_x_data->table->num_rows() * prefixsum2d_impl->sum_col_y_data->table->num_rows());
+            cb(prefixsum2d_impl);
+        } else {
+            auto table = std::make_shared<TableData>();
+            table->deserialize(reader);
+            metrics.record_output(table->table);
+            cb(table);
+        }
     }
 
     void Network::pick_useful_binding(const BindingMap& binding, BindingMap& useful_binding)
@@ -2,10 +2,27 @@
 
 namespace pvd 
 {
-    Plan::Plan(int id) : id(id) {};
+    Plan::Plan(int id) : id(id), fingerprint(0)
+    {
+        metrics.id = id;
+    }
+
+    Plan::~Plan()
+    {
+        if (auto current = pool.load(std::memory_order_acquire)) {
+            MemoryAccounting::instance().release(current);
+        }
+    }
 
     void Plan::execute_subplan(const BindingMap& binding, int id, execute_callback_t cb)
     {
+        if (index) {
+            // compiled plan, ids that are not in the plan are ignored
+            if (auto plan = index->find(id)) {
+                plan->execute(binding, std::move(cb));
+            }
+            return;
+        }
         if (this->id != id) {
             // not executing the current node, executing one of the child node
             for (auto& input : input_plans()) {
@@ -20,11 +37,76 @@ namespace pvd
         }
     }
 
+    ar::MemoryPool* Plan::memory_pool()
+    {
+        auto current = pool.load(std::memory_order_acquire);
+        if (!current) {
+            auto created = MemoryAccounting::instance().acquire();
+            if (pool.compare_exchange_strong(current, created, std::memory_order_acq_rel)) {
+                current = created;
+            }
+            else {
+                // created by a concurrent first call
+                MemoryAccounting::instance().release(created);
+            }
+        }
+        return current;
+    }
+
+    std::string Plan::label() const
+    {
+        return (metrics.node.empty() ? "Plan" : metrics.node) + "[" + std::to_string(id) + "]";
+    }
+
+    void Plan::execute_shared(const BindingMap& binding, execute_callback_t cb)
+    {
+        if (Tracer::instance().is_enabled()) {
+            // the execution span of the node, the spans of its inputs nest in it
+            cb = [this, start = Metrics::get_time(), cb = std::move(cb)](std::shared_ptr<SerialData> data) {
+                metrics.record_execute(start);
+                cb(std::move(data));
+            };
+        }
+        if (auto batch = ExecutionBatch::current()) {
+            batch->execute(this, binding, std::move(cb));
+        }
+        else {
+            execute(binding, std::move(cb));
+        }
+    }
+
+    task<std::shared_ptr<SerialData>> Plan::execute_async(BindingMap binding, std::shared_ptr<ExecutionBatch> batch)
+    {
+        auto token = current_cancel_token();
+        co_return co_await callback<std::shared_ptr<SerialData>>([&](execute_callback_t cb) {
+            if (token) {
+                // the task resumes in cb, maybe on another thread: it keeps the token of its execution
+                cb = [token, cb = std::move(cb)](std::shared_ptr<SerialData> data) {
+                    CancelScope scope(token);
+                    cb(std::move(data));
+                };
+            }
+            if (batch) {
+                // the batch is only current while the execution starts, the task may suspend
+                BatchScope scope(batch);
+                execute_shared(binding, std::move(cb));
+            }
+            else {
+                execute(binding, std::move(cb));
+            }
+        });
+    }
+
+    void Plan::to_sql_select(const BindingMap& binding, SqlSelect& select) const
+    {
+        select.from = "(" + to_sql(binding) + ")";
+    }
+
     void Plan::_initialize(build_callback_t cb, std::vector<std::shared_ptr<Plan>> inputs)
     {
         if (inputs.size() == 0) {
             if (!SENDER && !at_server()) {
-                cb();
+                cb(nullptr);
                 return;
             }
             // no more inputs to initialize
@@ -32,19 +114,26 @@ namespace pvd
                 scache->cache_data(cb);
             }
             else {
-                cb();
+                cb(nullptr);
             }
         }
         else {
             auto input = inputs[0];
             auto other_inputs = std::vector<std::shared_ptr<Plan>>(inputs.begin() + 1, inputs.end());
-            input->initialize([this, cb, other_inputs]() {
+            input->initialize([this, cb, other_inputs](std::exception_ptr error) {
+                if (error) {
+                    cb(error);
+                    return;
+                }
                 this->_initialize(cb, other_inputs);
             });
         }
     }
 
     bool Plan::at_server() const {
+        if (placement >= 0) {
+            return placement == 1;
+        }
         if (dynamic_cast<const Network*>(this)) {
             return false;
         }
@@ -56,11 +145,15 @@ namespace pvd
         }
     }
 
-    void Plan::initialize(build_callback_t cb)
+    void Plan::initialize(build_callback_t cb, Executor* executor)
     {
+        if (index) {
+            index->initialize(std::move(cb), executor);
+            return;
+        }
         // SENDER is nullptr <=> this is server-Side
         if (SENDER && dynamic_cast<Network*>(this)) {
-            cb();
+            cb(nullptr);
             return;
         }
         std::vector<std::shared_ptr<Plan>> inputs = input_plans();
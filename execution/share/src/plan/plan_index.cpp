@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <numeric>
+
+#include "plan.h"
+#include "executor.h"
+
+namespace pvd
+{
+    static int32_t find_set(std::vector<int32_t>& sets, int32_t i)
+    {
+        while (sets[i] != i) {
+            sets[i] = sets[sets[i]];
+            i = sets[i];
+        }
+        return i;
+    }
+
+    // the SCaches whose subtrees share a node, in the post order of the first SCache of each group
+    static std::vector<std::vector<SCache*>> group_scaches(const std::vector<PlanIndex::Node>& nodes,
+                                                           const std::vector<std::vector<int32_t>>& children,
+                                                           const std::vector<int32_t>& scaches)
+    {
+        std::vector<int32_t> sets(nodes.size());
+        std::iota(sets.begin(), sets.end(), 0);
+        std::vector<int32_t> stack;
+        for (int32_t scache : scaches) {
+            stack.assign(children[scache].begin(), children[scache].end());
+            while (!stack.empty()) {
+                int32_t node = stack.back();
+                stack.pop_back();
+                int32_t a = find_set(sets, scache), b = find_set(sets, node);
+                // the subtree of a node in the set is in the set too
+                if (a == b) continue;
+                sets[b] = a;
+                stack.insert(stack.end(), children[node].begin(), children[node].end());
+            }
+        }
+        std::vector<std::vector<SCache*>> groups;
+        std::unordered_map<int32_t, size_t> group_of;
+        for (int32_t scache : scaches) {
+            auto [it, inserted] = group_of.emplace(find_set(sets, scache), groups.size());
+            if (inserted) {
+                groups.emplace_back();
+            }
+            groups[it->second].push_back(static_cast<SCache*>(nodes[scache].plan));
+        }
+        return groups;
+    }
+
+    PlanIndex::PlanIndex(const std::shared_ptr<Plan>& root)
+    {
+        // iterative post order, a node read by several plans is visited once
+        struct Frame
+        {
+            Plan* plan;
+            std::vector<std::shared_ptr<Plan>> inputs;
+            size_t next = 0;
+        };
+        std::vector<std::vector<int32_t>> children;
+        std::vector<Frame> stack;
+        stack.push_back({root.get(), root->input_plans()});
+        indices[root->id] = -1;
+        while (!stack.empty()) {
+            auto& frame = stack.back();
+            if (frame.next < frame.inputs.size()) {
+                auto input = frame.inputs[frame.next++].get();
+                if (indices.emplace(input->id, -1).second) {
+                    stack.push_back({input, input->input_plans()});
+                }
+                continue;
+            }
+            int32_t index = static_cast<int32_t>(nodes.size());
+            bool at_server;
+            if (dynamic_cast<const Network*>(frame.plan)) {
+                at_server = false;
+            }
+            else if (frame.inputs.empty()) {
+                at_server = true;
+            }
+            else {
+                at_server = nodes[indices.at(frame.inputs[0]->id)].at_server;
+            }
+            frame.plan->placement = at_server ? 1 : 0;
+            nodes.push_back({frame.plan, -1, at_server, false});
+            indices[frame.plan->id] = index;
+            children.emplace_back();
+            for (auto& input : frame.inputs) {
+                int32_t child = indices.at(input->id);
+                if (nodes[child].parent == -1) {
+                    nodes[child].parent = index;
+                }
+                children.back().push_back(child);
+            }
+            stack.pop_back();
+        }
+
+        // the client stops at the Network nodes, parents come before their inputs in reverse post order
+        auto& top = nodes.back();
+        top.client_side = !dynamic_cast<const Network*>(top.plan);
+        for (int32_t i = static_cast<int32_t>(nodes.size()) - 1; i >= 0; i--) {
+            if (!nodes[i].client_side) continue;
+            for (int32_t child : children[i]) {
+                nodes[child].client_side = nodes[child].client_side || !dynamic_cast<const Network*>(nodes[child].plan);
+            }
+        }
+
+        std::vector<int32_t> client_scaches, server_scaches;
+        for (int32_t i = 0; i < static_cast<int32_t>(nodes.size()); i++) {
+            if (dynamic_cast<SCache*>(nodes[i].plan)) {
+                if (nodes[i].client_side) client_scaches.push_back(i);
+                if (nodes[i].at_server) server_scaches.push_back(i);
+            }
+        }
+        client_groups = group_scaches(nodes, children, client_scaches);
+        server_groups = group_scaches(nodes, children, server_scaches);
+    }
+
+    int32_t PlanIndex::index_of(int id) const
+    {
+        auto it = indices.find(id);
+        return it == indices.end() ? -1 : it->second;
+    }
+
+    Plan* PlanIndex::find(int id) const
+    {
+        auto it = indices.find(id);
+        return it == indices.end() ? nullptr : nodes[it->second].plan;
+    }
+
+    void PlanIndex::initialize(build_callback_t cb, Executor* executor) const
+    {
+        // SENDER is nullptr <=> this is server-Side
+        auto& side = SENDER ? client_groups : server_groups;
+        if (side.empty()) {
+            cb(nullptr);
+            return;
+        }
+        struct Join
+        {
+            std::atomic<size_t> remaining;
+            std::vector<std::exception_ptr> errors;
+        };
+        auto join = std::make_shared<Join>();
+        join->remaining = side.size();
+        join->errors.resize(side.size());
+        // the last group to finish calls cb, with the error of the first group that failed
+        auto done = [join, cb](size_t i) {
+            return [join, cb, i](std::exception_ptr error) {
+                join->errors[i] = error;
+                if (join->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    auto failed = std::find_if(join->errors.begin(), join->errors.end(),
+                                               [](auto& e) { return e != nullptr; });
+                    cb(failed == join->errors.end() ? nullptr : *failed);
+                }
+            };
+        };
+        if (executor && !SENDER && side.size() > 1) {
+            // the other groups are built by the workers, the calling thread builds the first one
+            for (size_t i = 1; i < side.size(); i++) {
+                executor->submit([self = shared_from_this(), &group = side[i], cb = done(i)]() {
+                    self->initialize(group, 0, cb);
+                });
+            }
+            initialize(side[0], 0, done(0));
+            return;
+        }
+        for (size_t i = 0; i < side.size(); i++) {
+            initialize(side[i], 0, done(i));
+        }
+    }
+
+    void PlanIndex::initialize(const std::vector<SCache*>& scaches, size_t i, build_callback_t cb) const
+    {
+        if (i == scaches.size()) {
+            cb(nullptr);
+            return;
+        }
+        // the index lives until the last SCache is built
+        scaches[i]->cache_data([self = shared_from_this(), &scaches, i, cb = std::move(cb)](std::exception_ptr error) {
+            if (error) {
+                cb(error);
+                return;
+            }
+            self->initialize(scaches, i + 1, cb);
+        });
+    }
+}
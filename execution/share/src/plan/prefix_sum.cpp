@@ -126,11 +126,9 @@ namespace pvd
 
     void PrefixSumBuild::execute(const BindingMap& binding, execute_callback_t cb)
     {
-        input->execute(binding, [this, binding, cb](std::shared_ptr<SerialData> data) {
-            std::shared_ptr<TableData> table = std::dynamic_pointer_cast<TableData>(data);
-            metrics.record_input(table->table);
-            auto table_source_option = ac::TableSourceNodeOptions{table->table, MAX_BATCH_SIZE};
-            auto source = ac::Declaration("table_source", {}, table_source_option);
+        input->execute_shared(binding, [this, binding, cb](std::shared_ptr<SerialData> data) {
+            // only the aggregate of the input is kept, a stream is aggregated while it is scanned
+            auto source = source_declaration(data, metrics, batch_size);
 
             std::vector<cp::Expression> proj_columns = {sum_col->bind(binding)->to_arrow_expr(),
                                                         target_col->bind(binding)->to_arrow_expr(),
@@ -147,7 +145,7 @@ namespace pvd
 
             ac::Declaration aggregate{"aggregate", {std::move(proj_plan)}, std::move(aggregate_options)};
 
-            auto aggregate_table = ac::DeclarationToTable(aggregate).ValueOrDie();
+            auto aggregate_table = declaration_to_table(aggregate, false, memory_pool());
 
             auto sum_col_data = aggregate_table->column(0);
             auto target_col_data = aggregate_table->column(1);
@@ -261,7 +259,7 @@ namespace pvd
 
     void PrefixSumQuery::execute(const BindingMap& binding, execute_callback_t cb)
     {
-        input->execute(binding, [this, binding, cb](std::shared_ptr<SerialData> data) {
+        input->execute_shared(binding, [this, binding, cb](std::shared_ptr<SerialData> data) {
             std::shared_ptr<PrefixSumImpl> prefix_sum = std::dynamic_pointer_cast<PrefixSumImpl>(data);
             metrics.record_input(nullptr, prefix_sum->target_col_data->table->num_rows(), prefix_sum->sum_col_data->table->num_rows());
 
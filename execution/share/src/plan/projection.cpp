@@ -9,6 +9,9 @@ namespace pvd
                            std::vector<std::shared_ptr<Expression>> proj_exprs,
                            std::vector<std::string> proj_names)
             : AceroPlan(id, input), proj_exprs(proj_exprs), proj_names(proj_names) {
+        for (auto& expr : this->proj_exprs) {
+            compiled_projs.push_back(std::make_shared<CompiledExpr>(expr));
+        }
         metrics.id = id;
         metrics.node = "Projection";
     }
@@ -21,7 +24,7 @@ namespace pvd
     ac::Declaration Projection::build_plan(const BindingMap& binding, ac::Declaration input_plan)
     {
         auto arrow_projs = std::vector<cp::Expression>{};
-        for (auto& expr : proj_exprs) {
+        for (auto& expr : compiled_projs) {
             arrow_projs.push_back(expr->to_arrow_expr(binding));
         }
         auto option = ac::ProjectNodeOptions{arrow_projs, proj_names};
@@ -29,6 +32,20 @@ namespace pvd
         return acero_plan;
     }
 
+    std::shared_ptr<ar::Table> Projection::execute_inline(const BindingMap& binding, const std::shared_ptr<ar::Table>& input)
+    {
+        std::vector<cp::Expression> arrow_projs;
+        for (auto& expr : compiled_projs) {
+            arrow_projs.push_back(expr->to_arrow_expr(binding));
+        }
+        return project_table(input, arrow_projs, proj_names, memory_pool());
+    }
+
+    std::vector<std::shared_ptr<Expression>> Projection::plan_expressions() const
+    {
+        return proj_exprs;
+    }
+
     void Projection::pick_useful_binding(const BindingMap& binding, BindingMap& useful_binding)
     {
         input->pick_useful_binding(binding, useful_binding);
@@ -55,6 +72,21 @@ namespace pvd
         return "SELECT " + select_str + " FROM (" + input->to_sql(binding) + ")";
     }
 
+    void Projection::to_sql_select(const BindingMap& binding, SqlSelect& select) const
+    {
+        input->to_sql_select(binding, select);
+        if (select.projected) {
+            select.wrap();
+        }
+        std::string select_str;
+        for (int i = 0; i < proj_exprs.size(); i++) {
+            if (i > 0) select_str += ", ";
+            select_str += select.bind(proj_exprs[i], binding) + " AS " + proj_names[i];
+        }
+        select.select = select_str;
+        select.projected = true;
+    }
+
     std::string Projection::to_string() const
     {
         std::string projs;
@@ -87,8 +87,9 @@ namespace pvd
 
     void RTreeBuild::execute(const BindingMap& binding, execute_callback_t cb)
     {
-        input->execute(binding, [this, cb](std::shared_ptr<SerialData> data) {
-            std::shared_ptr<TableData> table = std::dynamic_pointer_cast<TableData>(data);
+        input->execute_shared(binding, [this, cb](std::shared_ptr<SerialData> data) {
+            // the rows of the input are kept in the data structure
+            std::shared_ptr<TableData> table = materialize_table(data);
             metrics.record_input(table->table);
 
             std::vector<ar::Expression> ar_keys;
@@ -96,11 +97,12 @@ namespace pvd
                 ar_keys.push_back(key->to_arrow_expr());
             }
 
-            auto table_source_option = ac::TableSourceNodeOptions{table->table, MAX_BATCH_SIZE};
+            auto table_source_option = ac::TableSourceNodeOptions{table->table, batch_size_or_default(batch_size)};
             auto source = ac::Declaration("table_source", {}, table_source_option);
             auto proj_option = ac::ProjectNodeOptions{ar_keys};
             auto calc_keys = ac::Declaration("project", {source}, proj_option);
-            auto keys_value = ac::DeclarationToTable(calc_keys).ValueOrDie();
+            // the keys are matched with the rows of the table by position
+            auto keys_value = declaration_to_table(calc_keys, true, memory_pool());
 
             RTreeImpl::RTree_T rtree;
             int dim = keys.size();
@@ -181,7 +183,7 @@ namespace pvd
 
     void RTreeQuery::execute(const BindingMap& binding, execute_callback_t cb)
     {
-        input->execute(binding, [this, binding, cb](std::shared_ptr<SerialData> data) {
+        input->execute_shared(binding, [this, binding, cb](std::shared_ptr<SerialData> data) {
             std::shared_ptr<RTreeImpl> rtree = std::dynamic_pointer_cast<RTreeImpl>(data);
             metrics.record_input(rtree->table->table);
 
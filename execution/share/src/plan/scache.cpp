@@ -1,10 +1,12 @@
 #include "plan.h"
 #include "binding.h"
+#include "domain.h"
 
 
 namespace pvd
 {
-    SCache::SCache(int id, std::shared_ptr<Plan> input) : Plan(id), input(input) {
+    SCache::SCache(int id, std::shared_ptr<Plan> input, std::shared_ptr<SCacheStore> store)
+        : Plan(id), input(input), store(store ? std::move(store) : std::make_shared<SCacheStore>()) {
         metrics.id = id;
         metrics.node = "SCache";
     }
@@ -16,8 +18,8 @@ namespace pvd
 
     std::vector<BindingMap> get_all_binding(
             int current,
-            std::vector<std::string> &ids,
-            std::unordered_map<std::string, std::shared_ptr<ChoiceExpr>> choices)
+            const std::vector<std::string> &ids,
+            const std::unordered_map<std::string, std::shared_ptr<ChoiceExpr>>& choices)
     {
         std::vector<BindingMap> bindings;
         if (current == ids.size()) {
@@ -25,56 +27,147 @@ namespace pvd
         }
         else {
             auto sub_bindings = get_all_binding(current + 1, ids, choices);
-            auto choice = choices[ids[current]];
-            for (auto& binding : choice->all_choices()) {
+            auto all_choices = choices.at(ids[current])->all_choices();
+            bindings.reserve(all_choices.size() * sub_bindings.size());
+            for (auto& binding : all_choices) {
                 for (auto& sub_binding : sub_bindings) {
-                    auto new_binding = sub_binding;
-                    new_binding.insert(std::make_pair(ids[current], binding));
-                    bindings.emplace_back(std::move(new_binding));
+                    auto& new_binding = bindings.emplace_back(sub_binding);
+                    new_binding.emplace(ids[current], binding);
                 }
             }
         }
         return bindings;
     }
 
+    bool SCache::finish_build(const build_callback_t& cb, std::exception_ptr error)
+    {
+        std::vector<std::pair<build_callback_t, Continuation>> waiters;
+        {
+            std::lock_guard<std::mutex> lock(store->mutex);
+            if (!store->caching) {
+                // finished already, the error comes from the code after the build
+                return false;
+            }
+            // a failed build is dropped, the next initialization builds it again
+            store->cached = !error;
+            store->caching = false;
+            if (error) {
+                store->data.clear();
+            }
+            waiters.swap(store->waiters);
+        }
+        for (auto& [waiter, continuation] : waiters) {
+            continuation.resume([waiter, error]() { waiter(error); });
+        }
+        cb(error);
+        return true;
+    }
+
     void SCache::_cache_data(build_callback_t cb, std::shared_ptr<std::vector<BindingMap>> bindings, int i)
     {
         //std::cout << "SCache Caching " << i << "/" << bindings->size() << std::endl;
 
         if (i == bindings->size()) {
-            cb();
+            finish_build(cb, nullptr);
+            return;
         }
-        else {
+        try {
             input->execute(bindings->at(i), [this, bindings, cb, i](std::shared_ptr<SerialData> output) {
-                this->data[hash_binding(bindings->at(i))] = output;
-                metrics.record_input(nullptr);
-                metrics.record_output(nullptr, output->size());
+                try {
+                    output = materialize(std::move(output));
+                    store->data[FlatBinding(bindings->at(i))] = output;
+                    metrics.record_input(nullptr);
+                    metrics.record_output(nullptr, output->size());
+                }
+                catch (...) {
+                    finish_build(cb, std::current_exception());
+                    return;
+                }
                 _cache_data(cb, bindings, i + 1);
             });
         }
+        catch (...) {
+            if (!finish_build(cb, std::current_exception())) {
+                throw;
+            }
+        }
+    }
+
+    bool SCache::is_cached() const
+    {
+        std::lock_guard<std::mutex> lock(store->mutex);
+        return store->cached;
     }
 
     void SCache::cache_data(build_callback_t cb)
     {
+        // the store may be shared by several sessions, only build it once
+        {
+            std::unique_lock<std::mutex> lock(store->mutex);
+            if (store->cached) {
+                lock.unlock();
+                cb(nullptr);
+                return;
+            }
+            if (store->caching) {
+                // another session is building it, continue on the strand of this one when the build finishes
+                store->waiters.emplace_back(cb, Continuation::here());
+                return;
+            }
+            store->caching = true;
+        }
         //std::cout << "SCache Caching" << std::endl;
         std::unordered_map<std::string, std::shared_ptr<ChoiceExpr>> choices;
         input->get_all_choice_nodes(choices);
         std::vector<std::string> choice_ids;
+        // the domains of the choices are fetched together, one query per table
+        std::map<std::string, std::vector<std::string>> domain_columns;
         for (auto& choice : choices) {
             choice_ids.push_back(choice.first);
+            if (auto val = std::dynamic_pointer_cast<ValExpr>(choice.second)) {
+                if (auto col = val->domain_column()) {
+                    domain_columns[col->table].push_back(col->col);
+                }
+            }
+        }
+        std::shared_ptr<std::vector<BindingMap>> all_bindings;
+        try {
+            DomainCatalog::instance().prefetch(domain_columns);
+            all_bindings = std::make_shared<std::vector<BindingMap>>(get_all_binding(0, choice_ids, choices));
+        }
+        catch (...) {
+            finish_build(cb, std::current_exception());
+            return;
         }
-        auto all_bindings = std::make_shared<std::vector<BindingMap>>(get_all_binding(0, choice_ids, choices));
 
         _cache_data(cb, all_bindings, 0);
     }
 
+    CacheMemory SCache::cache_memory(BufferSet& counted)
+    {
+        CacheMemory memory;
+        if (!is_cached()) {
+            // being built
+            return memory;
+        }
+        for (auto& [_, output] : store->data) {
+            auto bytes = output->retained_size(counted);
+            memory.num_bindings++;
+            memory.retained_bytes += bytes;
+            memory.max_binding_bytes = std::max(memory.max_binding_bytes, bytes);
+        }
+        return memory;
+    }
+
     void SCache::execute(const BindingMap& binding, execute_callback_t cb)
     {
+        if (!is_cached()) {
+            throw std::runtime_error("SCache[" + std::to_string(id) + "] is not built");
+        }
         BindingMap useful_binding;
         input->pick_useful_binding(binding, useful_binding);
-        auto hash = hash_binding(useful_binding);
         //std::cout << "SCache Executed" << std::endl;
-        cb(data.at(hash));
+        cb(store->data.at(FlatBinding(useful_binding)));
     }
 
     void SCache::pick_useful_binding(const BindingMap& binding, BindingMap& useful_binding)
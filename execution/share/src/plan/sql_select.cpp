@@ -0,0 +1,30 @@
+#include "plan.h"
+
+namespace pvd
+{
+    std::string SqlSelect::bind(const std::shared_ptr<Expression>& expr, const BindingMap& binding)
+    {
+        return expr->bind_params(binding, params)->to_string();
+    }
+
+    void SqlSelect::wrap()
+    {
+        from = "(" + to_string() + ")";
+        select = "*";
+        where.clear();
+        group_by.clear();
+        projected = false;
+    }
+
+    std::string SqlSelect::to_string() const
+    {
+        std::string sql = "SELECT " + select + " FROM " + from;
+        for (int i = 0; i < where.size(); i++) {
+            sql += (i == 0 ? " WHERE (" : " AND (") + where[i] + ")";
+        }
+        if (!group_by.empty()) {
+            sql += " GROUP BY " + group_by;
+        }
+        return sql;
+    }
+}
@@ -33,6 +33,11 @@ namespace pvd
         return "SELECT * FROM " + table_name;
     }
 
+    void TableSource::to_sql_select(const BindingMap& binding, SqlSelect& select) const
+    {
+        select.from = table_name;
+    }
+
     std::string TableSource::to_string() const
     {
         return "TableSource[" + std::to_string(id) + "]{" + table_name + "}";
@@ -0,0 +1,338 @@
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numbers>
+
+#include "sketch.h"
+
+namespace pvd
+{
+    // the finalizer of splitmix64, spreads the bits of integers and doubles over the hash
+    static uint64_t mix64(uint64_t x)
+    {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111eb;
+        x ^= x >> 31;
+        return x;
+    }
+
+    static uint64_t hash_bytes(std::string_view bytes)
+    {
+        // FNV-1a
+        uint64_t hash = 0xcbf29ce484222325;
+        for (unsigned char c : bytes) {
+            hash ^= c;
+            hash *= 0x100000001b3;
+        }
+        return mix64(hash);
+    }
+
+    static uint64_t hash_double(double value)
+    {
+        if (value == 0) {
+            // -0.0 == 0.0
+            value = 0;
+        }
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return mix64(bits);
+    }
+
+    template <typename T>
+    static void append(std::string& out, T value)
+    {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    static T read(std::string_view data, size_t& offset)
+    {
+        if (offset + sizeof(T) > data.size()) {
+            throw std::runtime_error("Truncated sketch");
+        }
+        T value;
+        std::memcpy(&value, data.data() + offset, sizeof(T));
+        offset += sizeof(T);
+        return value;
+    }
+
+    HyperLogLog::HyperLogLog(int precision) : precision(precision), registers(size_t(1) << precision, 0)
+    {
+        if (precision < 4 || precision > 18) {
+            throw std::runtime_error("HyperLogLog precision must be in [4, 18]");
+        }
+    }
+
+    void HyperLogLog::add_hash(uint64_t hash)
+    {
+        size_t index = hash >> (64 - precision);
+        // the rank of the first 1 bit after the index bits, bounded by the sentinel bit
+        uint64_t rest = (hash << precision) | (uint64_t(1) << (precision - 1));
+        auto rank = static_cast<uint8_t>(std::countl_zero(rest) + 1);
+        registers[index] = std::max(registers[index], rank);
+    }
+
+    void HyperLogLog::merge(const HyperLogLog& other)
+    {
+        if (other.precision != precision) {
+            throw std::runtime_error("HyperLogLog sketches of different precisions can not be merged");
+        }
+        for (size_t i = 0; i < registers.size(); i++) {
+            registers[i] = std::max(registers[i], other.registers[i]);
+        }
+    }
+
+    double HyperLogLog::estimate() const
+    {
+        double m = registers.size();
+        double sum = 0;
+        int zeros = 0;
+        for (auto r : registers) {
+            sum += std::ldexp(1.0, -r);
+            zeros += r == 0;
+        }
+        double alpha = 0.7213 / (1 + 1.079 / m);
+        double estimate = alpha * m * m / sum;
+        if (estimate <= 2.5 * m && zeros > 0) {
+            // small cardinalities: linear counting of the empty registers
+            estimate = m * std::log(m / zeros);
+        }
+        return estimate;
+    }
+
+    std::string HyperLogLog::serialize() const
+    {
+        std::string out;
+        out.reserve(1 + registers.size());
+        append<uint8_t>(out, precision);
+        out.append(reinterpret_cast<const char*>(registers.data()), registers.size());
+        return out;
+    }
+
+    HyperLogLog HyperLogLog::deserialize(std::string_view data)
+    {
+        size_t offset = 0;
+        HyperLogLog sketch(read<uint8_t>(data, offset));
+        if (data.size() - offset != sketch.registers.size()) {
+            throw std::runtime_error("Invalid HyperLogLog sketch");
+        }
+        std::memcpy(sketch.registers.data(), data.data() + offset, sketch.registers.size());
+        return sketch;
+    }
+
+    TDigest::TDigest(double compression)
+            : compression(compression), min(std::numeric_limits<double>::infinity()),
+              max(-std::numeric_limits<double>::infinity())
+    {
+    }
+
+    void TDigest::add(double value, double weight)
+    {
+        if (std::isnan(value) || weight <= 0) {
+            return;
+        }
+        unmerged.push_back({value, weight});
+        total_weight += weight;
+        min = std::min(min, value);
+        max = std::max(max, value);
+        if (unmerged.size() >= 5 * compression) {
+            compress();
+        }
+    }
+
+    void TDigest::merge(const TDigest& other)
+    {
+        unmerged.insert(unmerged.end(), other.centroids.begin(), other.centroids.end());
+        unmerged.insert(unmerged.end(), other.unmerged.begin(), other.unmerged.end());
+        total_weight += other.total_weight;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        compress();
+    }
+
+    /*
+     * Merge the sorted centroids greedily: a centroid grows while it spans at most
+     * one unit of the scale function k(q) = compression / (2 pi) * asin(2q - 1).
+     */
+    void TDigest::compress()
+    {
+        if (unmerged.empty()) {
+            return;
+        }
+        unmerged.insert(unmerged.end(), centroids.begin(), centroids.end());
+        std::sort(unmerged.begin(), unmerged.end(), [](const Centroid& a, const Centroid& b) {
+            return a.mean < b.mean;
+        });
+        auto k = [this](double q) { return compression / (2 * std::numbers::pi) * std::asin(2 * q - 1); };
+        auto k_inverse = [this](double k) { return (std::sin(k * 2 * std::numbers::pi / compression) + 1) / 2; };
+
+        centroids.clear();
+        double weight_so_far = 0;
+        double q_limit = k_inverse(k(0) + 1);
+        Centroid current = unmerged[0];
+        for (size_t i = 1; i < unmerged.size(); i++) {
+            auto& next = unmerged[i];
+            if ((weight_so_far + current.weight + next.weight) / total_weight <= q_limit) {
+                current.weight += next.weight;
+                current.mean += (next.mean - current.mean) * next.weight / current.weight;
+            }
+            else {
+                weight_so_far += current.weight;
+                centroids.push_back(current);
+                q_limit = k_inverse(k(weight_so_far / total_weight) + 1);
+                current = next;
+            }
+        }
+        centroids.push_back(current);
+        unmerged.clear();
+    }
+
+    double TDigest::quantile(double q)
+    {
+        compress();
+        if (centroids.empty()) {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        q = std::clamp(q, 0.0, 1.0);
+        double target = q * total_weight;
+        // interpolate between the centers of the centroids, and min / max at the ends
+        double center = centroids[0].weight / 2;
+        if (target <= center) {
+            return center > 0 ? min + (centroids[0].mean - min) * target / center : min;
+        }
+        for (size_t i = 0; i + 1 < centroids.size(); i++) {
+            double next_center = center + (centroids[i].weight + centroids[i + 1].weight) / 2;
+            if (target <= next_center) {
+                double t = (target - center) / (next_center - center);
+                return centroids[i].mean + (centroids[i + 1].mean - centroids[i].mean) * t;
+            }
+            center = next_center;
+        }
+        double rest = total_weight - center;
+        return rest > 0 ? centroids.back().mean + (max - centroids.back().mean) * (target - center) / rest : max;
+    }
+
+    std::string TDigest::serialize()
+    {
+        compress();
+        std::string out;
+        out.reserve(4 * sizeof(double) + centroids.size() * sizeof(Centroid));
+        append<double>(out, compression);
+        append<double>(out, min);
+        append<double>(out, max);
+        append<int64_t>(out, centroids.size());
+        for (auto& centroid : centroids) {
+            append<double>(out, centroid.mean);
+            append<double>(out, centroid.weight);
+        }
+        return out;
+    }
+
+    TDigest TDigest::deserialize(std::string_view data)
+    {
+        size_t offset = 0;
+        TDigest digest(read<double>(data, offset));
+        digest.min = read<double>(data, offset);
+        digest.max = read<double>(data, offset);
+        auto n = read<int64_t>(data, offset);
+        for (int64_t i = 0; i < n; i++) {
+            Centroid centroid;
+            centroid.mean = read<double>(data, offset);
+            centroid.weight = read<double>(data, offset);
+            digest.centroids.push_back(centroid);
+            digest.total_weight += centroid.weight;
+        }
+        return digest;
+    }
+
+    template <typename ArrayType>
+    static void hash_numbers(const arrow::Array& values, HyperLogLog& sketch)
+    {
+        auto& array = static_cast<const ArrayType&>(values);
+        for (int64_t i = 0; i < array.length(); i++) {
+            if (array.IsNull(i)) continue;
+            if constexpr (std::is_floating_point_v<typename ArrayType::value_type>) {
+                sketch.add_hash(hash_double(array.Value(i)));
+            }
+            else {
+                // the same integer has the same hash at any width
+                sketch.add_hash(mix64(static_cast<uint64_t>(static_cast<int64_t>(array.Value(i)))));
+            }
+        }
+    }
+
+    template <typename ArrayType>
+    static void add_numbers(const arrow::Array& values, TDigest& digest)
+    {
+        auto& array = static_cast<const ArrayType&>(values);
+        for (int64_t i = 0; i < array.length(); i++) {
+            if (!array.IsNull(i)) {
+                digest.add(static_cast<double>(array.Value(i)));
+            }
+        }
+    }
+
+    HyperLogLog hyperloglog_of(const arrow::Array& values)
+    {
+        HyperLogLog sketch;
+        switch (values.type_id()) {
+            case arrow::Type::INT64: hash_numbers<arrow::Int64Array>(values, sketch); break;
+            case arrow::Type::INT32: hash_numbers<arrow::Int32Array>(values, sketch); break;
+            case arrow::Type::INT16: hash_numbers<arrow::Int16Array>(values, sketch); break;
+            case arrow::Type::INT8: hash_numbers<arrow::Int8Array>(values, sketch); break;
+            case arrow::Type::DOUBLE: hash_numbers<arrow::DoubleArray>(values, sketch); break;
+            case arrow::Type::FLOAT: hash_numbers<arrow::FloatArray>(values, sketch); break;
+            case arrow::Type::BOOL: {
+                auto& array = static_cast<const arrow::BooleanArray&>(values);
+                for (int64_t i = 0; i < array.length(); i++) {
+                    if (!array.IsNull(i)) sketch.add_hash(mix64(array.Value(i)));
+                }
+                break;
+            }
+            case arrow::Type::STRING: {
+                auto& array = static_cast<const arrow::StringArray&>(values);
+                for (int64_t i = 0; i < array.length(); i++) {
+                    if (!array.IsNull(i)) sketch.add_hash(hash_bytes(array.GetView(i)));
+                }
+                break;
+            }
+            case arrow::Type::BINARY: {
+                auto& array = static_cast<const arrow::BinaryArray&>(values);
+                for (int64_t i = 0; i < array.length(); i++) {
+                    if (!array.IsNull(i)) sketch.merge(HyperLogLog::deserialize(array.GetView(i)));
+                }
+                break;
+            }
+            default:
+                throw std::runtime_error("HyperLogLog of unsupported type " + values.type()->ToString());
+        }
+        return sketch;
+    }
+
+    TDigest tdigest_of(const arrow::Array& values)
+    {
+        TDigest digest;
+        switch (values.type_id()) {
+            case arrow::Type::INT64: add_numbers<arrow::Int64Array>(values, digest); break;
+            case arrow::Type::INT32: add_numbers<arrow::Int32Array>(values, digest); break;
+            case arrow::Type::INT16: add_numbers<arrow::Int16Array>(values, digest); break;
+            case arrow::Type::INT8: add_numbers<arrow::Int8Array>(values, digest); break;
+            case arrow::Type::DOUBLE: add_numbers<arrow::DoubleArray>(values, digest); break;
+            case arrow::Type::FLOAT: add_numbers<arrow::FloatArray>(values, digest); break;
+            case arrow::Type::BINARY: {
+                auto& array = static_cast<const arrow::BinaryArray&>(values);
+                for (int64_t i = 0; i < array.length(); i++) {
+                    if (!array.IsNull(i)) digest.merge(TDigest::deserialize(array.GetView(i)));
+                }
+                break;
+            }
+            default:
+                throw std::runtime_error("t-digest of unsupported type " + values.type()->ToString());
+        }
+        return digest;
+    }
+}
@@ -0,0 +1,153 @@
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include "trace.h"
+#include "metrics.h"
+
+namespace pvd
+{
+    // the Chrome trace process of the events of this process
+    static int trace_pid()
+    {
+        return SENDER ? 2 : 1;
+    }
+
+    Tracer::Tracer()
+    {
+        auto env = std::getenv("PVD_TRACE");
+        enabled = !env || std::strcmp(env, "0") != 0;
+    }
+
+    Tracer& Tracer::instance()
+    {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    Tracer::Ring& Tracer::local_ring()
+    {
+        // the ring outlives its thread until it is drained
+        thread_local std::shared_ptr<Ring> ring = [this]() {
+            auto ring = std::make_shared<Ring>();
+            std::lock_guard<std::mutex> lock(rings_mutex);
+            ring->tid = next_tid++;
+            rings.push_back(ring);
+            return ring;
+        }();
+        return *ring;
+    }
+
+    void Tracer::record(const TraceEvent& event)
+    {
+        if (!enabled) {
+            return;
+        }
+        auto& ring = local_ring();
+        auto head = ring.head.load(std::memory_order_relaxed);
+        if (head - ring.tail.load(std::memory_order_acquire) >= Ring::CAPACITY) {
+            ring.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        ring.events[head % Ring::CAPACITY] = event;
+        ring.head.store(head + 1, std::memory_order_release);
+    }
+
+    static void append_event(std::string& out, const TraceEvent& event, int pid, int tid)
+    {
+        char buffer[512];
+        const char* category = event.kind == TraceEvent::Operator ? "operator" : "execute";
+        int n = std::snprintf(buffer, sizeof(buffer),
+                "{\"name\": \"%s[%d]\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": %d, \"tid\": %d, "
+                "\"ts\": %" PRIu64 ".%03" PRIu64 ", \"dur\": %" PRIu64 ".%03" PRIu64 ", \"args\": {\"id\": %d",
+                event.name, event.node_id, category, pid, tid,
+                event.start_ns / 1000, event.start_ns % 1000, event.duration_ns / 1000, event.duration_ns % 1000,
+                event.node_id);
+        out.append(buffer, n);
+        if (event.kind == TraceEvent::Operator) {
+            n = std::snprintf(buffer, sizeof(buffer),
+                    ", \"input_rows\": %" PRId64 ", \"output_rows\": %" PRId64 ", \"build_size\": %" PRId64
+                    ", \"plan_us\": %" PRIu64 ".%03" PRIu64,
+                    event.input_rows, event.output_rows, event.build_size, event.plan_ns / 1000, event.plan_ns % 1000);
+            out.append(buffer, n);
+        }
+        out += "}},\n";
+    }
+
+    std::string Tracer::drain_json()
+    {
+        std::lock_guard<std::mutex> drain_lock(drain_mutex);
+        std::vector<std::shared_ptr<Ring>> current;
+        {
+            std::lock_guard<std::mutex> lock(rings_mutex);
+            current = rings;
+        }
+
+        int pid = trace_pid();
+        std::string out;
+        uint64_t dropped = 0;
+        for (auto& ring : current) {
+            auto tail = ring->tail.load(std::memory_order_relaxed);
+            auto head = ring->head.load(std::memory_order_acquire);
+            for (auto i = tail; i < head; i++) {
+                append_event(out, ring->events[i % Ring::CAPACITY], pid, ring->tid);
+            }
+            ring->tail.store(head, std::memory_order_release);
+            dropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+        }
+        current.clear();
+        {
+            // forget the rings of the threads that have exited
+            std::lock_guard<std::mutex> lock(rings_mutex);
+            std::erase_if(rings, [](const std::shared_ptr<Ring>& ring) {
+                return ring.use_count() == 1 && ring->head.load() == ring->tail.load();
+            });
+        }
+        if (dropped > 0) {
+            out += trace_instant_json("dropped_events", "{\"count\": " + std::to_string(dropped) + "}");
+        }
+        if (!out.empty() && !process_named) {
+            process_named = true;
+            out = "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " + std::to_string(pid) +
+                  ", \"args\": {\"name\": \"" + (pid == 1 ? "server" : "client") + "\"}},\n" + out;
+        }
+        return out;
+    }
+
+    std::string trace_instant_json(const std::string& name, const std::string& args)
+    {
+        auto ts = trace_now_ns();
+        char buffer[256];
+        int n = std::snprintf(buffer, sizeof(buffer),
+                "{\"name\": \"%s\", \"ph\": \"i\", \"s\": \"p\", \"pid\": %d, \"tid\": 0, \"ts\": %" PRIu64 ".%03" PRIu64 ", \"args\": ",
+                name.c_str(), trace_pid(), ts / 1000, ts % 1000);
+        return std::string(buffer, n) + args + "},\n";
+    }
+
+    void flush_trace()
+    {
+        auto& tracer = Tracer::instance();
+        if (!tracer.is_enabled()) {
+            return;
+        }
+        auto events = tracer.drain_json();
+        if (!events.empty()) {
+            logging(events);
+        }
+    }
+
+    void start_trace_exporter(std::chrono::milliseconds interval)
+    {
+        if (!Tracer::instance().is_enabled()) {
+            return;
+        }
+        std::thread([interval]() {
+            while (true) {
+                std::this_thread::sleep_for(interval);
+                flush_trace();
+            }
+        }).detach();
+    }
+}
@@ -1,3 +1,7 @@
+import json
+import os
+
+
 class Memory:
     """
     A memory information contains two parts: server memory and client memory
@@ -264,3 +268,30 @@ memory_coef = \
            'output_num_string_cols': 2.1901878425442843e-06,
            'output_size': 6.319028272613862,
            'output_string_size': 17.311274971046945}}
+
+# ms to send a table to the client: per call and per value
+network_coef = {'bias': 0, 'input_size': 0.0001}
+
+
+def load_cost_profile(path: str) -> None:
+    """
+    Replace the coefficients with the ones measured on the current hardware by
+    `pvd_bench --calibrate <path>`. The operators (and sides) missing in the profile keep theirs.
+    The latency is per side, the memory and the network coefficients are only taken from a
+    server profile (the memory model is not per side).
+    """
+    with open(path) as f:
+        profile = json.load(f)
+    at_server = {"client": 0, "server": 1}
+    for node, sides in profile.get("latency", {}).items():
+        for side, coef in sides.items():
+            latency_coef[(node, at_server[side])] = coef
+    if profile.get("context", {}).get("side", "server") == "server":
+        memory_coef.update(profile.get("memory", {}))
+        network_coef.update(profile.get("network", {}))
+
+
+# e.g. PVD_COST_PROFILE=server_profile.json:client_profile.json
+for profile_path in os.environ.get("PVD_COST_PROFILE", "").split(os.pathsep):
+    if profile_path:
+        load_cost_profile(profile_path)
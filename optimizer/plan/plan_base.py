@@ -169,7 +169,7 @@ class Plan:
         if node in ["Projection", "HashTableQuery", "PrefixSumQuery", "PrefixSum2DQuery", "DCache", "SCache", "Cloud"]:
             return 1
         if node == "Network":
-            return column_info["input_num_cols"] * input_n_rows * 0.0001
+            return network_coef["bias"] + column_info["input_num_cols"] * input_n_rows * network_coef["input_size"]
 
         coef = latency_coef[(node, self.at_server())]
         return max(1, input_n_rows * coef["input_num_rows"] +